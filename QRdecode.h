@@ -4,6 +4,9 @@
 #include "passengers-staff.h" // PassengerData
 #include "tickets-QRgen.h" // Possibly Identity/Person
 #include "payments.h" // Staff/Admin
+#include "qrreader.hpp" // Native QR decoder
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -14,9 +17,161 @@
 #include "json.hpp"
 #include <iomanip>
 
+#ifdef METRO_WITH_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+#ifndef _WIN32
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using json = nlohmann::json;
 using namespace std;
 
+/*
+=======================================
+0. PERSISTENT SCANNER WORKER
+ScannerClient keeps "python3 QRscanner.py --serve" running and talks to it over a
+socket pair with length-prefixed frames (see the protocol in QRscanner.py), so each
+scan is one round trip instead of an interpreter launch, a camera open and decoded.json.
+=======================================
+*/
+class ScannerClient {
+public:
+    enum class Status { DECODED = 0, NOT_FOUND = 1, FAILED = 2, UNAVAILABLE = 3 };
+
+    explicit ScannerClient(const string& script = "QRscanner.py") : script(script) {}
+    ~ScannerClient() { stop(); }
+
+    // Owns a child process, so it cannot be copied
+    ScannerClient(const ScannerClient&) = delete;
+    ScannerClient& operator=(const ScannerClient&) = delete;
+
+    // Starts the worker if it is not running; false if it cannot be started on this platform
+    bool start() {
+#ifdef _WIN32
+        return false;  // No socketpair/fork; QrDecode falls back to callScript()
+#else
+        if (isRunning()) return true;
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            return false;
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+        if (pid == 0) {
+            // Child: the socket becomes stdin and stdout, stderr stays the terminal
+            dup2(fds[1], STDIN_FILENO);
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            execlp("python3", "python3", script.c_str(), "--serve", static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        close(fds[1]);
+        fd = fds[0];
+        child = pid;
+        return true;
+#endif
+    }
+
+    bool isRunning() const {
+#ifdef _WIN32
+        return false;
+#else
+        return child > 0;
+#endif
+    }
+
+    // Asks the worker to scan for up to timeoutMs; on DECODED, text holds the raw QR content,
+    // on FAILED the worker's message. A worker that died or broke the protocol is stopped and
+    // UNAVAILABLE is returned; the next call starts a new one.
+    Status scan(int timeoutMs, string& text) {
+        text.clear();
+        if (!start()) return Status::UNAVAILABLE;
+        // The first scan also opens the camera, so allow some time on top of the scan itself
+        if (!writeFrame("SCAN " + to_string(timeoutMs)) || !readFrame(response, timeoutMs + 15000)
+                || response.empty() || static_cast<unsigned char>(response[0]) > static_cast<int>(Status::FAILED)) {
+            stop();
+            return Status::UNAVAILABLE;
+        }
+        text.assign(response, 1, string::npos);
+        return static_cast<Status>(response[0]);
+    }
+
+    // Sends QUIT and waits for the worker to exit
+    void stop() {
+#ifndef _WIN32
+        if (!isRunning()) return;
+        writeFrame("QUIT");
+        close(fd);
+        fd = -1;
+        // Give it a moment to release the camera, then make sure it is gone
+        for (int i = 0; i < 100 && waitpid(child, nullptr, WNOHANG) == 0; i++)
+            usleep(20000);
+        if (waitpid(child, nullptr, WNOHANG) == 0) {
+            kill(child, SIGKILL);
+            waitpid(child, nullptr, 0);
+        }
+        child = -1;
+#endif
+    }
+
+private:
+    string script;
+    string response;   // Reused between scans
+#ifndef _WIN32
+    int fd = -1;
+    pid_t child = -1;
+
+    // Frames are a 4-byte big-endian length, then the payload
+    bool writeFrame(const string& payload) {
+        string frame(4, '\0');
+        uint32_t n = static_cast<uint32_t>(payload.size());
+        for (int i = 0; i < 4; i++)
+            frame[i] = static_cast<char>(n >> (24 - 8 * i));
+        frame += payload;
+        for (size_t done = 0; done < frame.size(); ) {
+            // MSG_NOSIGNAL: a dead worker must not kill the app with SIGPIPE
+            ssize_t k = send(fd, frame.data() + done, frame.size() - done, MSG_NOSIGNAL);
+            if (k <= 0) return false;
+            done += static_cast<size_t>(k);
+        }
+        return true;
+    }
+
+    bool readExactly(char* out, size_t len, int timeoutMs) {
+        for (size_t done = 0; done < len; ) {
+            pollfd p = { fd, POLLIN, 0 };
+            if (poll(&p, 1, timeoutMs) <= 0) return false;
+            ssize_t k = read(fd, out + done, len - done);
+            if (k <= 0) return false;
+            done += static_cast<size_t>(k);
+        }
+        return true;
+    }
+
+    bool readFrame(string& payload, int timeoutMs) {
+        unsigned char header[4];
+        if (!readExactly(reinterpret_cast<char*>(header), 4, timeoutMs)) return false;
+        uint32_t n = uint32_t(header[0]) << 24 | uint32_t(header[1]) << 16 | uint32_t(header[2]) << 8 | header[3];
+        if (n > (1u << 20)) return false;  // Far more than any QR code holds
+        payload.resize(n);
+        return readExactly(&payload[0], n, timeoutMs);
+    }
+#else
+    bool writeFrame(const string&) { return false; }
+    bool readFrame(string&, int) { return false; }
+#endif
+};
+
 /* 
 =======================================
 1. INHERITANCE + COMPOSITION
@@ -26,10 +181,143 @@ We own this pointer and use it to validate ticket stations
 */
 class QrDecode {
 protected:
-    MetroStation* metrostation;  // Composition: QrDecode *has-a* MetroStation
+    MetroStation* metrostation = nullptr;  // Composition: QrDecode *has-a* MetroStation
     json decoded;                // Stores decoded QR JSON content
+    QrReader reader;             // In-process decoder; keeps its buffers between frames
+    ScannerClient scanner;       // Long-lived QRscanner.py worker, started on first use
 
 public:
+    // True if this build can open the camera itself (built with -DMETRO_WITH_OPENCV);
+    // otherwise scanning falls back to callScript()
+    static bool hasNativeCamera() {
+#ifdef METRO_WITH_OPENCV
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Turns the raw text of a scanned code into decoded JSON, the same way QRscanner.py's
+    // parse_qr_data() does: compact ticket, then a JSON object (its "data" member if present),
+    // then comma-separated key:value pairs. Touches no files, so a gate can call it per passenger.
+    void parseScannedText(const string& raw) {
+        if (!decodeCompactText(raw)) {
+            json parsed = json::parse(raw, nullptr, false);
+            if (!parsed.is_discarded() && parsed.is_object()) {
+                decoded = parsed.contains("data") ? parsed["data"] : parsed;
+            } else {
+                decoded = json::object();
+                size_t start = 0;
+                while (start <= raw.size()) {
+                    size_t end = raw.find(',', start);
+                    if (end == string::npos) end = raw.size();
+                    string item = raw.substr(start, end - start);
+                    size_t colon = item.find(':');
+                    if (colon != string::npos)
+                        decoded[trim(item.substr(0, colon))] = trim(item.substr(colon + 1));
+                    else
+                        cout << "⚠️ Skipping invalid entry: " << item << endl;
+                    start = end + 1;
+                }
+            }
+        }
+    }
+
+    // parseScannedText(), then saves the result to decoded.json like the script
+    void handleScannedText(const string& raw) {
+        cout << "🔍 Raw QR Code Data: " << raw << endl;
+        parseScannedText(raw);
+
+        ofstream out("decoded.json");
+        out << setw(4) << decoded;
+        cout << "✅ Processed QR code data saved to decoded.json" << endl;
+    }
+
+    // Scans through the persistent Python worker. Returns false if nothing was read; if the
+    // worker cannot be run at all (e.g. on Windows), falls back to the one-shot callScript().
+    bool scanWithWorker(int timeoutMs = 30000) {
+        cout << "📷 Scanning for QR Code. Press 'q' in the camera window to stop." << endl;
+        string text;
+        switch (scanner.scan(timeoutMs, text)) {
+            case ScannerClient::Status::DECODED:
+                handleScannedText(text);
+                return true;
+            case ScannerClient::Status::NOT_FOUND:
+                cout << "⚠️ No QR code read." << endl;
+                return false;
+            case ScannerClient::Status::FAILED:
+                cerr << "❌ Scanner error: " << text << endl;
+                return false;
+            default:
+                cerr << "⚠️ Scanner worker unavailable, running the scanner script once." << endl;
+                callScript();
+                return ifstream("decoded.json").is_open();
+        }
+    }
+
+    // Decodes one frame in process (8-bit gray by default, or BGR as OpenCV captures it);
+    // returns false if it holds no readable code
+    bool decodeFrame(const uint8_t* pixels, int width, int height, int stride,
+                     QrReader::PixelFormat format = QrReader::PixelFormat::GRAY8) {
+        QrReader::Result result;
+        if (!reader.decode(pixels, width, height, stride, format, result))
+            return false;
+        handleScannedText(result.text);
+        return true;
+    }
+
+    // Decodes a saved PBM/PGM/PPM image, e.g. one written by QRGeneration::saveQRCodePGM()
+    bool decodeImageFile(const string& filename) {
+        int width = 0, height = 0;
+        vector<uint8_t> gray;
+        if (!QRImageReader::readFile(filename, width, height, gray)) {
+            cerr << "❌ Could not read image " << filename << " (expected PBM, PGM or PPM)" << endl;
+            return false;
+        }
+        auto start = chrono::steady_clock::now();
+        bool found = decodeFrame(gray.data(), width, height, width);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (found)
+            cout << "⏱️ Decoded in " << static_cast<long>(ms * 100 + 0.5) / 100.0 << " ms" << endl;
+        else
+            cerr << "❌ No readable QR code in " << filename << endl;
+        return found;
+    }
+
+    // Scans camera frames with the native decoder until a code is read or 'q' is pressed.
+    // Returns false if the camera cannot be opened or this build has no camera support.
+    bool scanWithCamera() {
+#ifdef METRO_WITH_OPENCV
+        remove("decoded.json");
+        cv::VideoCapture cap(0);
+        if (!cap.isOpened()) {
+            cerr << "❌ Cannot open camera. Check index/backends/permissions." << endl;
+            return false;
+        }
+        cap.set(cv::CAP_PROP_FRAME_WIDTH, 1280);
+        cap.set(cv::CAP_PROP_FRAME_HEIGHT, 720);
+
+        cout << "📷 Scanning for QR Code. Press 'q' to quit." << endl;
+        cv::namedWindow("QR Code Detection", cv::WINDOW_NORMAL);
+        cv::Mat frame;
+        bool found = false;
+        while (!found && cap.read(frame)) {
+            // The reader converts the BGR pixels to gray while thresholding them
+            found = frame.type() == CV_8UC3
+                && decodeFrame(frame.data, frame.cols, frame.rows, static_cast<int>(frame.step), QrReader::PixelFormat::BGR24);
+            cv::imshow("QR Code Detection", frame);
+            if ((cv::waitKey(1) & 0xFF) == 'q')
+                break;
+        }
+        cap.release();
+        cv::destroyAllWindows();
+        return found;
+#else
+        cerr << "⚠️ This build has no camera support (build with -DMETRO_WITH_OPENCV)." << endl;
+        return false;
+#endif
+    }
+
     void callScript() {
 #ifdef _WIN32
     // On Windows: assume 'python' is on PATH
@@ -73,7 +361,13 @@ public:
         try {
             file >> decoded;
             cout << "\n--- Parsed QR JSON ---\n";
-            cout << "Name: " << decoded["Name"] << "\n";
+            if (decoded.contains("TicketID")) {
+                // Compact tickets carry the ticket ID and station codes instead of the name
+                cout << "Ticket ID: " << decoded["TicketID"] << "\n";
+                cout << "Tickets: " << decoded["Tickets"] << "\n";
+            } else {
+                cout << "Name: " << decoded["Name"] << "\n";
+            }
             cout << "CNIC: " << decoded["CNIC"] << "\n";
             cout << "Departure: " << decoded["Departure"] << "\n";
             cout << "Arrival: " << decoded["Arrival"] << "\n";
@@ -82,28 +376,56 @@ public:
         }
     }
 
-    // Validate ticket against station codes
-    void validateTicketWithStations() {
+    // Decode the raw text of a compact ticket (see CompactTicketCodec) into the same
+    // JSON fields QRscanner.py writes for it. Station codes are kept in Departure/Arrival
+    // so validateTicketWithStations() can check them directly.
+    bool decodeCompactText(const string& raw) {
+        CompactTicket ticket;
+        if (!CompactTicketCodec::decode(raw, ticket))
+            return false;
+        decoded = {
+            {"Format", "compact"},
+            {"CNIC", ticket.cnic},
+            {"TicketID", ticket.ticketId},
+            {"Tickets", ticket.numberOfTickets},
+            {"Departure", ticket.departureCode},
+            {"Arrival", ticket.arrivalCode}
+        };
+        if (metrostation) {
+            decoded["DepartureName"] = metrostation->getStationNameByCode(ticket.departureCode);
+            decoded["ArrivalName"] = metrostation->getStationNameByCode(ticket.arrivalCode);
+        }
+        return true;
+    }
+
+    // Validate ticket against the stations: compact tickets carry station codes, and the JSON
+    // tickets this app issues carry station names (a JSON ticket with codes is accepted too)
+    bool validateTicketWithStations() {
         if (decoded.empty()) {
             cerr << "No QR data found to validate." << endl;
-            return;
+            return false;
+        }
+        if (!decoded.contains("Departure") || !decoded["Departure"].is_string()
+                || !decoded.contains("Arrival") || !decoded["Arrival"].is_string()) {
+            cerr << "❌ Invalid ticket. No stations in QR data.\n";
+            return false;
         }
 
-        string depCode = decoded["Departure"];
-        string arrCode = decoded["Arrival"];
-
-        bool depFound = false, arrFound = false;
+        const string& dep = decoded["Departure"].get_ref<const string&>();
+        const string& arr = decoded["Arrival"].get_ref<const string&>();
 
-        // Validate codes by iterating over stations
-        for (const Station& s : metrostation->returnStations()) {
-            if (s.getStationCode() == depCode) depFound = true;
-            if (s.getStationCode() == arrCode) arrFound = true;
-        }
+        // Look both up in the station indexes, without copying either
+        auto format = decoded.find("Format");
+        bool compact = format != decoded.end() && format->is_string()
+                    && format->get_ref<const string&>() == "compact";
+        bool depFound = hasStation(dep, compact);
+        bool arrFound = hasStation(arr, compact);
 
         if (depFound && arrFound)
             cout << "✅ Ticket is valid. Both stations exist.\n";
         else
             cerr << "❌ Invalid ticket. Station(s) not found.\n";
+        return depFound && arrFound;
     }
 
     // COMPOSITION: Set the station object
@@ -115,6 +437,20 @@ public:
     json getDecoded() const {
         return decoded;
     }
+
+private:
+    bool hasStation(const string& station, bool byCodeOnly) const {
+        if (!byCodeOnly && metrostation->findStationIdByName(station) != MetroStation::NO_STATION)
+            return true;
+        return metrostation->hasStationCode(station);
+    }
+
+    static string trim(const string& str) {
+        size_t first = str.find_first_not_of(" \t\r\n");
+        if (first == string::npos) return "";
+        size_t last = str.find_last_not_of(" \t\r\n");
+        return str.substr(first, last - first + 1);
+    }
 };
 
 /*
@@ -204,20 +540,35 @@ public:
             return;
         }
 
-        string name = decoded["Name"];
         bool found = false;
 
-        for (const auto& p : passengers) {
-            if (p.getName() == name) {
-                validatedName = name;
-                cout << "✅ Name matched.\n";
-                found = true;
-                break;
+        if (!decoded.contains("Name") && decoded.contains("CNIC")) {
+            // Compact tickets identify the passenger by CNIC only
+            string cnic = decoded["CNIC"];
+            for (const auto& p : passengers) {
+                string stored = p.getCnic();
+                stored.erase(remove(stored.begin(), stored.end(), '-'), stored.end());
+                if (stored == cnic) {
+                    validatedName = p.getName();
+                    cout << "✅ CNIC matched.\n";
+                    found = true;
+                    break;
+                }
+            }
+        } else {
+            string name = decoded["Name"];
+            for (const auto& p : passengers) {
+                if (p.getName() == name) {
+                    validatedName = name;
+                    cout << "✅ Name matched.\n";
+                    found = true;
+                    break;
+                }
             }
         }
 
         if (!found) {
-            cout << "❌ Name not found.\n";
+            cout << "❌ Passenger not found.\n";
         }
     }
 
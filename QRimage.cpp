@@ -0,0 +1,628 @@
+#include "QRimage.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// ******************** PNG / zlib building blocks ***************************
+namespace {
+
+// CRC-32 (polynomial 0xEDB88320) as used by PNG chunks, table built once on first use
+const uint32_t* crcTable() {
+    static const struct Table {
+        uint32_t values[256];
+        Table() {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                values[n] = c;
+            }
+        }
+    } table;
+    return table.values;
+}
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+    const uint32_t* t = crcTable();
+    for (size_t i = 0; i < len; i++)
+        crc = t[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+// Adler-32 checksum of the uncompressed zlib data
+class Adler32 {
+    uint32_t s1 = 1, s2 = 0;
+public:
+    void update(const uint8_t* data, size_t len) {
+        while (len > 0) {
+            size_t n = len < 5552 ? len : 5552;  // Largest block that cannot overflow s2
+            for (size_t i = 0; i < n; i++) {
+                s1 += data[i];
+                s2 += s1;
+            }
+            s1 %= 65521;
+            s2 %= 65521;
+            data += n;
+            len -= n;
+        }
+    }
+    uint32_t value() const { return s2 << 16 | s1; }
+};
+
+// Writes into a caller buffer and remembers if it ran out of room
+class ByteOut {
+    uint8_t* out;
+    size_t capacity;
+    size_t length = 0;
+    bool overflow = false;
+public:
+    ByteOut(uint8_t* o, size_t cap) : out(o), capacity(cap) {}
+
+    void put(uint8_t b) {
+        if (length < capacity) out[length++] = b;
+        else overflow = true;
+    }
+    void putBytes(const void* data, size_t len) {
+        if (capacity - length < len) {
+            overflow = true;
+            return;
+        }
+        memcpy(out + length, data, len);
+        length += len;
+    }
+    void putBE32(uint32_t v) {
+        put(static_cast<uint8_t>(v >> 24));
+        put(static_cast<uint8_t>(v >> 16));
+        put(static_cast<uint8_t>(v >> 8));
+        put(static_cast<uint8_t>(v));
+    }
+    void patchBE32(size_t at, uint32_t v) {
+        if (at + 4 > length) return;
+        out[at] = static_cast<uint8_t>(v >> 24);
+        out[at + 1] = static_cast<uint8_t>(v >> 16);
+        out[at + 2] = static_cast<uint8_t>(v >> 8);
+        out[at + 3] = static_cast<uint8_t>(v);
+    }
+    uint8_t* data() { return out; }
+    size_t size() const { return length; }
+    bool failed() const { return overflow; }
+};
+
+// Deflate bit stream: bits are packed starting at the least significant bit of each byte
+class BitOut {
+    ByteOut& bytes;
+    uint64_t buffer = 0;
+    int count = 0;
+public:
+    explicit BitOut(ByteOut& b) : bytes(b) {}
+
+    void writeBits(uint32_t value, int len) {
+        buffer |= static_cast<uint64_t>(value) << count;
+        count += len;
+        while (count >= 8) {
+            bytes.put(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            count -= 8;
+        }
+    }
+    // Huffman codes are defined most significant bit first
+    void writeCode(uint32_t code, int len) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < len; i++)
+            reversed |= ((code >> i) & 1) << (len - 1 - i);
+        writeBits(reversed, len);
+    }
+    void alignToByte() {
+        if (count > 0)
+            writeBits(0, 8 - count);
+    }
+};
+
+const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                              35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                               3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const int DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const int DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                             7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+const size_t MAX_DISTANCE = 32768;
+const size_t MAX_STORED_BLOCK = 65535;
+
+// One fixed-Huffman deflate block (BTYPE = 01)
+class FixedHuffmanBlock {
+    BitOut& bits;
+
+    void writeSymbol(int sym) {
+        if (sym < 144)      bits.writeCode(0x30 + sym, 8);
+        else if (sym < 256) bits.writeCode(0x190 + sym - 144, 9);
+        else if (sym < 280) bits.writeCode(sym - 256, 7);
+        else                bits.writeCode(0xC0 + sym - 280, 8);
+    }
+    void writeMatch(int length, int distance) {
+        int i = 28;
+        while (LENGTH_BASE[i] > length) i--;
+        writeSymbol(257 + i);
+        bits.writeBits(length - LENGTH_BASE[i], LENGTH_EXTRA[i]);
+        int d = 29;
+        while (DIST_BASE[d] > distance) d--;
+        bits.writeCode(d, 5);
+        bits.writeBits(distance - DIST_BASE[d], DIST_EXTRA[d]);
+    }
+
+public:
+    explicit FixedHuffmanBlock(BitOut& b) : bits(b) {
+        bits.writeBits(1, 1);  // BFINAL
+        bits.writeBits(1, 2);  // Fixed Huffman codes
+    }
+    void finish() { writeSymbol(256); }
+
+    void literal(uint8_t b) { writeSymbol(b); }
+
+    // Emits src[0 .. len) which equals the data `distance` bytes back;
+    // pieces too short for a match fall back to literals
+    void copy(const uint8_t* src, size_t len, size_t distance) {
+        while (len >= 3) {
+            size_t take = len < 258 ? len : 258;
+            if (len - take == 1 || len - take == 2)
+                take = len - 3;  // Leave a valid 3-byte match at the end
+            writeMatch(static_cast<int>(take), static_cast<int>(distance));
+            src += take;
+            len -= take;
+        }
+        for (size_t i = 0; i < len; i++)
+            literal(src[i]);
+    }
+
+    // Emits data that may repeat bytes: each run of equal bytes becomes a literal plus a distance-1 match
+    void runs(const uint8_t* data, size_t len) {
+        size_t i = 0;
+        while (i < len) {
+            literal(data[i]);
+            size_t j = i + 1;
+            while (j < len && data[j] == data[i]) j++;
+            copy(data + i + 1, j - i - 1, 1);
+            i = j;
+        }
+    }
+};
+
+void writeChunkHeader(ByteOut& out, uint32_t length, const char* type) {
+    out.putBE32(length);
+    out.putBytes(type, 4);
+}
+
+// Appends the CRC of the chunk that started at chunkStart (its length field)
+void writeChunkCrc(ByteOut& out, size_t chunkStart) {
+    if (out.failed()) return;
+    uint32_t crc = crc32Update(0xFFFFFFFFu, out.data() + chunkStart + 4, out.size() - chunkStart - 4);
+    out.putBE32(crc ^ 0xFFFFFFFFu);
+}
+
+// Expands module row moduleY (which may lie in the border) into one pixel row.
+// oneBit packs 8 pixels per byte, most significant first, where dark pixels are
+// darkBit and padding bits are 0; otherwise each pixel is a byte, 0 = dark, 255 = light.
+void fillPixelRow(const QrCode& qr, int moduleY, int border, int scale, bool oneBit, bool darkBit, uint8_t* out) {
+    const int qrSize = qr.getSize();
+    const uint64_t* row = (moduleY >= 0 && moduleY < qrSize) ? qr.getModules().row(moduleY) : nullptr;
+    uint32_t acc = 0;
+    int accBits = 0;
+    for (int mx = -border; mx < qrSize + border; mx++) {
+        bool dark = row != nullptr && mx >= 0 && mx < qrSize && ((row[mx >> 6] >> (mx & 63)) & 1) != 0;
+        if (!oneBit) {
+            memset(out, dark ? 0 : 255, static_cast<size_t>(scale));
+            out += scale;
+            continue;
+        }
+        uint32_t bit = dark == darkBit ? 1 : 0;
+        for (int k = 0; k < scale; k++) {
+            acc = acc << 1 | bit;
+            if (++accBits == 8) {
+                *out++ = static_cast<uint8_t>(acc);
+                acc = 0;
+                accBits = 0;
+            }
+        }
+    }
+    if (accBits > 0)
+        *out = static_cast<uint8_t>(acc << (8 - accBits));
+}
+
+} // namespace
+
+
+// ******************** QR PNG Writer Class ***************************
+QRPngWriter::QRPngWriter(int s, int b, BitDepth d, Compression c)
+    : scale(s), border(b), depth(d), compression(c) {
+    if (scale < 1 || border < 0)
+        throw invalid_argument("Invalid PNG scale or border");
+}
+
+int QRPngWriter::imageSize(const QrCode& qr) const {
+    return (qr.getSize() + 2 * border) * scale;
+}
+
+size_t QRPngWriter::scanlineBytes(const QrCode& qr) const {
+    size_t width = static_cast<size_t>(imageSize(qr));
+    return 1 + (depth == BitDepth::GRAY_1 ? (width + 7) / 8 : width);
+}
+
+size_t QRPngWriter::maxEncodedSize(const QrCode& qr) const {
+    size_t raw = scanlineBytes(qr) * static_cast<size_t>(imageSize(qr));
+    // Fixed Huffman literals take at most 9 bits; stored blocks add 5 bytes per 64 KiB;
+    // plus signature, IHDR, IDAT and IEND framing, and the zlib header and checksum
+    return raw + raw / 8 + 5 * (raw / MAX_STORED_BLOCK + 1) + 128;
+}
+
+void QRPngWriter::buildScanline(const QrCode& qr, int moduleY) {
+    scanline[0] = 0;  // Filter type: none
+    fillPixelRow(qr, moduleY, border, scale, depth == BitDepth::GRAY_1, false, scanline.data() + 1);
+}
+
+size_t QRPngWriter::encode(const QrCode& qr, uint8_t* dest, size_t capacity) {
+    const int size = imageSize(qr);
+    const size_t stride = scanlineBytes(qr);
+    const size_t rawTotal = stride * static_cast<size_t>(size);
+    scanline.assign(stride, 0);
+    prevScanline.assign(stride, 0);
+
+    ByteOut out(dest, capacity);
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.putBytes(SIGNATURE, sizeof(SIGNATURE));
+
+    size_t chunkStart = out.size();
+    writeChunkHeader(out, 13, "IHDR");
+    out.putBE32(static_cast<uint32_t>(size));
+    out.putBE32(static_cast<uint32_t>(size));
+    out.put(static_cast<uint8_t>(depth));
+    out.put(0);  // Color type: grayscale
+    out.put(0);  // Compression method
+    out.put(0);  // Filter method
+    out.put(0);  // No interlace
+    writeChunkCrc(out, chunkStart);
+
+    chunkStart = out.size();
+    writeChunkHeader(out, 0, "IDAT");  // Length is patched below
+    out.put(0x78);  // zlib: deflate, 32 KiB window
+    out.put(0x01);  // No preset dictionary, fastest level; header is a multiple of 31
+
+    Adler32 adler;
+    BitOut bits(out);
+    optional<FixedHuffmanBlock> block;
+    if (compression == Compression::FAST)
+        block.emplace(bits);
+    size_t rawDone = 0;
+    size_t storedLeft = 0;  // Bytes remaining in the current stored block
+
+    for (int my = -border; my < qr.getSize() + border; my++) {
+        buildScanline(qr, my);
+        bool sameAsPrevious = my > -border && scanline == prevScanline;
+        for (int rep = 0; rep < scale; rep++) {
+            adler.update(scanline.data(), stride);
+            if (compression == Compression::STORED) {
+                for (size_t pos = 0; pos < stride; ) {
+                    if (storedLeft == 0) {
+                        size_t blockLen = rawTotal - rawDone < MAX_STORED_BLOCK ? rawTotal - rawDone : MAX_STORED_BLOCK;
+                        bits.writeBits(rawDone + blockLen == rawTotal ? 1 : 0, 1);  // BFINAL
+                        bits.writeBits(0, 2);                                       // Stored
+                        bits.alignToByte();
+                        bits.writeBits(static_cast<uint32_t>(blockLen), 16);
+                        bits.writeBits(static_cast<uint32_t>(~blockLen & 0xFFFF), 16);
+                        storedLeft = blockLen;
+                    }
+                    size_t n = stride - pos < storedLeft ? stride - pos : storedLeft;
+                    out.putBytes(scanline.data() + pos, n);
+                    pos += n;
+                    storedLeft -= n;
+                    rawDone += n;
+                }
+            } else {
+                if ((rep > 0 || sameAsPrevious) && stride <= MAX_DISTANCE)
+                    block->copy(scanline.data(), stride, stride);
+                else
+                    block->runs(scanline.data(), stride);
+            }
+        }
+        scanline.swap(prevScanline);
+    }
+    if (block)
+        block->finish();
+    bits.alignToByte();
+    out.putBE32(adler.value());
+    out.patchBE32(chunkStart, static_cast<uint32_t>(out.size() - chunkStart - 8));
+    writeChunkCrc(out, chunkStart);
+
+    chunkStart = out.size();
+    writeChunkHeader(out, 0, "IEND");
+    writeChunkCrc(out, chunkStart);
+
+    return out.failed() ? 0 : out.size();
+}
+
+const vector<uint8_t>& QRPngWriter::encode(const QrCode& qr) {
+    output.resize(maxEncodedSize(qr));
+    output.resize(encode(qr, output.data(), output.size()));
+    return output;
+}
+
+bool QRPngWriter::writeFile(const QrCode& qr, const string& filename) {
+    const vector<uint8_t>& png = encode(qr);
+    ofstream file(filename, ios::binary);
+    if (!file.is_open() || png.empty())
+        return false;
+    file.write(reinterpret_cast<const char*>(png.data()), static_cast<streamsize>(png.size()));
+    return static_cast<bool>(file);
+}
+
+int QRPngWriter::getScale() const {
+    return scale;
+}
+int QRPngWriter::getBorder() const {
+    return border;
+}
+QRPngWriter::BitDepth QRPngWriter::getDepth() const {
+    return depth;
+}
+QRPngWriter::Compression QRPngWriter::getCompression() const {
+    return compression;
+}
+
+
+// ******************** QR Stream Writer Class ***************************
+void QRStreamWriter::writeSVG(const QrCode& qr, ostream& out, int border, int scale) {
+    if (scale < 1 || border < 0)
+        throw invalid_argument("Invalid SVG scale or border");
+    const int qrSize = qr.getSize();
+    const int dim = qrSize + border * 2;
+    const BitGrid& grid = qr.getModules();
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" width=\"" << dim * scale
+        << "\" height=\"" << dim * scale << "\" viewBox=\"0 0 " << dim << " " << dim << "\" stroke=\"none\">\n"
+        << "\t<rect width=\"100%\" height=\"100%\" fill=\"#FFFFFF\"/>\n"
+        << "\t<path fill=\"#000000\" d=\"";
+
+    bool first = true;
+    for (int y = 0; y < qrSize; y++) {
+        const uint64_t* row = grid.row(y);
+        int x = 0;
+        while (x < qrSize) {
+            // Skip light modules, then measure the dark run, a word at a time
+            uint64_t word = row[x >> 6] >> (x & 63);
+            if ((word & 1) == 0) {
+                if (word == 0) {
+                    x = (x | 63) + 1;
+                    continue;
+                }
+                while ((word & 1) == 0) {
+                    word >>= 1;
+                    x++;
+                }
+            }
+            int start = x;
+            while (x < qrSize && ((row[x >> 6] >> (x & 63)) & 1) != 0)
+                x++;
+            if (!first)
+                out << ' ';
+            out << 'M' << start + border << ',' << y + border << 'h' << x - start << "v1h-" << x - start << 'z';
+            first = false;
+        }
+    }
+    out << "\"/>\n</svg>\n";
+}
+
+void QRStreamWriter::writePBM(const QrCode& qr, ostream& out, int border, int scale) {
+    writeRaster(qr, out, border, scale, true);
+}
+
+void QRStreamWriter::writePGM(const QrCode& qr, ostream& out, int border, int scale) {
+    writeRaster(qr, out, border, scale, false);
+}
+
+void QRStreamWriter::writeRaster(const QrCode& qr, ostream& out, int border, int scale, bool oneBit) {
+    if (scale < 1 || border < 0)
+        throw invalid_argument("Invalid image scale or border");
+    const int qrSize = qr.getSize();
+    const int width = (qrSize + border * 2) * scale;
+    out << (oneBit ? "P4\n" : "P5\n") << width << ' ' << width << '\n';
+    if (!oneBit)
+        out << "255\n";
+
+    // Only one pixel row is held at a time; it is written scale times
+    vector<uint8_t> row(oneBit ? (static_cast<size_t>(width) + 7) / 8 : static_cast<size_t>(width));
+    for (int my = -border; my < qrSize + border; my++) {
+        fillPixelRow(qr, my, border, scale, oneBit, true, row.data());
+        for (int k = 0; k < scale; k++)
+            out.write(reinterpret_cast<const char*>(row.data()), static_cast<streamsize>(row.size()));
+    }
+}
+
+
+// ******************** QR Image Reader Class ***************************
+bool QRImageReader::readNumber(istream& in, int& value) {
+    int c = in.get();
+    while (c != EOF && (isspace(c) || c == '#')) {
+        if (c == '#') {
+            while (c != EOF && c != '\n')
+                c = in.get();
+        }
+        c = in.get();
+    }
+    if (c == EOF || !isdigit(c))
+        return false;
+    long v = 0;
+    for (; c != EOF && isdigit(c); c = in.get()) {
+        v = v * 10 + (c - '0');
+        if (v > (1 << 24))
+            return false;
+    }
+    // The single whitespace character after the last header field is consumed here
+    if (c != EOF && !isspace(c))
+        in.unget();
+    value = static_cast<int>(v);
+    return true;
+}
+
+bool QRImageReader::readPNM(istream& in, int& width, int& height, vector<uint8_t>& gray) {
+    char magic[2];
+    if (!in.read(magic, 2) || magic[0] != 'P' || magic[1] < '1' || magic[1] > '6')
+        return false;
+    const int kind = magic[1] - '0';
+    const bool bitmap = kind == 1 || kind == 4, color = kind == 3 || kind == 6, binary = kind >= 4;
+    int maxval = 1;
+    if (!readNumber(in, width) || !readNumber(in, height) || width < 1 || height < 1
+            || static_cast<long long>(width) * height > (1LL << 28))
+        return false;
+    if (!bitmap && (!readNumber(in, maxval) || maxval < 1 || maxval > 65535))
+        return false;
+
+    gray.resize(static_cast<size_t>(width) * height);
+    const int channels = color ? 3 : 1;
+    const int sampleBytes = maxval > 255 ? 2 : 1;
+    vector<uint8_t> row;
+    if (binary)
+        row.resize(bitmap ? (static_cast<size_t>(width) + 7) / 8 : static_cast<size_t>(width) * channels * sampleBytes);
+
+    for (int y = 0; y < height; y++) {
+        uint8_t* out = &gray[static_cast<size_t>(y) * width];
+        if (binary && !in.read(reinterpret_cast<char*>(row.data()), static_cast<streamsize>(row.size())))
+            return false;
+        for (int x = 0; x < width; x++) {
+            if (bitmap) {
+                // PBM stores 1 for dark
+                int bit;
+                if (binary) {
+                    bit = (row[x >> 3] >> (7 - (x & 7))) & 1;
+                } else {
+                    // Plain PBM digits need not be separated
+                    char c;
+                    if (!(in >> c) || (c != '0' && c != '1'))
+                        return false;
+                    bit = c - '0';
+                }
+                out[x] = bit ? 0 : 255;
+                continue;
+            }
+            int v[3];
+            for (int c = 0; c < channels; c++) {
+                if (!binary) {
+                    if (!readNumber(in, v[c]))
+                        return false;
+                } else if (sampleBytes == 2) {
+                    size_t i = (static_cast<size_t>(x) * channels + c) * 2;
+                    v[c] = row[i] << 8 | row[i + 1];
+                } else {
+                    v[c] = row[static_cast<size_t>(x) * channels + c];
+                }
+                if (v[c] > maxval)
+                    v[c] = maxval;
+            }
+            int luma = color ? (v[0] * 299 + v[1] * 587 + v[2] * 114 + 500) / 1000 : v[0];
+            out[x] = static_cast<uint8_t>((luma * 255 + maxval / 2) / maxval);
+        }
+    }
+    return true;
+}
+
+bool QRImageReader::readFile(const string& filename, int& width, int& height, vector<uint8_t>& gray) {
+    ifstream file(filename, ios::binary);
+    return file.is_open() && readPNM(file, width, height, gray);
+}
+
+
+// ******************** QR Terminal Renderer Class ***************************
+QRTerminalRenderer::QRTerminalRenderer(Style s, int b) : style(s), border(b) {
+    if (border < 0)
+        throw invalid_argument("Invalid border");
+}
+
+const string& QRTerminalRenderer::render(const QrCode& qr) {
+    frame.clear();
+    if (style == Style::HALF_BLOCKS)
+        renderHalfBlocks(qr);
+    else
+        renderInverse(qr);
+    return frame;
+}
+
+void QRTerminalRenderer::renderHalfBlocks(const QrCode& qr) {
+    static const char* const GLYPHS[4] = { " ", "\u2580", "\u2584", "\u2588" };  // none, top, bottom, both
+    const int qrSize = qr.getSize();
+    const int dim = qrSize + border * 2;
+    const size_t lines = static_cast<size_t>(dim + 1) / 2;
+    frame.reserve(lines * (static_cast<size_t>(dim) * 3 + 1));  // Each glyph is at most 3 bytes of UTF-8
+
+    const BitGrid& grid = qr.getModules();
+    auto rowOf = [&](int my) -> const uint64_t* {
+        return (my >= 0 && my < qrSize) ? grid.row(my) : nullptr;
+    };
+    for (int my = -border; my < qrSize + border; my += 2) {
+        const uint64_t* top = rowOf(my);
+        const uint64_t* bottom = my + 1 < qrSize + border ? rowOf(my + 1) : nullptr;
+        for (int mx = -border; mx < qrSize + border; mx++) {
+            int cell = 0;
+            if (mx >= 0 && mx < qrSize) {
+                if (top != nullptr && ((top[mx >> 6] >> (mx & 63)) & 1) != 0) cell |= 1;
+                if (bottom != nullptr && ((bottom[mx >> 6] >> (mx & 63)) & 1) != 0) cell |= 2;
+            }
+            frame += GLYPHS[cell];
+        }
+        frame += '\n';
+    }
+}
+
+void QRTerminalRenderer::renderInverse(const QrCode& qr) {
+    static const char INVERSE_ON[] = "\x1b[7m";
+    static const char INVERSE_OFF[] = "\x1b[0m";
+    const int qrSize = qr.getSize();
+    const size_t dim = static_cast<size_t>(qrSize + border * 2);
+    // Two spaces per module, plus at most one escape sequence (4 bytes) per module and at each line end
+    frame.reserve(dim * (dim * 2 + (dim + 1) * 4 + 1));
+
+    const BitGrid& grid = qr.getModules();
+    for (int my = -border; my < qrSize + border; my++) {
+        const uint64_t* row = (my >= 0 && my < qrSize) ? grid.row(my) : nullptr;
+        bool inverse = false;
+        for (int mx = -border; mx < qrSize + border; mx++) {
+            bool dark = row != nullptr && mx >= 0 && mx < qrSize && ((row[mx >> 6] >> (mx & 63)) & 1) != 0;
+            if (dark != inverse) {
+                frame += dark ? INVERSE_ON : INVERSE_OFF;
+                inverse = dark;
+            }
+            frame += "  ";
+        }
+        if (inverse)
+            frame += INVERSE_OFF;
+        frame += '\n';
+    }
+}
+
+size_t QRTerminalRenderer::print(const QrCode& qr, int fd) {
+    render(qr);
+    const char* data = frame.data();
+    size_t left = frame.size();
+    while (left > 0) {  // Normally a single call; loops only on partial writes and signals
+#ifdef _WIN32
+        int n = _write(fd, data, static_cast<unsigned>(left));
+#else
+        ssize_t n = write(fd, data, left);
+#endif
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        data += n;
+        left -= static_cast<size_t>(n);
+    }
+    return frame.size() - left;
+}
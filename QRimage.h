@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "qrcodegen.hpp"
+
+using namespace std;
+using namespace qrcodegen;
+
+// ******************** QR PNG Writer Class ***************************
+// Encodes a QrCode as a grayscale PNG without any image library.
+// Scanlines are built straight from the QR bit grid (dark = 0, light = 255),
+// so the pixels match the old OpenCV output for the same scale and border.
+// One writer keeps its scanline and output buffers between calls; use one per thread.
+class QRPngWriter {
+public:
+    enum class BitDepth { GRAY_1 = 1, GRAY_8 = 8 };
+
+    // STORED copies the scanlines into uncompressed deflate blocks.
+    // FAST uses fixed Huffman codes with two kinds of matches: runs of equal bytes
+    // (distance 1) and whole scanlines repeated from the row above (distance = stride).
+    enum class Compression { STORED, FAST };
+
+    QRPngWriter(int scale = 10, int border = 4, BitDepth depth = BitDepth::GRAY_1,
+                Compression compression = Compression::FAST);
+
+    // Upper bound on the encoded size of the given code, for sizing caller buffers
+    size_t maxEncodedSize(const QrCode& qr) const;
+
+    // Writes the PNG into out; returns the number of bytes written,
+    // or 0 if capacity is smaller than needed
+    size_t encode(const QrCode& qr, uint8_t* out, size_t capacity);
+
+    // Returns the PNG in the writer's internal buffer, valid until the next call
+    const vector<uint8_t>& encode(const QrCode& qr);
+
+    bool writeFile(const QrCode& qr, const string& filename);
+
+    int getScale() const;
+    int getBorder() const;
+    BitDepth getDepth() const;
+    Compression getCompression() const;
+
+private:
+    int scale;
+    int border;
+    BitDepth depth;
+    Compression compression;
+
+    vector<uint8_t> scanline;      // filter byte + packed pixels
+    vector<uint8_t> prevScanline;
+    vector<uint8_t> output;
+
+    int imageSize(const QrCode& qr) const;
+    size_t scanlineBytes(const QrCode& qr) const;
+    void buildScanline(const QrCode& qr, int moduleY);
+};
+
+
+// ******************** QR Stream Writer Class ***************************
+// Compact output modes that stream straight to an ostream, one row at a time,
+// without building an intermediate image. border is in modules, scale in pixels
+// (or SVG user units) per module.
+class QRStreamWriter {
+public:
+    // One <path> made of a rectangle subpath per horizontal run of dark modules
+    static void writeSVG(const QrCode& qr, ostream& out, int border = 4, int scale = 1);
+
+    // Binary PBM (P4): 1 bit per pixel, 1 = dark
+    static void writePBM(const QrCode& qr, ostream& out, int border = 4, int scale = 1);
+
+    // Binary PGM (P5): 8 bits per pixel, 0 = dark, 255 = light
+    static void writePGM(const QrCode& qr, ostream& out, int border = 4, int scale = 1);
+
+private:
+    static void writeRaster(const QrCode& qr, ostream& out, int border, int scale, bool oneBit);
+};
+
+
+// ******************** QR Image Reader Class ***************************
+// Loads the Netpbm images that QRStreamWriter writes (and that most capture tools can
+// save) as 8-bit grayscale for QrReader, 0 = dark. Reads P1 to P6; color pixels are
+// converted with the usual luma weights and other maxvals are rescaled to 255.
+class QRImageReader {
+public:
+    // Returns false if the stream is not a complete PNM image; gray is resized to width * height
+    static bool readPNM(istream& in, int& width, int& height, vector<uint8_t>& gray);
+    static bool readFile(const string& filename, int& width, int& height, vector<uint8_t>& gray);
+
+private:
+    // Next decimal header field, skipping whitespace and # comments
+    static bool readNumber(istream& in, int& value);
+};
+
+
+// ******************** QR Terminal Renderer Class ***************************
+// Draws a QrCode for consoles (gates over serial/SSH). The whole frame is built
+// in one preallocated string and written with a single write() call, so there is
+// no per-line flushing. Dark modules are drawn filled, as printQr always did.
+class QRTerminalRenderer {
+public:
+    // HALF_BLOCKS packs two module rows into each line with the glyphs ▀ ▄ █.
+    // ANSI_INVERSE is for terminals without those glyphs: one line per module row,
+    // two spaces per module, dark runs in inverse video.
+    enum class Style { HALF_BLOCKS, ANSI_INVERSE };
+
+    QRTerminalRenderer(Style style = Style::HALF_BLOCKS, int border = 0);
+
+    // Returns the frame in the renderer's buffer, valid until the next call
+    const string& render(const QrCode& qr);
+
+    // Renders and writes the frame to the given file descriptor (stdout by default), retrying
+    // interrupted writes. Returns the number of bytes written, less than getFrame().size() on error
+    size_t print(const QrCode& qr, int fd = 1);
+
+    // The last rendered frame
+    const string& getFrame() const { return frame; }
+
+private:
+    Style style;
+    int border;
+    string frame;
+
+    void renderHalfBlocks(const QrCode& qr);
+    void renderInverse(const QrCode& qr);
+};
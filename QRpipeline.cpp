@@ -0,0 +1,376 @@
+#include "QRpipeline.h"
+#include "QRimage.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <streambuf>
+
+#ifdef METRO_WITH_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+// ******************** QR Frame Source ***************************
+namespace {
+
+// Lets QRImageReader parse the PGM stream of a pipe
+class StdioStreamBuf : public streambuf {
+public:
+    explicit StdioStreamBuf(FILE* f) : file(f) {}
+
+protected:
+    int_type underflow() override {
+        size_t n = fread(buffer, 1, sizeof(buffer), file);
+        if (n == 0)
+            return traits_type::eof();
+        setg(buffer, buffer, buffer + n);
+        return traits_type::to_int_type(buffer[0]);
+    }
+
+private:
+    FILE* file;
+    char buffer[1 << 16];
+};
+
+// The ffmpeg child and the stream over its output, closed with the last copy of the source
+struct PipeState {
+    FILE* pipe;
+    StdioStreamBuf buf;
+    istream in;
+
+    explicit PipeState(FILE* p) : pipe(p), buf(p), in(&buf) {}
+    ~PipeState() {
+#ifdef _WIN32
+        _pclose(pipe);
+#else
+        pclose(pipe);
+#endif
+    }
+};
+
+bool isImageFile(const filesystem::path& path) {
+    string ext = path.extension().string();
+    transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    return ext == ".pgm" || ext == ".pbm" || ext == ".ppm" || ext == ".pnm";
+}
+
+#ifdef METRO_WITH_OPENCV
+// Copies a BGR capture as it is into tightly packed bytes; the reader does the gray conversion
+QRFrameSource::Next fromCapture(shared_ptr<cv::VideoCapture> capture) {
+    auto bgr = make_shared<cv::Mat>();
+    return [capture, bgr](int& width, int& height, QrReader::PixelFormat& format, vector<uint8_t>& out) {
+        if (!capture->read(*bgr) || bgr->type() != CV_8UC3)
+            return false;
+        width = bgr->cols;
+        height = bgr->rows;
+        format = QrReader::PixelFormat::BGR24;
+        size_t rowBytes = static_cast<size_t>(width) * 3;
+        out.resize(rowBytes * height);
+        for (int y = 0; y < height; y++)
+            copy(bgr->ptr<uint8_t>(y), bgr->ptr<uint8_t>(y) + rowBytes, &out[static_cast<size_t>(y) * rowBytes]);
+        return true;
+    };
+}
+#endif
+
+}
+
+QRFrameSource::Next QRFrameSource::fromDirectory(const string& directory) {
+    auto files = make_shared<vector<string>>();
+    error_code ec;
+    for (filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file() && isImageFile(it->path()))
+            files->push_back(it->path().string());
+    }
+    if (ec)
+        return Next();
+    sort(files->begin(), files->end());
+    auto index = make_shared<size_t>(0);
+    return [files, index](int& width, int& height, QrReader::PixelFormat& format, vector<uint8_t>& gray) {
+        format = QrReader::PixelFormat::GRAY8;
+        while (*index < files->size()) {
+            const string& file = (*files)[(*index)++];
+            if (QRImageReader::readFile(file, width, height, gray))
+                return true;
+            fprintf(stderr, "Skipping unreadable image %s\n", file.c_str());
+        }
+        return false;
+    };
+}
+
+QRFrameSource::Next QRFrameSource::fromVideo(const string& filename) {
+#ifdef METRO_WITH_OPENCV
+    auto capture = make_shared<cv::VideoCapture>();
+    if (!capture->open(filename))
+        return Next();
+    return fromCapture(capture);
+#else
+    // ffmpeg writes the frames as a stream of binary PGM images
+    string command = "ffmpeg -loglevel error -nostdin -i \"" + filename + "\" -f image2pipe -vcodec pgm -";
+#ifdef _WIN32
+    FILE* pipe = _popen(command.c_str(), "rb");
+#else
+    FILE* pipe = popen(command.c_str(), "r");
+#endif
+    if (!pipe)
+        return Next();
+    auto state = make_shared<PipeState>(pipe);
+    return [state](int& width, int& height, QrReader::PixelFormat& format, vector<uint8_t>& gray) {
+        format = QrReader::PixelFormat::GRAY8;
+        return QRImageReader::readPNM(state->in, width, height, gray);
+    };
+#endif
+}
+
+QRFrameSource::Next QRFrameSource::fromCamera(int index) {
+#ifdef METRO_WITH_OPENCV
+    auto capture = make_shared<cv::VideoCapture>(index);
+    if (!capture->isOpened())
+        return Next();
+    capture->set(cv::CAP_PROP_FRAME_WIDTH, 1280);
+    capture->set(cv::CAP_PROP_FRAME_HEIGHT, 720);
+    return fromCapture(capture);
+#else
+    (void)index;
+    return Next();
+#endif
+}
+
+QRFrameSource::Next QRFrameSource::open(const string& input) {
+    error_code ec;
+    if (filesystem::is_directory(input, ec))
+        return fromDirectory(input);
+    if (!filesystem::exists(input, ec))
+        return Next();
+    return fromVideo(input);
+}
+
+bool QRFrameSource::hasCamera() {
+#ifdef METRO_WITH_OPENCV
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+// ******************** Recent Payloads ***************************
+bool RecentPayloads::firstSighting(const string& text, Clock::time_point now) {
+    // Forget expired entries once per window, so a long shift does not grow the map
+    if (now >= nextPrune) {
+        for (auto it = lastSeen.begin(); it != lastSeen.end();) {
+            if (now - it->second > window)
+                it = lastSeen.erase(it);
+            else
+                ++it;
+        }
+        nextPrune = now + window;
+    }
+    auto inserted = lastSeen.emplace(hash<string>()(text), now);
+    if (inserted.second)
+        return true;
+    bool expired = now - inserted.first->second > window;
+    inserted.first->second = now;
+    return expired;
+}
+
+void RecentPayloads::forget(const string& text) {
+    lastSeen.erase(hash<string>()(text));
+}
+
+void RecentPayloads::clear() {
+    lastSeen.clear();
+    nextPrune = Clock::time_point();
+}
+
+
+// ******************** QR Scan Pipeline Class ***************************
+void QRScanPipeline::StageStats::record(Clock::time_point start, Clock::time_point end) {
+    uint64_t us = static_cast<uint64_t>(chrono::duration_cast<chrono::microseconds>(end - start).count());
+    count.fetch_add(1, memory_order_relaxed);
+    totalMicros.fetch_add(us, memory_order_relaxed);
+    // Only the owning stage writes, so a plain compare is enough
+    if (us > maxMicros.load(memory_order_relaxed))
+        maxMicros.store(us, memory_order_relaxed);
+}
+
+double QRScanPipeline::StageStats::averageMicros() const {
+    uint64_t n = count.load(memory_order_relaxed);
+    return n == 0 ? 0.0 : static_cast<double>(totalMicros.load(memory_order_relaxed)) / n;
+}
+
+QRScanPipeline::~QRScanPipeline() {
+    stop();
+}
+
+void QRScanPipeline::setMultiCode(bool enabled) {
+    multiCode = enabled;
+}
+
+void QRScanPipeline::setDuplicateWindow(chrono::milliseconds window) {
+    duplicateWindow = window;
+}
+
+bool QRScanPipeline::start(QRFrameSource::Next source, Validator validator) {
+    if (!source || isRunning())
+        return false;
+    wait();
+
+    // Every buffer starts out free; leftovers of an earlier run are discarded
+    Frame* f;
+    while (frames.tryPop(f)) {}
+    while (freeFrames.tryPop(f)) {}
+    Payload p;
+    while (payloads.tryPop(p)) {}
+    for (Frame& frame : pool) {
+        f = &frame;
+        freeFrames.tryPush(f);
+    }
+
+    for (StageStats* s : { &capture, &decode, &validate, &endToEnd }) {
+        s->count = 0;
+        s->totalMicros = 0;
+        s->maxMicros = 0;
+    }
+    for (atomic<uint64_t>* c : { &framesCaptured, &framesDropped, &framesSkipped, &framesDecoded, &codesDecoded,
+                                 &payloadsRepeated, &payloadsDropped, &ticketsValid, &ticketsInvalid })
+        *c = 0;
+
+    stopping = false;
+    captureDone = false;
+    decodeDone = false;
+    running = 3;
+    captureThread = thread(&QRScanPipeline::captureLoop, this, std::move(source));
+    decodeThread = thread(&QRScanPipeline::decodeLoop, this, multiCode, duplicateWindow);
+    validateThread = thread(&QRScanPipeline::validateLoop, this, std::move(validator));
+    return true;
+}
+
+void QRScanPipeline::stop() {
+    stopping = true;
+    wait();
+}
+
+void QRScanPipeline::wait() {
+    for (thread* t : { &captureThread, &decodeThread, &validateThread }) {
+        if (t->joinable())
+            t->join();
+    }
+}
+
+bool QRScanPipeline::isRunning() const {
+    return running.load() > 0;
+}
+
+void QRScanPipeline::idle(int& rounds) {
+    if (++rounds < 64)
+        this_thread::yield();
+    else
+        this_thread::sleep_for(chrono::microseconds(500));
+}
+
+void QRScanPipeline::captureLoop(QRFrameSource::Next source) {
+    while (!stopping.load(memory_order_relaxed)) {
+        Frame* f = nullptr;
+        bool pooled = freeFrames.tryPop(f);
+        if (!pooled)
+            f = &scratch;
+
+        Clock::time_point start = Clock::now();
+        // A pooled frame left over here is put back by the next start()
+        if (!source(f->width, f->height, f->format, f->pixels))
+            break;
+        f->captured = Clock::now();
+        capture.record(start, f->captured);
+        framesCaptured.fetch_add(1, memory_order_relaxed);
+
+        // The pool holds POOL_SIZE frames and the queue as many, so a pooled frame always fits
+        if (!pooled || !frames.tryPush(f))
+            framesDropped.fetch_add(1, memory_order_relaxed);
+    }
+    captureDone.store(true, memory_order_release);
+    running.fetch_sub(1);
+}
+
+void QRScanPipeline::decodeLoop(bool multiCode, chrono::milliseconds duplicateWindow) {
+    QrReader reader;
+    vector<QrReader::Result> results(1);
+    RecentPayloads recent(duplicateWindow);
+    int rounds = 0;
+    while (true) {
+        // Take the newest frame and hand the older ones straight back
+        Frame* f = nullptr;
+        Frame* newer;
+        while (frames.tryPop(newer)) {
+            if (f) {
+                freeFrames.tryPush(f);
+                framesSkipped.fetch_add(1, memory_order_relaxed);
+            }
+            f = newer;
+        }
+        if (!f) {
+            if (captureDone.load(memory_order_acquire) && frames.empty())
+                break;
+            idle(rounds);
+            continue;
+        }
+        rounds = 0;
+
+        Clock::time_point start = Clock::now();
+        // Tracking searches only around the last ticket until it has been gone for a few frames;
+        // the search for every ticket covers the whole frame
+        int stride = f->width * QrReader::bytesPerPixel(f->format);
+        size_t found;
+        if (multiCode)
+            found = static_cast<size_t>(reader.decodeAll(f->pixels.data(), f->width, f->height, stride, f->format, results));
+        else
+            found = reader.decodeTracked(f->pixels.data(), f->width, f->height, stride, f->format, results[0]) ? 1 : 0;
+        decode.record(start, Clock::now());
+        Clock::time_point captured = f->captured;
+        freeFrames.tryPush(f);
+
+        if (found == 0)
+            continue;
+        framesDecoded.fetch_add(1, memory_order_relaxed);
+        codesDecoded.fetch_add(found, memory_order_relaxed);
+        // A ticket held in front of the camera decodes on every frame; pass it on once
+        for (size_t i = 0; i < found; i++) {
+            if (!recent.firstSighting(results[i].text, captured)) {
+                payloadsRepeated.fetch_add(1, memory_order_relaxed);
+                continue;
+            }
+            Payload p{ results[i].text, captured };
+            if (!payloads.tryPush(p)) {
+                // Not validated, so the next frame that shows the ticket must try again
+                recent.forget(results[i].text);
+                payloadsDropped.fetch_add(1, memory_order_relaxed);
+            }
+        }
+    }
+    decodeDone.store(true, memory_order_release);
+    running.fetch_sub(1);
+}
+
+void QRScanPipeline::validateLoop(Validator validator) {
+    Payload p;
+    int rounds = 0;
+    while (true) {
+        if (!payloads.tryPop(p)) {
+            if (decodeDone.load(memory_order_acquire) && payloads.empty())
+                break;
+            idle(rounds);
+            continue;
+        }
+        rounds = 0;
+        Clock::time_point start = Clock::now();
+        bool valid = validator ? validator(p.text) : true;
+        Clock::time_point end = Clock::now();
+        validate.record(start, end);
+        endToEnd.record(p.captured, end);
+        (valid ? ticketsValid : ticketsInvalid).fetch_add(1, memory_order_relaxed);
+    }
+    running.fetch_sub(1);
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "qrreader.hpp"
+
+using namespace std;
+using namespace qrcodegen;
+
+// ******************** QR Frame Source ***************************
+// Frames for QrReader from a camera, a video file or a directory of PBM/PGM/PPM images,
+// tightly packed in the pixel format set by the source: gray from images and ffmpeg, BGR
+// as OpenCV captures it, which QrReader converts while thresholding. A source is a function
+// that fills the next frame and returns false when the input ends; an empty function means
+// the input could not be opened.
+class QRFrameSource {
+public:
+    using Next = function<bool(int& width, int& height, QrReader::PixelFormat& format, vector<uint8_t>& pixels)>;
+
+    // Images in name order, e.g. frame_0001.pgm as written by "ffmpeg -i video frame_%04d.pgm"
+    static Next fromDirectory(const string& directory);
+
+    // Decoded with OpenCV when built with -DMETRO_WITH_OPENCV, otherwise streamed as
+    // PGM images from "ffmpeg -f image2pipe" (empty source if ffmpeg cannot be started)
+    static Next fromVideo(const string& filename);
+
+    // Needs -DMETRO_WITH_OPENCV; returns an empty source otherwise
+    static Next fromCamera(int index = 0);
+
+    // A directory or a video file, by what the path is
+    static Next open(const string& input);
+
+    static bool hasCamera();
+};
+
+
+// ******************** SPSC Queue ***************************
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// The producer only advances tail and the consumer only advances head, each on its
+// own cache line; Capacity must be a power of two.
+template<typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Returns false (and leaves value alone) if the queue is full
+    bool tryPush(T& value) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == Capacity)
+            return false;
+        slots[t & (Capacity - 1)] = std::move(value);
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool tryPop(T& value) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire))
+            return false;
+        value = std::move(slots[h & (Capacity - 1)]);
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+    }
+
+private:
+    alignas(64) atomic<size_t> head{0};
+    alignas(64) atomic<size_t> tail{0};
+    alignas(64) T slots[Capacity];
+};
+
+
+// ******************** Recent Payloads ***************************
+// The payloads seen within a time window, keyed by their hash, so that a ticket held in
+// view for many frames (or read by more than one pass) is passed on once. Each sighting
+// restarts the ticket's window, so it is passed on again only after it has been out of
+// view for the whole window. Distinct payloads with the same 64-bit hash would be taken
+// for one, which is negligible for a gate.
+class RecentPayloads {
+public:
+    using Clock = chrono::steady_clock;
+
+    explicit RecentPayloads(Clock::duration window = chrono::seconds(3)) : window(window) {}
+
+    // Returns true if text was not seen within the window before now; records it as seen now
+    bool firstSighting(const string& text, Clock::time_point now);
+
+    // Takes back the sighting of text, so its next sighting is a first one again
+    void forget(const string& text);
+
+    void clear();
+
+    size_t size() const { return lastSeen.size(); }
+
+private:
+    Clock::duration window;
+    unordered_map<size_t, Clock::time_point> lastSeen;
+    Clock::time_point nextPrune;
+};
+
+
+// ******************** QR Scan Pipeline Class ***************************
+// Capture -> decode -> validate, one thread per stage, joined by SPSC queues so that
+// no stage waits on the next one:
+//  - capture fills frame buffers from a fixed pool; if decode holds them all, the frame
+//    is read into a scratch buffer and dropped, so the camera never backs up
+//  - decode skips to the newest queued frame (older ones are stale) and searches it around
+//    the last ticket (QrReader::decodeTracked), or for every ticket in it at a wide gate
+//    (QrReader::decodeAll); a payload is passed on only if it was not seen within the
+//    duplicate window (RecentPayloads)
+//  - validate runs the caller's check on each payload; if it falls behind, payloads
+//    that do not fit its queue are dropped and counted
+// Frame buffers are reused, so the steady state does not allocate per frame.
+class QRScanPipeline {
+public:
+    using Clock = chrono::steady_clock;
+
+    // Runs on the validation thread; returns whether the ticket is valid
+    using Validator = function<bool(const string& text)>;
+
+    // Latency of one stage in microseconds, updated by that stage and readable at any time
+    struct StageStats {
+        atomic<uint64_t> count{0};
+        atomic<uint64_t> totalMicros{0};
+        atomic<uint64_t> maxMicros{0};
+
+        void record(Clock::time_point start, Clock::time_point end);
+        double averageMicros() const;
+    };
+
+    QRScanPipeline() = default;
+    ~QRScanPipeline();
+
+    // Both take effect at the next start(). By default one ticket is tracked per frame,
+    // and a ticket is validated again after 3 seconds out of view.
+    void setMultiCode(bool enabled);
+    void setDuplicateWindow(chrono::milliseconds window);
+
+    QRScanPipeline(const QRScanPipeline&) = delete;
+    QRScanPipeline& operator=(const QRScanPipeline&) = delete;
+
+    // Starts the three threads; returns false if already running or source is empty
+    bool start(QRFrameSource::Next source, Validator validator);
+
+    // Asks the stages to finish and joins them; queued payloads are still validated
+    void stop();
+
+    // Joins the threads once the source has ended
+    void wait();
+
+    // True until all three stages have finished
+    bool isRunning() const;
+
+    StageStats capture, decode, validate;
+    StageStats endToEnd;                  // Frame captured -> ticket validated
+
+    atomic<uint64_t> framesCaptured{0};
+    atomic<uint64_t> framesDropped{0};    // No free buffer, decode was busy
+    atomic<uint64_t> framesSkipped{0};    // Stale, a newer frame was queued behind them
+    atomic<uint64_t> framesDecoded{0};    // A code was found
+    atomic<uint64_t> codesDecoded{0};     // Codes found in those frames
+    atomic<uint64_t> payloadsRepeated{0}; // Seen within the duplicate window
+    atomic<uint64_t> payloadsDropped{0};  // Validation was busy
+    atomic<uint64_t> ticketsValid{0};
+    atomic<uint64_t> ticketsInvalid{0};
+
+private:
+    static constexpr size_t POOL_SIZE = 4;
+
+    struct Frame {
+        vector<uint8_t> pixels;
+        int width = 0;
+        int height = 0;
+        QrReader::PixelFormat format = QrReader::PixelFormat::GRAY8;
+        Clock::time_point captured;
+    };
+
+    struct Payload {
+        string text;
+        Clock::time_point captured;
+    };
+
+    void captureLoop(QRFrameSource::Next source);
+    void decodeLoop(bool multiCode, chrono::milliseconds duplicateWindow);
+    void validateLoop(Validator validator);
+
+    // Waiting consumer: spins briefly, then sleeps, so an idle stage costs no CPU
+    static void idle(int& rounds);
+
+    Frame pool[POOL_SIZE];
+    Frame scratch;                                 // Capture target when the pool is exhausted
+    SpscQueue<Frame*, POOL_SIZE> frames;           // Capture -> decode
+    SpscQueue<Frame*, POOL_SIZE> freeFrames;       // Decode -> capture, buffers to reuse
+    SpscQueue<Payload, 8> payloads;                // Decode -> validate
+
+    bool multiCode = false;
+    chrono::milliseconds duplicateWindow{3000};
+
+    atomic<bool> stopping{false};
+    atomic<bool> captureDone{false};
+    atomic<bool> decodeDone{false};
+    atomic<int> running{0};
+    thread captureThread, decodeThread, validateThread;
+};
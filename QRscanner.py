@@ -2,8 +2,10 @@ import cv2
 from pyzbar.pyzbar import decode
 import numpy as np
 import json
+import struct
 import sys
 import os
+import time
 
 JSON_FILE = "decoded.json"
 
@@ -12,7 +14,36 @@ def save_json_to_file(data_dict):
         json.dump(data_dict, f, indent=4)
     print(f"✅ Processed QR code data saved to {JSON_FILE}")
 
+COMPACT_MAGIC = "~"
+COMPACT_VERSION = 1
+COMPACT_HEADER_LENGTH = 5
+
+def parse_compact_ticket(qr_data):
+    # Mirrors CompactTicketCodec in tickets-QRgen: a 5-byte header, then CNIC + ticket ID
+    # digits, then "<departure code> <arrival code>". Returns None for other payloads.
+    if len(qr_data) <= COMPACT_HEADER_LENGTH or qr_data[0] != COMPACT_MAGIC or ord(qr_data[1]) != COMPACT_VERSION:
+        return None
+    cnic_len, id_len, count = ord(qr_data[2]), ord(qr_data[3]), ord(qr_data[4])
+    digits_end = COMPACT_HEADER_LENGTH + cnic_len + id_len
+    digits = qr_data[COMPACT_HEADER_LENGTH:digits_end]
+    codes = qr_data[digits_end:].split(" ")
+    if cnic_len == 0 or id_len == 0 or count == 0 or not digits.isdigit() or len(digits) != cnic_len + id_len \
+            or len(codes) != 2 or not codes[0] or not codes[1]:
+        return None
+    return {
+        "Format": "compact",
+        "CNIC": digits[:cnic_len],
+        "TicketID": digits[cnic_len:],
+        "Tickets": count,
+        "Departure": codes[0],
+        "Arrival": codes[1],
+    }
+
 def parse_qr_data(qr_data):
+    compact = parse_compact_ticket(qr_data)
+    if compact is not None:
+        return compact
+
     try:
         parsed = json.loads(qr_data)
         if isinstance(parsed, dict):
@@ -29,6 +60,16 @@ def parse_qr_data(qr_data):
             print(f"⚠️ Skipping invalid entry: {item}")
     return data
 
+def unique_payloads(qr_codes):
+    # The raw and the thresholded frame often yield the same code; keep each payload once, in order
+    seen = set()
+    payloads = []
+    for qr in qr_codes:
+        if qr.data not in seen:
+            seen.add(qr.data)
+            payloads.append(qr.data)
+    return payloads
+
 def open_camera():
     # Try different indices/backends if default fails
     candidates = [
@@ -74,16 +115,15 @@ def read_qr_from_camera():
                                        cv2.THRESH_BINARY, 11, 2)
         thresh_color = cv2.cvtColor(thresh, cv2.COLOR_GRAY2BGR)
 
-        qr_codes = decode(thresh) + decode(frame)
-        if qr_codes:
-            for qr in qr_codes:
-                qr_data = qr.data.decode('utf-8')
-                print(f"🔍 Raw QR Code Data: {qr_data}")
-                parsed_data = parse_qr_data(qr_data)
-                save_json_to_file(parsed_data)
-                cap.release()
-                cv2.destroyAllWindows()
-                return
+        payloads = unique_payloads(decode(thresh) + decode(frame))
+        if payloads:
+            # Every ticket in view is reported; decoded.json holds the first, as QrDecode reads one
+            for raw in payloads:
+                print(f"🔍 Raw QR Code Data: {raw.decode('utf-8')}")
+            save_json_to_file(parse_qr_data(payloads[0].decode('utf-8')))
+            cap.release()
+            cv2.destroyAllWindows()
+            return
 
         combined = np.hstack((cv2.resize(frame, (640, 480)),
                               cv2.resize(thresh_color, (640, 480))))
@@ -95,5 +135,86 @@ def read_qr_from_camera():
     cap.release()
     cv2.destroyAllWindows()
 
+# ---- Persistent worker mode (--serve) ----
+# QrDecode in QRdecode.h starts "python3 QRscanner.py --serve" once and keeps it running, so
+# a scan costs one round trip instead of an interpreter launch and a camera open.
+# stdin and stdout carry frames of a 4-byte big-endian length followed by that many bytes;
+# logging goes to stderr. Requests are ASCII commands:
+#   "SCAN <timeout ms>"  scan until a code is read, the timeout passes or 'q' is pressed
+#   "PING"               liveness check
+#   "QUIT"               release the camera and exit
+# Every request gets one response whose first byte is a status, then the body:
+#   0 = decoded (raw QR text, UTF-8), 1 = nothing read, 2 = error (message)
+STATUS_DECODED, STATUS_NONE, STATUS_ERROR = 0, 1, 2
+
+def read_frame(stream):
+    header = stream.read(4)
+    if len(header) < 4:
+        return None
+    (length,) = struct.unpack(">I", header)
+    body = stream.read(length)
+    return body if len(body) == length else None
+
+def write_frame(stream, status, body=b""):
+    stream.write(struct.pack(">IB", len(body) + 1, status) + body)
+    stream.flush()
+
+def scan_once(cap, timeout_ms):
+    deadline = time.monotonic() + timeout_ms / 1000.0
+    cv2.namedWindow('QR Code Detection', cv2.WINDOW_NORMAL)
+    try:
+        while time.monotonic() < deadline:
+            ret, frame = cap.read()
+            if not ret:
+                return STATUS_ERROR, b"Can't receive frame"
+            # The plain frame first; the enhanced threshold of the one-shot mode only if that fails
+            qr_codes = decode(frame)
+            if not qr_codes:
+                gray = cv2.cvtColor(frame, cv2.COLOR_BGR2GRAY)
+                gray = cv2.convertScaleAbs(gray, alpha=1.5, beta=0)
+                gray = cv2.bilateralFilter(gray, 9, 75, 75)
+                thresh = cv2.adaptiveThreshold(gray, 255,
+                                               cv2.ADAPTIVE_THRESH_GAUSSIAN_C,
+                                               cv2.THRESH_BINARY, 11, 2)
+                qr_codes = decode(thresh)
+            if qr_codes:
+                return STATUS_DECODED, qr_codes[0].data
+            cv2.imshow('QR Code Detection', frame)
+            if cv2.waitKey(1) & 0xFF == ord('q'):
+                break
+        return STATUS_NONE, b""
+    finally:
+        cv2.destroyAllWindows()
+
+def serve():
+    requests, responses = sys.stdin.buffer, sys.stdout.buffer
+    sys.stdout = sys.stderr  # print() must not corrupt the frame stream
+    cap = None
+    while True:
+        request = read_frame(requests)
+        if request is None or request == b"QUIT":
+            break
+        command = request.decode("ascii", "replace").split()
+        if command == ["PING"]:
+            write_frame(responses, STATUS_NONE)
+        elif len(command) == 2 and command[0] == "SCAN" and command[1].isdigit():
+            # The camera is opened on the first scan and then kept open
+            if cap is None:
+                cap = open_camera()
+                if cap is None:
+                    write_frame(responses, STATUS_ERROR, b"Cannot open camera")
+                    continue
+                cap.set(cv2.CAP_PROP_FRAME_WIDTH, 1280)
+                cap.set(cv2.CAP_PROP_FRAME_HEIGHT, 720)
+            status, body = scan_once(cap, int(command[1]))
+            write_frame(responses, status, body)
+        else:
+            write_frame(responses, STATUS_ERROR, b"Unknown command")
+    if cap is not None:
+        cap.release()
+
 if __name__ == "__main__":
-    read_qr_from_camera()
+    if "--serve" in sys.argv[1:]:
+        serve()
+    else:
+        read_qr_from_camera()
@@ -3,11 +3,14 @@
 #include "stations-metro.h"
 #include "tickets-QRgen.h"
 #include "QRdecode.h"
+#include "QRpipeline.h"
 #include <iostream>
 #include <vector>
 #include <memory>
 #include <limits>
 #include <iomanip>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 
@@ -200,7 +203,7 @@ void initializeStations() {
 void viewAllStations() {
     printSubHeader("All Metro Stations");
     
-    vector<Station> stations = lahoreMetro.returnStations();
+    const vector<Station>& stations = lahoreMetro.returnStations();
     if (stations.empty()) {
         cout << YELLOW << "No stations loaded. Please initialize stations first." << RESET << endl;
     } else {
@@ -267,7 +270,7 @@ void stationManagement() {
 
 // Ticket Booking Functions
 Station selectStation(const string& prompt) {
-    vector<Station> stations = lahoreMetro.returnStations();
+    const vector<Station>& stations = lahoreMetro.returnStations();
     if (stations.empty()) {
         cout << RED << "No stations available. Please initialize stations first." << RESET << endl;
         return Station();
@@ -354,7 +357,7 @@ void bookTicket() {
     SaveTicketToFile saver(ticketInfo);
     saver.saveAsJSON("tickets.json");
     
-    cout << GREEN << "\n✓ Ticket booked successfully!" << RESET << endl;
+    cout << GREEN << "\n✓ Ticket booked successfully! Ticket ID: " << ticketInfo.getTicketId() << RESET << endl;
     pauseScreen();
 }
 
@@ -577,6 +580,34 @@ void generateQRCode() {
         TicketInfo& selectedTicket = tickets[choice - 1];
         PassengerData passenger = selectedTicket.getPassenger();
         
+        int payloadFormat = getValidInteger("Payload format (1. JSON  2. Compact): ");
+        if (payloadFormat == 2) {
+            // Compact payload: CNIC, ticket ID and station codes only, for a much smaller code
+            CompactTicket compact = CompactTicketCodec::fromTicket(selectedTicket);
+            if (CompactTicketCodec::canEncode(compact)) {
+                QrCode qr = CompactTicketCodec::encode(compact);
+                cout << "\nCompact ticket #" << compact.ticketId << " (QR version " << qr.getVersion() << ")" << endl;
+                QRGeneration::printQr(qr);
+                
+                char saveChoice;
+                cout << "\nSave QR code as PNG image? (y/n): ";
+                cin >> saveChoice;
+                if (saveChoice == 'y' || saveChoice == 'Y') {
+                    QRPngWriter writer;
+                    if (QRGeneration::saveQRCodePNG(qr, "qrcode.png", writer))
+                        cout << "QR Code successfully saved as 'qrcode.png'" << endl;
+                    else
+                        cout << RED << "Error: Failed to save QR Code image." << RESET << endl;
+                }
+                
+                cout << GREEN << "\n✓ QR Code generated successfully!" << RESET << endl;
+                pauseScreen();
+                return;
+            }
+            cout << YELLOW << "This ticket has no saved ticket ID or station codes (booked with an older version), "
+                 << "or its CNIC or station codes do not fit the compact format; using JSON." << RESET << endl;
+        }
+        
         // Generate QR code
         QRCodeData qrData(passenger, selectedTicket);
         QRGeneration qrGen(qrData);
@@ -587,14 +618,28 @@ void generateQRCode() {
         qrGen.generateQR();
         
         char saveChoice;
-        cout << "\nSave QR code as PNG image? (y/n): ";
+        cout << "\nSave QR code as an image? (y/n): ";
         cin >> saveChoice;
         
         if (saveChoice == 'y' || saveChoice == 'Y') {
-            qrGen.saveQRCodePNG("qrcode.png");
+            int format = getValidInteger("Format (1. PNG  2. SVG  3. PBM  4. PGM): ");
+            bool saved = true;
+            switch (format) {
+                case 2: saved = qrGen.saveQRCodeSVG("qrcode.svg"); break;
+                case 3: saved = qrGen.saveQRCodePBM("qrcode.pbm"); break;
+                case 4: saved = qrGen.saveQRCodePGM("qrcode.pgm"); break;
+                default: qrGen.saveQRCodePNG("qrcode.png"); break;
+            }
+            if (!saved)
+                cout << RED << "Error: Failed to save QR Code image." << RESET << endl;
+            else if (format >= 2 && format <= 4)
+                cout << "QR Code successfully saved." << endl;
         }
         
         cout << GREEN << "\n✓ QR Code generated successfully!" << RESET << endl;
+        const QRCodeCache& cache = QRGeneration::getCache();
+        cout << "QR cache: " << cache.getHits() << " hit(s), " << cache.getMisses() << " miss(es), "
+             << cache.getUsedBytes() / 1024 << " KiB used" << endl;
         
     } catch (const exception& e) {
         cout << RED << "Error generating QR code: " << e.what() << RESET << endl;
@@ -603,6 +648,52 @@ void generateQRCode() {
     pauseScreen();
 }
 
+void bulkGenerateQRCodes() {
+    printSubHeader("Bulk Generate QR Codes");
+    
+    try {
+        // Load tickets.json once and turn every ticket into a payload
+        vector<TicketInfo> tickets = SaveTicketToFile::loadAllFromJSON("tickets.json");
+        if (tickets.empty()) {
+            cout << YELLOW << "No tickets found. Please book a ticket first." << RESET << endl;
+            pauseScreen();
+            return;
+        }
+        
+        vector<QRCodeData> payloads;
+        payloads.reserve(tickets.size());
+        for (const TicketInfo& ticket : tickets)
+            payloads.emplace_back(ticket.getPassenger(), ticket);
+        
+        QRBatchGeneration batch;
+        cout << "Encoding " << payloads.size() << " ticket(s) on " << batch.getNumThreads() << " thread(s)..." << endl;
+        
+        char saveChoice;
+        cout << "Save each QR code as PNG (qrcode_<n>.png)? (y/n): ";
+        cin >> saveChoice;
+        
+        if (saveChoice == 'y' || saveChoice == 'Y') {
+            size_t saved = batch.saveAllPNG(payloads, "qrcode_");
+            if (saved != payloads.size())
+                cout << RED << (payloads.size() - saved) << " QR code(s) could not be saved." << RESET << endl;
+            cout << GREEN << "\n✓ Saved " << saved << " QR code image(s)." << RESET << endl;
+        } else {
+            vector<QrCode> codes = batch.encodeAll(payloads);
+            cout << GREEN << "\n✓ Encoded " << codes.size() << " QR code(s)." << RESET << endl;
+        }
+        
+        cout << fixed << setprecision(1)
+             << "Time: " << batch.getLastSeconds() * 1000.0 << " ms, throughput: "
+             << batch.getCodesPerSecond() << " codes/sec" << endl;
+        cout.unsetf(ios::fixed);
+        
+    } catch (const exception& e) {
+        cout << RED << "Error generating QR codes: " << e.what() << RESET << endl;
+    }
+    
+    pauseScreen();
+}
+
 void validateQRCode() {
     printSubHeader("Validate QR Code");
     
@@ -625,6 +716,7 @@ void qrCodeGeneration() {
         printHeader("QR CODE GENERATION");
         cout << GREEN << "1. " << WHITE << "Generate QR Code" << RESET << endl;
         cout << GREEN << "2. " << WHITE << "Validate QR Code" << RESET << endl;
+        cout << GREEN << "3. " << WHITE << "Bulk Generate QR Codes" << RESET << endl;
         cout << RED << "0. " << WHITE << "Back to Main Menu" << RESET << endl;
         
         choice = getValidInteger("\nEnter your choice: ");
@@ -632,6 +724,7 @@ void qrCodeGeneration() {
         switch (choice) {
             case 1: generateQRCode(); break;
             case 2: validateQRCode(); break;
+            case 3: bulkGenerateQRCodes(); break;
             case 0: break;
             default: 
                 cout << RED << "Invalid choice! Please try again." << RESET << endl;
@@ -647,8 +740,24 @@ void scanAndDecodeQR() {
     cout << YELLOW << "Starting camera for QR code scanning..." << RESET << endl;
     cout << CYAN << "Make sure you have a QR code ready to scan." << RESET << endl;
     
-    // Call the Python script to scan QR code
-    qrDecoder.callScript();
+    // Decode in process when this build can open the camera; otherwise ask the Python
+    // scanner worker, which stays running between passengers
+    if (QrDecode::hasNativeCamera())
+        qrDecoder.scanWithCamera();
+    else
+        qrDecoder.scanWithWorker();
+    
+    pauseScreen();
+}
+
+void decodeQRFromImage() {
+    printSubHeader("Decode QR Code from Image");
+    
+    string filename = getValidString("Enter image file (PBM/PGM/PPM): ");
+    
+    // Decoded in process, no camera or Python needed
+    if (qrDecoder.decodeImageFile(filename))
+        cout << GREEN << "✓ QR code decoded successfully!" << RESET << endl;
     
     pauseScreen();
 }
@@ -714,6 +823,76 @@ void manualPassengerValidation() {
     pauseScreen();
 }
 
+void continuousGateScanning() {
+    printSubHeader("Continuous Gate Scanning");
+    
+    if (lahoreMetro.returnStations().empty()) {
+        cout << RED << "No stations loaded. Please initialize stations first." << RESET << endl;
+        pauseScreen();
+        return;
+    }
+    
+    // Capture, decode and validation each run on their own thread
+    QRFrameSource::Next source;
+    bool camera = QRFrameSource::hasCamera() && getValidString("Use the camera? (y/n): ") == "y";
+    if (camera) {
+        source = QRFrameSource::fromCamera();
+    } else {
+        string input = getValidString("Enter video file or frame directory: ");
+        source = QRFrameSource::open(input);
+    }
+    if (!source) {
+        cout << RED << "Could not open the frame source." << RESET << endl;
+        pauseScreen();
+        return;
+    }
+    // A camera never runs out of frames, so it needs a duration to stop after
+    int seconds;
+    if (camera) {
+        while ((seconds = getValidInteger("Scan for how many seconds: ")) <= 0)
+            cout << RED << "Please enter a positive number of seconds." << RESET << endl;
+    } else {
+        seconds = getValidInteger("Scan for how many seconds (0 = until the input ends): ");
+    }
+    // A wide gate or a group shows several tickets at once; each is validated once while in view
+    bool multiCode = getValidString("Read every ticket in view (wide gate / group)? (y/n): ") == "y";
+    
+    // The validation thread has its own decoder, so the menu's decoded data is left alone
+    QrDecode gateDecoder;
+    gateDecoder.setMetroStation(&lahoreMetro);
+    QRScanPipeline pipeline;
+    pipeline.setMultiCode(multiCode);
+    pipeline.start(source, [&gateDecoder](const string& text) {
+        gateDecoder.parseScannedText(text);
+        return gateDecoder.validateTicketWithStations();
+    });
+    
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(seconds);
+    while (pipeline.isRunning() && (seconds <= 0 || chrono::steady_clock::now() < deadline))
+        this_thread::sleep_for(chrono::milliseconds(50));
+    pipeline.stop();
+    
+    cout << CYAN << "\nFrames: " << pipeline.framesCaptured << " captured, " << pipeline.framesDecoded
+         << " decoded, " << pipeline.framesDropped << " dropped, " << pipeline.framesSkipped << " stale" << RESET << endl;
+    cout << CYAN << "Codes: " << pipeline.codesDecoded << " read, " << pipeline.payloadsRepeated
+         << " already validated while in view" << RESET << endl;
+    cout << GREEN << "Tickets: " << pipeline.ticketsValid << " valid, " << RESET
+         << RED << pipeline.ticketsInvalid << " invalid" << RESET << endl;
+    cout << fixed << setprecision(2);
+    cout << "Capture   avg " << pipeline.capture.averageMicros() / 1000 << " ms, max "
+         << pipeline.capture.maxMicros / 1000.0 << " ms" << endl;
+    cout << "Decode    avg " << pipeline.decode.averageMicros() / 1000 << " ms, max "
+         << pipeline.decode.maxMicros / 1000.0 << " ms" << endl;
+    cout << "Validate  avg " << pipeline.validate.averageMicros() / 1000 << " ms, max "
+         << pipeline.validate.maxMicros / 1000.0 << " ms" << endl;
+    cout << "Frame to verdict avg " << pipeline.endToEnd.averageMicros() / 1000 << " ms, max "
+         << pipeline.endToEnd.maxMicros / 1000.0 << " ms" << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+    
+    pauseScreen();
+}
+
 void qrCodeDecoding() {
     int choice;
     do {
@@ -724,6 +903,8 @@ void qrCodeDecoding() {
         cout << GREEN << "3. " << WHITE << "Validate Decoded Ticket" << RESET << endl;
         cout << GREEN << "4. " << WHITE << "Advanced QR Validation" << RESET << endl;
         cout << GREEN << "5. " << WHITE << "Manual Passenger Validation" << RESET << endl;
+        cout << GREEN << "6. " << WHITE << "Decode QR Code from Image" << RESET << endl;
+        cout << GREEN << "7. " << WHITE << "Continuous Gate Scanning" << RESET << endl;
         cout << RED << "0. " << WHITE << "Back to Main Menu" << RESET << endl;
         
         choice = getValidInteger("\nEnter your choice: ");
@@ -734,6 +915,8 @@ void qrCodeDecoding() {
             case 3: validateDecodedTicket(); break;
             case 4: advancedQRValidation(); break;
             case 5: manualPassengerValidation(); break;
+            case 6: decodeQRFromImage(); break;
+            case 7: continuousGateScanning(); break;
             case 0: break;
             default: 
                 cout << RED << "Invalid choice! Please try again." << RESET << endl;
@@ -918,4 +1101,4 @@ int main() {
     return 0;
 }
 
-// g++ -std=c++17 main.cpp payments.cpp tickets-QRgen.cpp qrcodegen.cpp -o metro $(pkg-config --cflags --libs opencv4)
\ No newline at end of file
+// g++ -std=c++17 -pthread main.cpp payments.cpp tickets-QRgen.cpp QRimage.cpp QRpipeline.cpp qrcodegen.cpp qrreader.cpp -o metro
\ No newline at end of file
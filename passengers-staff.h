@@ -20,7 +20,7 @@ public:
     Identity(string cnic) : cnic(cnic) {}
 
     // Getter and Setter (Encapsulation)
-    string getCnic() const { return cnic; }
+    const string& getCnic() const { return cnic; }
     void setCnic(string a) { cnic = a; }
 };
 
@@ -39,7 +39,7 @@ public:
 
     // Encapsulated access
     void setName(string n) { name = n; }
-    string getName() const { return name; }
+    const string& getName() const { return name; }
 
     void setAge(int a) { age = a; }
     int getAge() const { return age; }
@@ -112,7 +112,7 @@ public:
     }
 
     // Encapsulated getter for CNIC
-    string getCnic() const {
+    const string& getCnic() const {
         return identity.getCnic();
     }
 };
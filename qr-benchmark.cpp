@@ -0,0 +1,629 @@
+// Stand-alone benchmarks for the QR encoding path.
+// Build: g++ -std=c++17 -O2 -pthread qr-benchmark.cpp payments.cpp tickets-QRgen.cpp QRimage.cpp QRpipeline.cpp qrcodegen.cpp qrreader.cpp -o qr-benchmark
+// Usage: ./qr-benchmark masks     -> serial vs parallel mask scoring for every version
+//        ./qr-benchmark png       -> PNG writer time and size per depth/compression
+//        ./qr-benchmark alloc     -> heap allocations per encode; exits with 1 if QrEncoder allocates
+//        ./qr-benchmark rs        -> checks SIMD Reed-Solomon against scalar for every version and ECC
+//                                    level (exits with 1 on a mismatch), then times each level
+//        ./qr-benchmark penalty   -> checks word-parallel mask penalties and the chosen mask against the
+//                                    scalar penalty for every version and ECC level (exits with 1 on a mismatch)
+//        ./qr-benchmark decode    -> decodes damaged grids and rendered images for every version and ECC
+//                                    level with QrReader (exits with 1 on a failure), then times a gray
+//                                    and a BGR frame at each SIMD level, and a frame of six tickets
+//        ./qr-benchmark gate      -> issues JSON and compact tickets, reads them from a frame and checks
+//                                    the gate's valid/invalid verdicts (exits with 1 on a wrong verdict)
+//        ./qr-benchmark scan "QR metro.mp4" [min success %]
+//                                 -> decodes every frame of a video or of a directory of PNM images,
+//                                    reports frames/s, latency percentiles and the success rate
+//                                    (exits with 1 below the minimum). Videos are read with OpenCV
+//                                    when built with -DMETRO_WITH_OPENCV, otherwise through ffmpeg.
+
+#include "qrcodegen.hpp"
+#include "qrreader.hpp"
+#include "QRimage.h"
+#include "QRpipeline.h"
+#include "QRdecode.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace qrcodegen;
+using namespace std;
+
+// Every heap allocation in this program goes through here, so the alloc mode can count them.
+// They are kept out of line: inlined into the standard allocator, GCC would pair their
+// malloc() and free() with operator new and delete and report a mismatch (-Wmismatched-new-delete).
+#if defined(__GNUC__) || defined(__clang__)
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#else
+#define BENCHMARK_NOINLINE
+#endif
+
+static atomic<long> allocationCount(0);
+
+BENCHMARK_NOINLINE void* operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size > 0 ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+BENCHMARK_NOINLINE void operator delete(void* p) noexcept {
+    free(p);
+}
+
+BENCHMARK_NOINLINE void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// Runs fn repeatedly for at least minMillis and returns the average time per call in microseconds
+template <typename Fn>
+static double timePerCall(Fn fn, int minMillis = 200) {
+    auto start = chrono::steady_clock::now();
+    long calls = 0;
+    double elapsed = 0;
+    do {
+        fn();
+        calls++;
+        elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < minMillis * 1000.0);
+    return elapsed / calls;
+}
+
+// Encodes a short ticket-sized payload at a fixed version, so only the symbol size varies
+static void encodeAtVersion(const vector<QrSegment>& segs, int version) {
+    QrCode qr = QrCode::encodeSegments(segs, QrCode::Ecc::HIGH, version, version, -1, false);
+    if (qr.getVersion() != version)
+        cerr << "unexpected version " << qr.getVersion() << endl;
+}
+
+// ******************** Mask scoring: serial vs parallel ***************************
+static int benchmarkMasks() {
+    vector<QrSegment> segs = QrSegment::makeSegments("3520212345678");  // Fits version 1 at ECC HIGH
+    int previous = QrCode::getParallelMaskMinVersion();
+
+    cout << "Hardware threads: " << thread::hardware_concurrency() << "\n";
+    cout << "version  serial(us)  parallel(us)  speedup\n";
+    vector<bool> parallelWins(QrCode::MAX_VERSION + 1, false);
+    for (int ver = QrCode::MIN_VERSION; ver <= QrCode::MAX_VERSION; ver++) {
+        QrCode::setParallelMaskMinVersion(QrCode::MAX_VERSION + 1);
+        double serial = timePerCall([&] { encodeAtVersion(segs, ver); });
+        QrCode::setParallelMaskMinVersion(QrCode::MIN_VERSION);
+        double parallel = timePerCall([&] { encodeAtVersion(segs, ver); });
+        parallelWins[ver] = parallel < serial;
+        printf("%7d  %10.1f  %12.1f  %7.2fx\n", ver, serial, parallel, serial / parallel);
+    }
+    QrCode::setParallelMaskMinVersion(previous);
+
+    // The threshold is the lowest version from which parallel scoring wins all the way up
+    int threshold = QrCode::MAX_VERSION + 1;
+    while (threshold > QrCode::MIN_VERSION && parallelWins[threshold - 1])
+        threshold--;
+    if (threshold > QrCode::MAX_VERSION)
+        cout << "Parallel scoring never wins here; keep it off with setParallelMaskMinVersion("
+             << QrCode::MAX_VERSION + 1 << ")\n";
+    else
+        cout << "Recommended: QrCode::setParallelMaskMinVersion(" << threshold << ")\n";
+    return 0;
+}
+
+// ******************** PNG writer: depth x compression ***************************
+static int benchmarkPng() {
+    const char* payload = "{\"type\":\"QRCODE\",\"data\":{\"Name\":\"Muhammad Ali\",\"CNIC\":\"3520212345678\","
+                          "\"Departure\":\"Thokar Niaz Baig\",\"Arrival\":\"Dera Gujran\"}}";
+    QrCode qr = QrCode::encodeText(payload, QrCode::Ecc::HIGH);
+    cout << "Version " << qr.getVersion() << ", scale 10, border 4\n";
+    cout << "depth  compression  time(us)  bytes\n";
+    for (QRPngWriter::BitDepth depth : { QRPngWriter::BitDepth::GRAY_1, QRPngWriter::BitDepth::GRAY_8 }) {
+        for (QRPngWriter::Compression comp : { QRPngWriter::Compression::STORED, QRPngWriter::Compression::FAST }) {
+            QRPngWriter writer(10, 4, depth, comp);
+            vector<uint8_t> buffer(writer.maxEncodedSize(qr));
+            size_t bytes = 0;
+            double us = timePerCall([&] { bytes = writer.encode(qr, buffer.data(), buffer.size()); });
+            printf("%5d  %11s  %8.1f  %5zu\n", static_cast<int>(depth),
+                   comp == QRPngWriter::Compression::FAST ? "fast" : "stored", us, bytes);
+        }
+    }
+    return 0;
+}
+
+// ******************** Heap allocations: QrCode vs QrEncoder ***************************
+static bool sameModules(const QrCode& a, const QrCode& b) {
+    if (a.getVersion() != b.getVersion() || a.getMask() != b.getMask()
+            || a.getErrorCorrectionLevel() != b.getErrorCorrectionLevel())
+        return false;
+    for (int y = 0; y < a.getSize(); y++) {
+        for (int x = 0; x < a.getSize(); x++) {
+            if (a.getModule(x, y) != b.getModule(x, y))
+                return false;
+        }
+    }
+    return true;
+}
+
+static int benchmarkAlloc() {
+    vector<string> payloads = {
+        "{\"type\":\"QRCODE\",\"data\":{\"Name\":\"Muhammad Ali\",\"CNIC\":\"3520212345678\","
+        "\"Departure\":\"Thokar Niaz Baig\",\"Arrival\":\"Dera Gujran\"}}",
+        "3520212345678104",                // Numeric
+        "LHR1 LHR12 3520212345678",        // Alphanumeric
+        "",
+        string(1000, 'x'),                 // Large byte mode codes, up to version 40
+    };
+    const QrCode::Ecc levels[] = { QrCode::Ecc::LOW, QrCode::Ecc::HIGH };
+
+    // Warm up: builds the version templates and starts the mask worker pool
+    QrEncoder encoder;
+    bool same = true, sameOptimal = true;
+    for (const string& p : payloads) {
+        for (QrCode::Ecc ecl : levels) {
+            same = sameModules(encoder.encodeText(p.c_str(), ecl), QrCode::encodeText(p.c_str(), ecl)) && same;
+            sameOptimal = sameModules(encoder.encodeTextOptimal(p.c_str(), ecl), QrCode::encodeTextOptimal(p.c_str(), ecl)) && sameOptimal;
+        }
+    }
+    if (!same || !sameOptimal) {
+        cerr << "QrEncoder output differs from QrCode::" << (same ? "encodeTextOptimal" : "encodeText") << endl;
+        return 1;
+    }
+
+    const int rounds = 20;
+    long encodes = rounds * static_cast<long>(payloads.size()) * 2;
+    int checksum = 0;
+    // Encodes every payload at every level for some rounds; returns the allocations per encode
+    auto measure = [&](const char* name, auto encode) {
+        long before = allocationCount.load();
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (const string& p : payloads) {
+                for (QrCode::Ecc ecl : levels)
+                    checksum += encode(p.c_str(), ecl).getMask();
+            }
+        }
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        long allocs = allocationCount.load() - before;
+        printf("%-18s  %13.1f  %15.1f\n", name, double(allocs) / encodes, us / encodes);
+        return allocs;
+    };
+    cout << "encoder             allocs/encode  time(us)/encode\n";
+    measure("QrCode", [](const char* text, QrCode::Ecc ecl) { return QrCode::encodeText(text, ecl); });
+    long encoderAllocs = measure("QrEncoder", [&](const char* text, QrCode::Ecc ecl) -> const QrCode& {
+        return encoder.encodeText(text, ecl); });
+    measure("QrCode optimal", [](const char* text, QrCode::Ecc ecl) { return QrCode::encodeTextOptimal(text, ecl); });
+    encoderAllocs += measure("QrEncoder optimal", [&](const char* text, QrCode::Ecc ecl) -> const QrCode& {
+        return encoder.encodeTextOptimal(text, ecl); });
+
+    if (encoderAllocs != 0) {
+        cerr << "QrEncoder allocated " << encoderAllocs << " times in steady state (checksum "
+             << checksum << ")" << endl;
+        return 1;
+    }
+    cout << "QrEncoder made no heap allocations in " << encodes * 2 << " encodes\n";
+    return 0;
+}
+
+// ******************** Reed-Solomon: SIMD levels vs scalar ***************************
+static const char* simdLevelName(QrCode::SimdLevel level) {
+    switch (level) {
+        case QrCode::SimdLevel::AVX2:  return "avx2";
+        case QrCode::SimdLevel::SSSE3: return "ssse3";
+        default:                       return "scalar";
+    }
+}
+
+// Random bytes filling the data capacity of the given version and level
+static vector<uint8_t> randomData(mt19937& rng, int version, QrCode::Ecc ecl) {
+    auto fits = [&](size_t len) {
+        try {
+            QrCode::encodeSegments({ QrSegment::makeBytes(vector<uint8_t>(len)) }, ecl, version, version, 0, false);
+            return true;
+        } catch (const data_too_long&) {
+            return false;
+        }
+    };
+    size_t lo = 0, hi = 4096;  // Binary search for the longest segment that fits
+    while (lo + 1 < hi) {
+        size_t mid = (lo + hi) / 2;
+        (fits(mid) ? lo : hi) = mid;
+    }
+    vector<uint8_t> data(lo);
+    for (uint8_t& b : data)
+        b = static_cast<uint8_t>(rng());
+    return data;
+}
+
+// Random data codewords of the given version and level, as many as computeEccAndInterleave() accepts
+static vector<uint8_t> randomCodewords(mt19937& rng, int version, QrCode::Ecc ecl) {
+    vector<uint8_t> data, codewords;
+    while (true) {
+        data.push_back(static_cast<uint8_t>(rng()));
+        try {
+            QrCode::computeEccAndInterleave(version, ecl, data, codewords);
+            return data;
+        } catch (const invalid_argument&) {}
+    }
+}
+
+// The same as one byte segment
+static vector<QrSegment> randomSegments(mt19937& rng, int version, QrCode::Ecc ecl) {
+    return { QrSegment::makeBytes(randomData(rng, version, ecl)) };
+}
+
+static int benchmarkReedSolomon() {
+    QrCode::SimdLevel best = QrCode::getMaxSimdLevel();
+    cout << "Best SIMD level on this machine: " << simdLevelName(best) << "\n";
+    vector<QrCode::SimdLevel> levels = { QrCode::SimdLevel::SCALAR };
+    for (QrCode::SimdLevel level : { QrCode::SimdLevel::SSSE3, QrCode::SimdLevel::AVX2 }) {
+        if (level <= best)
+            levels.push_back(level);
+    }
+
+    // Every level must give the same codes as the scalar code for every version and ECC level
+    mt19937 rng(42);
+    int checked = 0, mismatches = 0;
+    for (int ver = QrCode::MIN_VERSION; ver <= QrCode::MAX_VERSION; ver++) {
+        for (int e = 0; e < 4; e++) {
+            QrCode::Ecc ecl = static_cast<QrCode::Ecc>(e);
+            vector<QrSegment> segs = randomSegments(rng, ver, ecl);
+            QrCode::setSimdLevel(QrCode::SimdLevel::SCALAR);
+            QrCode expected = QrCode::encodeSegments(segs, ecl, ver, ver, 0, false);
+            for (size_t i = 1; i < levels.size(); i++) {
+                QrCode::setSimdLevel(levels[i]);
+                if (!sameModules(expected, QrCode::encodeSegments(segs, ecl, ver, ver, 0, false))) {
+                    cerr << "Mismatch at version " << ver << ", ECC " << e << ", " << simdLevelName(levels[i]) << endl;
+                    mismatches++;
+                }
+                checked++;
+            }
+        }
+    }
+    cout << "Checked " << checked << " (version, ECC level, SIMD level) combinations, "
+         << mismatches << " mismatches\n";
+
+    // Version 40 at ECC HIGH has the most blocks (81), so it gains the most from the lanes.
+    // The ECC columns time the Reed-Solomon step alone, the encode columns a whole code
+    // (with a fixed mask), of which the ECC is only a part.
+    cout << "level   ecc v10-M(us)  ecc v40-H(us)  encode v10-M(us)  encode v40-H(us)\n";
+    vector<QrSegment> medium = randomSegments(rng, 10, QrCode::Ecc::MEDIUM);
+    vector<QrSegment> high = randomSegments(rng, 40, QrCode::Ecc::HIGH);
+    vector<uint8_t> data10 = randomCodewords(rng, 10, QrCode::Ecc::MEDIUM);
+    vector<uint8_t> data40 = randomCodewords(rng, 40, QrCode::Ecc::HIGH);
+    vector<uint8_t> codewords;
+    QrEncoder encoder;
+    for (QrCode::SimdLevel level : levels) {
+        QrCode::setSimdLevel(level);
+        double ecc10 = timePerCall([&] { QrCode::computeEccAndInterleave(10, QrCode::Ecc::MEDIUM, data10, codewords); });
+        double ecc40 = timePerCall([&] { QrCode::computeEccAndInterleave(40, QrCode::Ecc::HIGH, data40, codewords); });
+        double us10 = timePerCall([&] { encoder.encodeSegments(medium, QrCode::Ecc::MEDIUM, 10, 10, 0, false); });
+        double us40 = timePerCall([&] { encoder.encodeSegments(high, QrCode::Ecc::HIGH, 40, 40, 0, false); });
+        printf("%-6s  %13.2f  %13.2f  %16.1f  %16.1f\n", simdLevelName(level), ecc10, ecc40, us10, us40);
+    }
+    QrCode::setSimdLevel(best);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// ******************** Mask penalties: word-parallel vs scalar ***************************
+// The lowest mask number with the lowest penalty, as automatic mask selection picks it
+static int bestMask(const array<long, 8>& penalties) {
+    return static_cast<int>(min_element(penalties.begin(), penalties.end()) - penalties.begin());
+}
+
+static int checkMaskPenalties() {
+    mt19937 rng(42);
+    int previous = QrCode::getParallelMaskMinVersion();
+    int checked = 0, mismatches = 0;
+    for (int ver = QrCode::MIN_VERSION; ver <= QrCode::MAX_VERSION; ver++) {
+        for (int e = 0; e < 4; e++) {
+            QrCode::Ecc ecl = static_cast<QrCode::Ecc>(e);
+            vector<uint8_t> data = randomCodewords(rng, ver, ecl);
+            array<long, 8> wordParallel, scalar;
+            QrCode::scoreMasks(ver, ecl, data, wordParallel, scalar);
+            for (int i = 0; i < 8; i++) {
+                if (wordParallel[i] != scalar[i]) {
+                    cerr << "Penalty mismatch at version " << ver << ", ECC " << e << ", mask " << i
+                         << ": " << wordParallel[i] << " vs " << scalar[i] << endl;
+                    mismatches++;
+                }
+            }
+
+            // The encoder must choose the scalar best mask, scoring serially and in parallel
+            int expected = bestMask(scalar);
+            for (int minVersion : { QrCode::MAX_VERSION + 1, QrCode::MIN_VERSION }) {
+                QrCode::setParallelMaskMinVersion(minVersion);
+                int chosen = QrCode(ver, ecl, data, -1).getMask();
+                if (chosen != expected) {
+                    cerr << "Mask mismatch at version " << ver << ", ECC " << e << ": chose " << chosen
+                         << ", expected " << expected << endl;
+                    mismatches++;
+                }
+            }
+            checked++;
+        }
+    }
+    QrCode::setParallelMaskMinVersion(previous);
+    cout << "Checked " << checked << " (version, ECC level) combinations, " << mismatches << " mismatches\n";
+    return mismatches == 0 ? 0 : 1;
+}
+
+// ******************** Decoding: QrReader round trip ***************************
+// Draws the dark modules of the code into a frame of the given width at (left, top)
+static void drawCode(const QrCode& qr, int scale, int left, int top, int width, vector<uint8_t>& frame) {
+    for (int y = 0; y < qr.getSize() * scale; y++) {
+        for (int x = 0; x < qr.getSize() * scale; x++) {
+            if (qr.getModule(x / scale, y / scale))
+                frame[static_cast<size_t>(top + y) * width + left + x] = 40;
+        }
+    }
+}
+
+// Adds the noise of a camera image, +-12 levels per pixel
+static void addNoise(mt19937& rng, vector<uint8_t>& frame) {
+    for (uint8_t& p : frame)
+        p = static_cast<uint8_t>(p + static_cast<int>(rng() % 25) - 12);
+}
+
+// Draws the code into a gray frame at (left, top), dark = 40 and light = 210 with some noise,
+// roughly what a camera at the gate delivers after grayscale conversion
+static void renderFrame(const QrCode& qr, int scale, int left, int top, int width, int height,
+                        mt19937& rng, vector<uint8_t>& frame) {
+    frame.assign(static_cast<size_t>(width) * height, 210);
+    drawCode(qr, scale, left, top, width, frame);
+    addNoise(rng, frame);
+}
+
+static int benchmarkDecode() {
+    mt19937 rng(7);
+    QrReader reader;
+    QrReader::Result result;
+    vector<QrReader::Result> results;
+    vector<uint8_t> frame;
+    int checked = 0, failures = 0;
+    for (int ver = QrCode::MIN_VERSION; ver <= QrCode::MAX_VERSION; ver++) {
+        for (int e = 0; e < 4; e++) {
+            QrCode::Ecc ecl = static_cast<QrCode::Ecc>(e);
+            vector<uint8_t> data = randomData(rng, ver, ecl);
+            QrCode qr = QrCode::encodeBinary(data, ecl);
+            string expected(data.begin(), data.end());
+
+            // Two flipped modules damage at most two codewords, which every block can correct
+            BitGrid damaged = qr.getModules();
+            for (int k = 0; k < 2; k++) {
+                int x = static_cast<int>(rng() % qr.getSize()), y = static_cast<int>(rng() % qr.getSize());
+                damaged.set(x, y, !damaged.get(x, y));
+            }
+            bool gridOk = reader.decodeModules(damaged, result) && result.text == expected;
+
+            int scale = 4, quiet = 4 * scale, side = qr.getSize() * scale + 2 * quiet;
+            renderFrame(qr, scale, quiet, quiet, side, side, rng, frame);
+            bool imageOk = reader.decode(frame.data(), side, side, side, result) && result.text == expected
+                && result.version == ver && result.errorCorrectionLevel == ecl && result.mask == qr.getMask()
+                && reader.decodeAll(frame.data(), side, side, side, results) == 1 && results[0].text == expected;
+            if (!gridOk || !imageOk) {
+                cerr << "Decoding failed at version " << ver << ", ECC " << e
+                     << (gridOk ? " (image)" : " (grid)") << endl;
+                failures++;
+            }
+            checked++;
+        }
+    }
+    cout << "Decoded " << checked << " (version, ECC level) combinations, " << failures << " failures\n";
+
+    // A ticket code as a 1280x720 camera frame shows it, about 6 pixels per module
+    const char* payload = "{\"type\":\"QRCODE\",\"data\":{\"Name\":\"Muhammad Ali\",\"CNIC\":\"3520212345678\","
+                          "\"Departure\":\"Thokar Niaz Baig\",\"Arrival\":\"Dera Gujran\"}}";
+    QrCode ticket = QrCode::encodeText(payload, QrCode::Ecc::HIGH);
+    renderFrame(ticket, 6, 500, 200, 1280, 720, rng, frame);
+    vector<uint8_t> bgr(frame.size() * 3);
+    for (size_t i = 0; i < frame.size(); i++)
+        bgr[i * 3] = bgr[i * 3 + 1] = bgr[i * 3 + 2] = frame[i];
+
+    // Binarization (and the gray conversion of BGR frames) is vectorized with AVX2
+    QrCode::SimdLevel best = QrCode::getMaxSimdLevel();
+    bool ok = true;
+    printf("1280x720 frame, version %d, ms per decode:\n", ticket.getVersion());
+    printf("level   gray(ms)  bgr(ms)\n");
+    for (QrCode::SimdLevel level : { QrCode::SimdLevel::SCALAR, QrCode::SimdLevel::AVX2 }) {
+        if (level > best)
+            continue;
+        QrCode::setSimdLevel(level);
+        double grayUs = timePerCall([&] { ok = reader.decode(frame.data(), 1280, 720, 1280, result) && ok; });
+        double bgrUs = timePerCall([&] {
+            ok = reader.decode(bgr.data(), 1280, 720, 1280 * 3, QrReader::PixelFormat::BGR24, result) && ok;
+        });
+        printf("%-6s  %8.2f  %7.2f\n", simdLevelName(level), grayUs / 1000, bgrUs / 1000);
+    }
+    QrCode::setSimdLevel(best);
+    if (!ok)
+        cerr << "Decoding the 1280x720 frame failed" << endl;
+
+    // A group at a wide gate: six tickets in a grid with the same spacing both ways, so that the
+    // finder patterns of neighbors also form right isosceles triangles that must be passed over
+    frame.assign(static_cast<size_t>(1280) * 720, 210);
+    vector<string> group;
+    for (int i = 0; i < 6; i++) {
+        string text = payload;
+        text.replace(text.find("5678"), 4, "567" + to_string(i));
+        drawCode(QrCode::encodeText(text.c_str(), QrCode::Ecc::HIGH), 3, 100 + i % 3 * 300, 80 + i / 3 * 300, 1280, frame);
+        group.push_back(text);
+    }
+    addNoise(rng, frame);
+    int count = 0;
+    double groupUs = timePerCall([&] { count = reader.decodeAll(frame.data(), 1280, 720, 1280, results); });
+    vector<string> texts;
+    for (const QrReader::Result& r : results)
+        texts.push_back(r.text);
+    sort(texts.begin(), texts.end());
+    sort(group.begin(), group.end());
+    bool groupOk = texts == group;
+    printf("1280x720 frame of %zu tickets: %d decoded in %.2f ms%s\n",
+           group.size(), count, groupUs / 1000, groupOk ? "" : ", FAILED");
+    return failures == 0 && ok && groupOk ? 0 : 1;
+}
+
+// ******************** Gate validation: issued tickets through the gate decoder ***************************
+// Issues JSON and compact tickets the way the booking menu does, reads each one from a camera-like
+// frame and validates it as the gate pipeline does. Tickets to a station outside the metro must fail.
+static int checkGateValidation() {
+    MetroStation metro;
+    metro.addStation(Station("Thokar Niaz Baig", "TNB", 30, 0));
+    metro.addStation(Station("Dera Gujran", "DGJ", 80, 27));
+    Station outside("Shahdara", "SHD", 50, 12);
+    PassengerData passenger("Muhammad Ali", 30, "35202-1234567-8");
+    TicketInfo ticket(1, 80, metro.getStation(0), metro.getStation(1), passenger);
+    ticket.setTicketId(100);
+    TicketInfo outsideTicket(1, 50, metro.getStation(0), outside, passenger);
+    outsideTicket.setTicketId(101);
+
+    struct Case {
+        const char* name;
+        QrCode qr;
+        bool valid;
+    };
+    auto jsonCode = [&](const TicketInfo& t) {
+        return QrCode::encodeText(QRCodeData(passenger, t).getQrCodeData().c_str(), QrCode::Ecc::HIGH);
+    };
+    vector<Case> cases = {
+        { "JSON ticket", jsonCode(ticket), true },
+        { "compact ticket", CompactTicketCodec::encode(CompactTicketCodec::fromTicket(ticket)), true },
+        { "JSON ticket to an outside station", jsonCode(outsideTicket), false },
+        { "compact ticket to an outside station", CompactTicketCodec::encode(CompactTicketCodec::fromTicket(outsideTicket)), false },
+    };
+
+    mt19937 rng(11);
+    QrReader reader;
+    QrReader::Result result;
+    QrDecode gateDecoder;
+    gateDecoder.setMetroStation(&metro);
+    vector<uint8_t> frame;
+    int failures = 0;
+    for (const Case& c : cases) {
+        renderFrame(c.qr, 6, 500, 200, 1280, 720, rng, frame);
+        bool valid = false;
+        if (reader.decode(frame.data(), 1280, 720, 1280, QrReader::PixelFormat::GRAY8, result)) {
+            gateDecoder.parseScannedText(result.text);
+            valid = gateDecoder.validateTicketWithStations();
+        }
+        cout << c.name << ": " << (valid ? "valid" : "invalid") << (valid == c.valid ? "" : "  <-- WRONG") << "\n";
+        if (valid != c.valid)
+            failures++;
+    }
+    cout << "Checked " << cases.size() << " tickets, " << failures << " wrong verdicts\n";
+    return failures == 0 ? 0 : 1;
+}
+
+// ******************** Scanning: frames from a video or an image directory ***************************
+static int benchmarkScan(const string& input, double minSuccess) {
+    QRFrameSource::Next next = QRFrameSource::open(input);
+    if (!next) {
+        cerr << "Cannot open " << input << endl;
+        return 1;
+    }
+
+    // Every frame is decoded three times: searching the whole frame, tracking the last symbol
+    // as the scan pipeline does, and looking for every symbol as the pipeline does at a wide
+    // gate. The success rate that is checked is the tracked one.
+    struct Run {
+        const char* name;
+        QrReader reader;
+        vector<double> latencies;   // Milliseconds per frame, decode only
+        long decoded = 0;
+        double total = 0;
+    } runs[3];
+    runs[0].name = "full";
+    runs[1].name = "tracked";
+    runs[2].name = "all";
+    QrReader::Result result;
+    vector<QrReader::Result> results;
+    vector<uint8_t> pixels;
+    QrReader::PixelFormat format = QrReader::PixelFormat::GRAY8;
+    string lastText;
+    long distinct = 0, windowed = 0, codes = 0;
+    int width = 0, height = 0;
+    while (next(width, height, format, pixels)) {
+        windowed += runs[1].reader.isTracking() ? 1 : 0;
+        int stride = width * QrReader::bytesPerPixel(format);
+        for (int i = 0; i < 3; i++) {
+            Run& run = runs[i];
+            auto start = chrono::steady_clock::now();
+            bool ok;
+            if (i == 0)
+                ok = run.reader.decode(pixels.data(), width, height, stride, format, result);
+            else if (i == 1)
+                ok = run.reader.decodeTracked(pixels.data(), width, height, stride, format, result);
+            else {
+                int count = run.reader.decodeAll(pixels.data(), width, height, stride, format, results);
+                codes += count;
+                ok = count > 0;
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            run.latencies.push_back(ms);
+            run.total += ms;
+            if (ok) {
+                run.decoded++;
+                if (i == 0 && result.text != lastText) {
+                    distinct++;
+                    lastText = result.text;
+                }
+            }
+        }
+    }
+    size_t frames = runs[0].latencies.size();
+    if (frames == 0) {
+        cerr << "No frames read from " << input << " (videos need ffmpeg or -DMETRO_WITH_OPENCV)" << endl;
+        return 1;
+    }
+
+    printf("%zu frames (%dx%d), %ld payload changes, %ld frames searched in the tracked window, "
+           "%ld codes found by the search for all\n", frames, width, height, distinct, windowed, codes);
+    printf("search    decoded  frames/s  p50(ms)  p90(ms)  p99(ms)  max(ms)\n");
+    for (Run& run : runs) {
+        vector<double>& l = run.latencies;
+        sort(l.begin(), l.end());
+        auto percentile = [&](double p) {
+            size_t rank = static_cast<size_t>(p / 100 * l.size() + 0.5);
+            return l[min(l.size() - 1, rank > 0 ? rank - 1 : 0)];
+        };
+        printf("%-7s  %7.1f%%  %8.1f  %7.2f  %7.2f  %7.2f  %7.2f\n", run.name, 100.0 * run.decoded / frames,
+               1000.0 * frames / run.total, percentile(50), percentile(90), percentile(99), l.back());
+    }
+    double success = 100.0 * runs[1].decoded / frames;
+    if (success < minSuccess) {
+        cerr << "Success rate " << success << "% is below the required " << minSuccess << "%" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    string mode = argc > 1 ? argv[1] : "masks";
+    if (mode == "masks")
+        return benchmarkMasks();
+    if (mode == "png")
+        return benchmarkPng();
+    if (mode == "alloc")
+        return benchmarkAlloc();
+    if (mode == "rs")
+        return benchmarkReedSolomon();
+    if (mode == "penalty")
+        return checkMaskPenalties();
+    if (mode == "decode")
+        return benchmarkDecode();
+    if (mode == "gate")
+        return checkGateValidation();
+    if (mode == "scan" && argc > 2)
+        return benchmarkScan(argv[2], argc > 3 ? atof(argv[3]) : 0);
+    cerr << "Usage: " << argv[0] << " masks|png|alloc|rs|penalty|decode|gate" << endl;
+    cerr << "       " << argv[0] << " scan <video file or PNM directory> [min success %]" << endl;
+    return 1;
+}
@@ -24,13 +24,29 @@
 #include <algorithm>
 #include <cassert>
 #include <climits>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <utility>
 #include "qrcodegen.hpp"
 
+// The vectorized Reed-Solomon code needs GCC or Clang (for target attributes and CPU detection) on x86
+#if !defined(QRCODEGEN_SCALAR_RS) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define QRCODEGEN_SIMD_RS
+	#include <immintrin.h>
+#endif
+
+// GCC does not align the stack to 32 bytes on Windows (GCC bug 54412), so AVX2 registers spilled
+// to the stack would fault there; those builds stop at SSSE3, whose 16 bytes the stack does align
+#if defined(QRCODEGEN_SIMD_RS) && !defined(_WIN32)
+	#define QRCODEGEN_SIMD_RS_AVX2
+#endif
+
 using std::int8_t;
 using std::uint8_t;
 using std::size_t;
@@ -39,6 +55,119 @@ using std::vector;
 
 namespace qrcodegen {
 
+/*---- Class MaskWorkerPool ----*/
+
+/* 
+ * A small fixed set of worker threads, started on first use and shared by all QrCode objects, that
+ * runs the independent mask trials of one QR Code at a time. The calling thread takes part in the
+ * work too. Tasks are a plain function pointer and context, so submitting a job does not allocate.
+ */
+class MaskWorkerPool final {
+	
+	public: static MaskWorkerPool &getInstance() {
+		static MaskWorkerPool instance;
+		return instance;
+	}
+	
+	
+	// Returns true iff this pool has at least one worker thread.
+	public: bool isAvailable() const {
+		return !workers.empty();
+	}
+	
+	
+	// Runs func(context, i) for each i in [0, count) and returns true when all of them are done.
+	// Returns false immediately without running anything if another thread is using the pool.
+	public: bool tryRun(int count, void (*func)(void *, int), void *context) {
+		std::unique_lock<std::mutex> runLock(runMutex, std::try_to_lock);
+		if (!runLock.owns_lock() || workers.empty())
+			return false;
+		std::unique_lock<std::mutex> lock(mutex);
+		taskFunc = func;
+		taskContext = context;
+		numTasks = count;
+		nextTask = 0;
+		numDone = 0;
+		generation++;
+		wake.notify_all();
+		runTasks(lock);
+		done.wait(lock, [this] { return numDone == numTasks; });
+		return true;
+	}
+	
+	
+	private: MaskWorkerPool() {
+		unsigned int threads = std::thread::hardware_concurrency();
+		unsigned int numWorkers = std::min(threads > 0 ? threads - 1 : 0, 7U);
+		for (unsigned int i = 0; i < numWorkers; i++)
+			workers.emplace_back([this] { workerLoop(); });
+	}
+	
+	
+	private: ~MaskWorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : workers)
+			t.join();
+	}
+	
+	
+	// Claims and runs tasks of the current job until none are left. The lock is held on entry and exit.
+	private: void runTasks(std::unique_lock<std::mutex> &lock) {
+		while (nextTask < numTasks) {
+			int index = nextTask++;
+			void (*func)(void *, int) = taskFunc;
+			void *context = taskContext;
+			lock.unlock();
+			func(context, index);
+			lock.lock();
+			numDone++;
+			if (numDone == numTasks)
+				done.notify_all();
+		}
+	}
+	
+	
+	private: void workerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		unsigned long seen = generation;
+		while (true) {
+			wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+			runTasks(lock);
+		}
+	}
+	
+	
+	private: std::vector<std::thread> workers;
+	private: std::mutex runMutex;  // Held by the thread that owns the current job
+	private: std::mutex mutex;     // Guards all the fields below
+	private: std::condition_variable wake;
+	private: std::condition_variable done;
+	private: unsigned long generation = 0;
+	private: bool stopping = false;
+	private: void (*taskFunc)(void *, int) = nullptr;
+	private: void *taskContext = nullptr;
+	private: int numTasks = 0;
+	private: int nextTask = 0;
+	private: int numDone = 0;
+	
+};
+
+
+// The arguments and results of one parallel mask selection.
+struct MaskScoringJob final {
+	const QrCode *qrCode;
+	std::array<long,8> *penalties;
+};
+
+
+
 /*---- Class QrSegment ----*/
 
 QrSegment::Mode::Mode(int mode, int cc0, int cc1, int cc2) :
@@ -70,14 +199,26 @@ QrSegment QrSegment::makeBytes(const vector<uint8_t> &data) {
 	if (data.size() > static_cast<unsigned int>(INT_MAX))
 		throw std::length_error("Data too long");
 	BitBuffer bb;
-	for (uint8_t b : data)
-		bb.appendBits(b, 8);
+	bb.appendBytes(data.data(), data.size());
 	return QrSegment(Mode::BYTE, static_cast<int>(data.size()), std::move(bb));
 }
 
 
 QrSegment QrSegment::makeNumeric(const char *digits) {
 	BitBuffer bb;
+	int charCount = appendNumeric(digits, bb);
+	return QrSegment(Mode::NUMERIC, charCount, std::move(bb));
+}
+
+
+QrSegment QrSegment::makeAlphanumeric(const char *text) {
+	BitBuffer bb;
+	int charCount = appendAlphanumeric(text, bb);
+	return QrSegment(Mode::ALPHANUMERIC, charCount, std::move(bb));
+}
+
+
+int QrSegment::appendNumeric(const char *digits, BitBuffer &bb) {
 	int accumData = 0;
 	int accumCount = 0;
 	int charCount = 0;
@@ -95,12 +236,11 @@ QrSegment QrSegment::makeNumeric(const char *digits) {
 	}
 	if (accumCount > 0)  // 1 or 2 digits remaining
 		bb.appendBits(static_cast<uint32_t>(accumData), accumCount * 3 + 1);
-	return QrSegment(Mode::NUMERIC, charCount, std::move(bb));
+	return charCount;
 }
 
 
-QrSegment QrSegment::makeAlphanumeric(const char *text) {
-	BitBuffer bb;
+int QrSegment::appendAlphanumeric(const char *text, BitBuffer &bb) {
 	int accumData = 0;
 	int accumCount = 0;
 	int charCount = 0;
@@ -118,7 +258,7 @@ QrSegment QrSegment::makeAlphanumeric(const char *text) {
 	}
 	if (accumCount > 0)  // 1 character remaining
 		bb.appendBits(static_cast<uint32_t>(accumData), 6);
-	return QrSegment(Mode::ALPHANUMERIC, charCount, std::move(bb));
+	return charCount;
 }
 
 
@@ -140,6 +280,95 @@ vector<QrSegment> QrSegment::makeSegments(const char *text) {
 }
 
 
+vector<QrSegment> QrSegment::makeSegmentsOptimally(const char *text, int version) {
+	if (version < QrCode::MIN_VERSION || version > QrCode::MAX_VERSION)
+		throw std::domain_error("Version number out of range");
+	size_t len = std::strlen(text);
+	vector<QrSegment> result;
+	if (len == 0)
+		return result;
+	vector<std::array<signed char, 3> > charModes;
+	vector<signed char> byteModes;
+	computeOptimalModes(text, len, version, charModes, byteModes);
+	
+	// Group runs of bytes with the same mode into segments
+	for (size_t start = 0; start < len; ) {
+		size_t end = start + 1;
+		while (end < len && byteModes[end] == byteModes[start])
+			end++;
+		if (byteModes[start] == 0)
+			result.push_back(makeBytes(vector<uint8_t>(text + start, text + end)));
+		else {
+			std::string run(text + start, end - start);
+			result.push_back(byteModes[start] == 1 ? makeAlphanumeric(run.c_str()) : makeNumeric(run.c_str()));
+		}
+		start = end;
+	}
+	return result;
+}
+
+
+void QrSegment::computeOptimalModes(const char *text, size_t len, int version,
+		vector<std::array<signed char, 3> > &charModes, vector<signed char> &byteModes) {
+	const Mode *const modes[] = {&Mode::BYTE, &Mode::ALPHANUMERIC, &Mode::NUMERIC};
+	const int numModes = 3;
+	
+	// Segment header sizes, measured in 1/6 bits
+	int headCosts[numModes];
+	for (int i = 0; i < numModes; i++)
+		headCosts[i] = (4 + modes[i]->numCharCountBits(version)) * 6;
+	
+	// charModes[i][j] is the mode that byte i is encoded in, such that the segment open after
+	// byte i is in modes[j] and the total cost is minimal, or -1 if that state is impossible
+	charModes.resize(len);
+	int prevCosts[numModes] = {headCosts[0], headCosts[1], headCosts[2]};
+	for (size_t i = 0; i < len; i++) {
+		char c = text[i];
+		int curCosts[numModes] = {};
+		std::array<signed char, numModes> &cur = charModes[i];
+		cur.fill(-1);
+		
+		// Extend a segment of the same mode, if the byte is allowed in it
+		curCosts[0] = prevCosts[0] + 8 * 6;  // Any byte fits in byte mode
+		cur[0] = 0;
+		if (std::strchr(ALPHANUMERIC_CHARSET, c) != nullptr) {
+			curCosts[1] = prevCosts[1] + 33;  // 5.5 bits per alphanumeric char
+			cur[1] = 1;
+		}
+		if ('0' <= c && c <= '9') {
+			curCosts[2] = prevCosts[2] + 20;  // 3.33 bits per digit
+			cur[2] = 2;
+		}
+		
+		// Or end the segment here (rounding up to whole bits) and start one in another mode
+		for (int j = 0; j < numModes; j++) {  // To mode
+			for (int k = 0; k < numModes; k++) {  // From mode
+				int newCost = (curCosts[k] + 5) / 6 * 6 + headCosts[j];
+				if (cur[k] != -1 && (cur[j] == -1 || newCost < curCosts[j])) {
+					curCosts[j] = newCost;
+					cur[j] = static_cast<signed char>(k);
+				}
+			}
+		}
+		std::copy(curCosts, curCosts + numModes, prevCosts);
+	}
+	
+	// Find the cheapest mode for the last byte, then trace back to the mode of every byte
+	int curMode = -1;
+	for (int j = 0, minCost = 0; j < numModes; j++) {
+		if (charModes[len - 1][j] != -1 && (curMode == -1 || prevCosts[j] < minCost)) {
+			minCost = prevCosts[j];
+			curMode = j;
+		}
+	}
+	byteModes.resize(len);
+	for (size_t i = len; i-- > 0; ) {
+		curMode = charModes[i][static_cast<size_t>(curMode)];
+		byteModes[i] = static_cast<signed char>(curMode);
+	}
+}
+
+
 QrSegment QrSegment::makeEci(long assignVal) {
 	BitBuffer bb;
 	if (assignVal < 0)
@@ -158,7 +387,7 @@ QrSegment QrSegment::makeEci(long assignVal) {
 }
 
 
-QrSegment::QrSegment(const Mode &md, int numCh, const std::vector<bool> &dt) :
+QrSegment::QrSegment(const Mode &md, int numCh, const BitBuffer &dt) :
 		mode(&md),
 		numChars(numCh),
 		data(dt) {
@@ -167,7 +396,7 @@ QrSegment::QrSegment(const Mode &md, int numCh, const std::vector<bool> &dt) :
 }
 
 
-QrSegment::QrSegment(const Mode &md, int numCh, std::vector<bool> &&dt) :
+QrSegment::QrSegment(const Mode &md, int numCh, BitBuffer &&dt) :
 		mode(&md),
 		numChars(numCh),
 		data(std::move(dt)) {
@@ -176,6 +405,17 @@ QrSegment::QrSegment(const Mode &md, int numCh, std::vector<bool> &&dt) :
 }
 
 
+QrSegment::QrSegment(const Mode &md, int numCh, const std::vector<bool> &dt) :
+		mode(&md),
+		numChars(numCh) {
+	if (numCh < 0)
+		throw std::domain_error("Invalid value");
+	data.reserve(dt.size());
+	for (bool bit : dt)
+		data.appendBits(bit ? 1 : 0, 1);
+}
+
+
 int QrSegment::getTotalBits(const vector<QrSegment> &segs, int version) {
 	int result = 0;
 	for (const QrSegment &seg : segs) {
@@ -222,7 +462,7 @@ int QrSegment::getNumChars() const {
 }
 
 
-const std::vector<bool> &QrSegment::getData() const {
+const BitBuffer &QrSegment::getData() const {
 	return data;
 }
 
@@ -231,341 +471,843 @@ const char *QrSegment::ALPHANUMERIC_CHARSET = "0123456789ABCDEFGHIJKLMNOPQRSTUVW
 
 
 
-/*---- Class QrCode ----*/
+/*---- Reed-Solomon tables (computed at compile time) ----*/
 
-int QrCode::getFormatBits(Ecc ecl) {
-	switch (ecl) {
-		case Ecc::LOW     :  return 1;
-		case Ecc::MEDIUM  :  return 0;
-		case Ecc::QUARTILE:  return 3;
-		case Ecc::HIGH    :  return 2;
-		default:  throw std::logic_error("Unreachable");
-	}
-}
+// Exponent (antilog) and logarithm tables for the field GF(2^8/0x11D) with the generator element 0x02.
+// The exponent table holds two periods so that the sum of two logarithms can index it directly.
+struct GaloisFieldTables final {
+	std::uint8_t exp[2 * 255];
+	std::uint8_t log[256];  // log[0] is unused
+};
 
 
-QrCode QrCode::encodeText(const char *text, Ecc ecl) {
-	vector<QrSegment> segs = QrSegment::makeSegments(text);
-	return encodeSegments(segs, ecl);
+static constexpr GaloisFieldTables makeGaloisFieldTables() {
+	GaloisFieldTables result{};
+	int x = 1;
+	for (int i = 0; i < 255; i++) {
+		result.exp[i] = static_cast<std::uint8_t>(x);
+		result.exp[i + 255] = static_cast<std::uint8_t>(x);
+		result.log[x] = static_cast<std::uint8_t>(i);
+		x <<= 1;
+		if ((x & 0x100) != 0)
+			x ^= 0x11D;
+	}
+	return result;
 }
 
-
-QrCode QrCode::encodeBinary(const vector<uint8_t> &data, Ecc ecl) {
-	vector<QrSegment> segs{QrSegment::makeBytes(data)};
-	return encodeSegments(segs, ecl);
-}
+static constexpr GaloisFieldTables GF_TABLES = makeGaloisFieldTables();
 
 
-QrCode QrCode::encodeSegments(const vector<QrSegment> &segs, Ecc ecl,
-		int minVersion, int maxVersion, int mask, bool boostEcl) {
-	if (!(MIN_VERSION <= minVersion && minVersion <= maxVersion && maxVersion <= MAX_VERSION) || mask < -1 || mask > 7)
-		throw std::invalid_argument("Invalid value");
-	
-	// Find the minimal version number to use
-	int version, dataUsedBits;
-	for (version = minVersion; ; version++) {
-		int dataCapacityBits = getNumDataCodewords(version, ecl) * 8;  // Number of data bits available
-		dataUsedBits = QrSegment::getTotalBits(segs, version);
-		if (dataUsedBits != -1 && dataUsedBits <= dataCapacityBits)
-			break;  // This version number is found to be suitable
-		if (version >= maxVersion) {  // All versions in the range could not fit the given data
-			std::ostringstream sb;
-			if (dataUsedBits == -1)
-				sb << "Segment too long";
-			else {
-				sb << "Data length = " << dataUsedBits << " bits, ";
-				sb << "Max capacity = " << dataCapacityBits << " bits";
-			}
-			throw data_too_long(sb.str());
-		}
-	}
-	assert(dataUsedBits != -1);
-	
-	// Increase the error correction level while the data still fits in the current version number
-	for (Ecc newEcl : {Ecc::MEDIUM, Ecc::QUARTILE, Ecc::HIGH}) {  // From low to high
-		if (boostEcl && dataUsedBits <= getNumDataCodewords(version, newEcl) * 8)
-			ecl = newEcl;
-	}
-	
-	// Concatenate all segments to create the data bit string
-	BitBuffer bb;
-	for (const QrSegment &seg : segs) {
-		bb.appendBits(static_cast<uint32_t>(seg.getMode().getModeBits()), 4);
-		bb.appendBits(static_cast<uint32_t>(seg.getNumChars()), seg.getMode().numCharCountBits(version));
-		bb.insert(bb.end(), seg.getData().begin(), seg.getData().end());
-	}
-	assert(bb.size() == static_cast<unsigned int>(dataUsedBits));
-	
-	// Add terminator and pad up to a byte if applicable
-	size_t dataCapacityBits = static_cast<size_t>(getNumDataCodewords(version, ecl)) * 8;
-	assert(bb.size() <= dataCapacityBits);
-	bb.appendBits(0, std::min(4, static_cast<int>(dataCapacityBits - bb.size())));
-	bb.appendBits(0, (8 - static_cast<int>(bb.size() % 8)) % 8);
-	assert(bb.size() % 8 == 0);
-	
-	// Pad with alternating bytes until data capacity is reached
-	for (uint8_t padByte = 0xEC; bb.size() < dataCapacityBits; padByte ^= 0xEC ^ 0x11)
-		bb.appendBits(padByte, 8);
-	
-	// Pack bits into bytes in big endian
-	vector<uint8_t> dataCodewords(bb.size() / 8);
-	for (size_t i = 0; i < bb.size(); i++)
-		dataCodewords.at(i >> 3) |= (bb.at(i) ? 1 : 0) << (7 - (i & 7));
-	
-	// Create the QR Code object
-	return QrCode(version, ecl, dataCodewords, mask);
-}
+// The Reed-Solomon generator polynomials for degrees 1 to 30 (every block ECC length in
+// ECC_CODEWORDS_PER_BLOCK), each stored as the discrete logarithms of its coefficients.
+struct ReedSolomonDivisors final {
+	std::uint8_t logCoefs[31][30];  // Row 0 is unused
+};
 
 
-QrCode::QrCode(int ver, Ecc ecl, const vector<uint8_t> &dataCodewords, int msk) :
-		// Initialize fields and check arguments
-		version(ver),
-		errorCorrectionLevel(ecl) {
-	if (ver < MIN_VERSION || ver > MAX_VERSION)
-		throw std::domain_error("Version value out of range");
-	if (msk < -1 || msk > 7)
-		throw std::domain_error("Mask value out of range");
-	size = ver * 4 + 17;
-	size_t sz = static_cast<size_t>(size);
-	modules    = vector<vector<bool> >(sz, vector<bool>(sz));  // Initially all light
-	isFunction = vector<vector<bool> >(sz, vector<bool>(sz));
-	
-	// Compute ECC, draw modules
-	drawFunctionPatterns();
-	const vector<uint8_t> allCodewords = addEccAndInterleave(dataCodewords);
-	drawCodewords(allCodewords);
-	
-	// Do masking
-	if (msk == -1) {  // Automatically choose best mask
-		long minPenalty = LONG_MAX;
-		for (int i = 0; i < 8; i++) {
-			applyMask(i);
-			drawFormatBits(i);
-			long penalty = getPenaltyScore();
-			if (penalty < minPenalty) {
-				msk = i;
-				minPenalty = penalty;
+static constexpr ReedSolomonDivisors makeReedSolomonDivisors() {
+	ReedSolomonDivisors result{};
+	for (int degree = 1; degree <= 30; degree++) {
+		// Compute the product polynomial (x - r^0) * (x - r^1) * (x - r^2) * ... * (x - r^{degree-1}),
+		// and drop the highest monomial term which is always 1x^degree.
+		// Note that r = 0x02, which is a generator element of this field GF(2^8/0x11D).
+		std::uint8_t poly[30] = {};
+		poly[degree - 1] = 1;  // Start off with the monomial x^0
+		for (int i = 0; i < degree; i++) {
+			// Multiply the current product by (x - r^i)
+			for (int j = 0; j < degree; j++) {
+				poly[j] = poly[j] == 0 ? 0 : GF_TABLES.exp[GF_TABLES.log[poly[j]] + i];
+				if (j + 1 < degree)
+					poly[j] ^= poly[j + 1];
 			}
-			applyMask(i);  // Undoes the mask due to XOR
+		}
+		for (int j = 0; j < degree; j++) {
+			if (poly[j] == 0)
+				throw std::logic_error("Zero coefficient");  // Never happens; would fail compilation
+			result.logCoefs[degree][j] = GF_TABLES.log[poly[j]];
 		}
 	}
-	assert(0 <= msk && msk <= 7);
-	mask = msk;
-	applyMask(msk);  // Apply the final choice of mask
-	drawFormatBits(msk);  // Overwrite old format bits
-	
-	isFunction.clear();
-	isFunction.shrink_to_fit();
-}
-
-
-int QrCode::getVersion() const {
-	return version;
+	return result;
 }
 
+static constexpr ReedSolomonDivisors RS_DIVISORS = makeReedSolomonDivisors();
 
-int QrCode::getSize() const {
-	return size;
-}
 
+#ifdef QRCODEGEN_SIMD_RS
 
-QrCode::Ecc QrCode::getErrorCorrectionLevel() const {
-	return errorCorrectionLevel;
-}
+// For every generator coefficient, its products with all 16 low nibbles and all 16 high nibbles,
+// so that the products of one coefficient with 16 different bytes are two pshufb lookups.
+struct ReedSolomonNibbleTables final {
+	alignas(16) std::uint8_t low [31][30][16];  // low [degree][i][n] = coefficient i * n
+	alignas(16) std::uint8_t high[31][30][16];  // high[degree][i][n] = coefficient i * (n << 4)
+};
 
 
-int QrCode::getMask() const {
-	return mask;
+static constexpr ReedSolomonNibbleTables makeReedSolomonNibbleTables() {
+	ReedSolomonNibbleTables result{};
+	for (int degree = 1; degree <= 30; degree++) {
+		for (int i = 0; i < degree; i++) {
+			int coefLog = RS_DIVISORS.logCoefs[degree][i];
+			for (int n = 1; n < 16; n++) {
+				result.low [degree][i][n] = GF_TABLES.exp[coefLog + GF_TABLES.log[n]];
+				result.high[degree][i][n] = GF_TABLES.exp[coefLog + GF_TABLES.log[n << 4]];
+			}
+		}
+	}
+	return result;
 }
 
-
-bool QrCode::getModule(int x, int y) const {
-	return 0 <= x && x < size && 0 <= y && y < size && module(x, y);
-}
+static constexpr ReedSolomonNibbleTables RS_NIBBLES = makeReedSolomonNibbleTables();
 
 
-void QrCode::drawFunctionPatterns() {
-	// Draw horizontal and vertical timing patterns
-	for (int i = 0; i < size; i++) {
-		setFunctionModule(6, i, i % 2 == 0);
-		setFunctionModule(i, 6, i % 2 == 0);
+/* 
+ * Computes the ECC of up to 16 blocks side by side, one block per byte lane, for
+ * QrCode::reedSolomonComputeInterleaved(). Reads the data bytes from their interleaved positions
+ * in codewords and writes the ECC bytes to theirs, for the blocks [firstBlock, firstBlock + lanes).
+ */
+__attribute__((target("ssse3")))
+static void reedSolomonLanesSsse3(std::uint8_t *codewords, int numBlocks, int numShortBlocks,
+		int shortDataLen, int degree, int firstBlock, int lanes) {
+	__m128i low[30], high[30], rem[30];
+	for (int i = 0; i < degree; i++) {
+		low [i] = _mm_load_si128(reinterpret_cast<const __m128i*>(RS_NIBBLES.low [degree][i]));
+		high[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(RS_NIBBLES.high[degree][i]));
+		rem [i] = _mm_setzero_si128();
 	}
+	const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+	alignas(16) std::uint8_t column[16] = {};
 	
-	// Draw 3 finder patterns (all corners except bottom right; overwrites some timing modules)
-	drawFinderPattern(3, 3);
-	drawFinderPattern(size - 4, 3);
-	drawFinderPattern(3, size - 4);
-	
-	// Draw numerous alignment patterns
-	const vector<int> alignPatPos = getAlignmentPatternPositions();
-	size_t numAlign = alignPatPos.size();
-	for (size_t i = 0; i < numAlign; i++) {
-		for (size_t j = 0; j < numAlign; j++) {
-			// Don't draw on the three finder corners
-			if (!((i == 0 && j == 0) || (i == 0 && j == numAlign - 1) || (i == numAlign - 1 && j == 0)))
-				drawAlignmentPattern(alignPatPos.at(i), alignPatPos.at(j));
+	// Polynomial division of all lanes at once; long blocks take one more step at the end
+	for (int k = 0; k <= shortDataLen; k++) {
+		__m128i dat;
+		if (k < shortDataLen) {
+			const std::uint8_t *src = &codewords[static_cast<size_t>(k * numBlocks + firstBlock)];
+			if (lanes == 16)
+				dat = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			else {
+				std::memcpy(column, src, static_cast<size_t>(lanes));
+				dat = _mm_load_si128(reinterpret_cast<const __m128i*>(column));
+			}
+		} else {
+			if (firstBlock + lanes <= numShortBlocks)
+				break;  // No long blocks in these lanes
+			for (int l = 0; l < lanes; l++) {
+				int i = firstBlock + l;
+				column[l] = i < numShortBlocks ? 0 : codewords[static_cast<size_t>(shortDataLen * numBlocks + (i - numShortBlocks))];
+			}
+			dat = _mm_load_si128(reinterpret_cast<const __m128i*>(column));
+		}
+		__m128i factor = _mm_xor_si128(dat, rem[0]);
+		__m128i factorLow  = _mm_and_si128(factor, nibbleMask);
+		__m128i factorHigh = _mm_and_si128(_mm_srli_epi16(factor, 4), nibbleMask);
+		__m128i next[30];
+		for (int i = 0; i < degree; i++) {
+			__m128i prod = _mm_xor_si128(_mm_shuffle_epi8(low[i], factorLow), _mm_shuffle_epi8(high[i], factorHigh));
+			next[i] = i + 1 < degree ? _mm_xor_si128(rem[i + 1], prod) : prod;
+		}
+		if (k < shortDataLen) {
+			for (int i = 0; i < degree; i++)
+				rem[i] = next[i];
+		} else {  // Only the long blocks take the last step
+			alignas(16) std::uint8_t longLanes[16] = {};
+			for (int l = 0; l < lanes; l++)
+				longLanes[l] = firstBlock + l >= numShortBlocks ? 0xFF : 0x00;
+			__m128i select = _mm_load_si128(reinterpret_cast<const __m128i*>(longLanes));
+			for (int i = 0; i < degree; i++)
+				rem[i] = _mm_or_si128(_mm_and_si128(select, next[i]), _mm_andnot_si128(select, rem[i]));
 		}
 	}
 	
-	// Draw configuration data
-	drawFormatBits(0);  // Dummy mask value; overwritten later in the constructor
-	drawVersion();
+	size_t eccStart = static_cast<size_t>(shortDataLen * numBlocks + (numBlocks - numShortBlocks));
+	for (int i = 0; i < degree; i++) {
+		_mm_store_si128(reinterpret_cast<__m128i*>(column), rem[i]);
+		std::memcpy(&codewords[eccStart + static_cast<size_t>(i * numBlocks + firstBlock)], column, static_cast<size_t>(lanes));
+	}
 }
 
 
-void QrCode::drawFormatBits(int msk) {
-	// Calculate error correction code and pack bits
-	int data = getFormatBits(errorCorrectionLevel) << 3 | msk;  // errCorrLvl is uint2, msk is uint3
-	int rem = data;
-	for (int i = 0; i < 10; i++)
-		rem = (rem << 1) ^ ((rem >> 9) * 0x537);
-	int bits = (data << 10 | rem) ^ 0x5412;  // uint15
-	assert(bits >> 15 == 0);
-	
-	// Draw first copy
-	for (int i = 0; i <= 5; i++)
-		setFunctionModule(8, i, getBit(bits, i));
-	setFunctionModule(8, 7, getBit(bits, 6));
-	setFunctionModule(8, 8, getBit(bits, 7));
-	setFunctionModule(7, 8, getBit(bits, 8));
-	for (int i = 9; i < 15; i++)
-		setFunctionModule(14 - i, 8, getBit(bits, i));
-	
-	// Draw second copy
-	for (int i = 0; i < 8; i++)
-		setFunctionModule(size - 1 - i, 8, getBit(bits, i));
-	for (int i = 8; i < 15; i++)
-		setFunctionModule(8, size - 15 + i, getBit(bits, i));
-	setFunctionModule(8, size - 8, true);  // Always dark
-}
-
+#ifdef QRCODEGEN_SIMD_RS_AVX2
 
-void QrCode::drawVersion() {
-	if (version < 7)
-		return;
+// The same as reedSolomonLanesSsse3() for up to 32 blocks, with the 16-byte tables in both halves of each register.
+__attribute__((target("avx2")))
+static void reedSolomonLanesAvx2(std::uint8_t *codewords, int numBlocks, int numShortBlocks,
+		int shortDataLen, int degree, int firstBlock, int lanes) {
+	__m256i low[30], high[30], rem[30];
+	for (int i = 0; i < degree; i++) {
+		low [i] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(RS_NIBBLES.low [degree][i])));
+		high[i] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(RS_NIBBLES.high[degree][i])));
+		rem [i] = _mm256_setzero_si256();
+	}
+	const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+	std::uint8_t column[32] = {};
 	
-	// Calculate error correction code and pack bits
-	int rem = version;  // version is uint6, in the range [7, 40]
-	for (int i = 0; i < 12; i++)
-		rem = (rem << 1) ^ ((rem >> 11) * 0x1F25);
-	long bits = static_cast<long>(version) << 12 | rem;  // uint18
-	assert(bits >> 18 == 0);
+	for (int k = 0; k <= shortDataLen; k++) {
+		__m256i dat;
+		if (k < shortDataLen) {
+			const std::uint8_t *src = &codewords[static_cast<size_t>(k * numBlocks + firstBlock)];
+			if (lanes == 32)
+				dat = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+			else {
+				std::memcpy(column, src, static_cast<size_t>(lanes));
+				dat = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column));
+			}
+		} else {
+			if (firstBlock + lanes <= numShortBlocks)
+				break;
+			for (int l = 0; l < lanes; l++) {
+				int i = firstBlock + l;
+				column[l] = i < numShortBlocks ? 0 : codewords[static_cast<size_t>(shortDataLen * numBlocks + (i - numShortBlocks))];
+			}
+			dat = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column));
+		}
+		__m256i factor = _mm256_xor_si256(dat, rem[0]);
+		__m256i factorLow  = _mm256_and_si256(factor, nibbleMask);
+		__m256i factorHigh = _mm256_and_si256(_mm256_srli_epi16(factor, 4), nibbleMask);
+		__m256i next[30];
+		for (int i = 0; i < degree; i++) {
+			__m256i prod = _mm256_xor_si256(_mm256_shuffle_epi8(low[i], factorLow), _mm256_shuffle_epi8(high[i], factorHigh));
+			next[i] = i + 1 < degree ? _mm256_xor_si256(rem[i + 1], prod) : prod;
+		}
+		if (k < shortDataLen) {
+			for (int i = 0; i < degree; i++)
+				rem[i] = next[i];
+		} else {
+			std::uint8_t longLanes[32] = {};
+			for (int l = 0; l < lanes; l++)
+				longLanes[l] = firstBlock + l >= numShortBlocks ? 0xFF : 0x00;
+			__m256i select = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(longLanes));
+			for (int i = 0; i < degree; i++)
+				rem[i] = _mm256_blendv_epi8(rem[i], next[i], select);
+		}
+	}
 	
-	// Draw two copies
-	for (int i = 0; i < 18; i++) {
-		bool bit = getBit(bits, i);
-		int a = size - 11 + i % 3;
-		int b = i / 3;
-		setFunctionModule(a, b, bit);
-		setFunctionModule(b, a, bit);
+	size_t eccStart = static_cast<size_t>(shortDataLen * numBlocks + (numBlocks - numShortBlocks));
+	for (int i = 0; i < degree; i++) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(column), rem[i]);
+		std::memcpy(&codewords[eccStart + static_cast<size_t>(i * numBlocks + firstBlock)], column, static_cast<size_t>(lanes));
 	}
 }
 
+#endif
 
-void QrCode::drawFinderPattern(int x, int y) {
-	for (int dy = -4; dy <= 4; dy++) {
-		for (int dx = -4; dx <= 4; dx++) {
-			int dist = std::max(std::abs(dx), std::abs(dy));  // Chebyshev/infinity norm
-			int xx = x + dx, yy = y + dy;
-			if (0 <= xx && xx < size && 0 <= yy && yy < size)
-				setFunctionModule(xx, yy, dist != 2 && dist != 4);
-		}
-	}
-}
+#endif
 
 
-void QrCode::drawAlignmentPattern(int x, int y) {
-	for (int dy = -2; dy <= 2; dy++) {
-		for (int dx = -2; dx <= 2; dx++)
-			setFunctionModule(x + dx, y + dy, std::max(std::abs(dx), std::abs(dy)) != 1);
-	}
-}
 
+/*---- Version tables (computed at compile time) ----*/
 
-void QrCode::setFunctionModule(int x, int y, bool isDark) {
-	size_t ux = static_cast<size_t>(x);
-	size_t uy = static_cast<size_t>(y);
-	modules   .at(uy).at(ux) = isDark;
-	isFunction.at(uy).at(ux) = true;
-}
+static constexpr int8_t ECC_CODEWORDS_PER_BLOCK[4][41] = {
+	// Version: (note that index 0 is for padding, and is set to an illegal value)
+	//0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
+	{-1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // Low
+	{-1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},  // Medium
+	{-1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // Quartile
+	{-1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // High
+};
+
+static constexpr int8_t NUM_ERROR_CORRECTION_BLOCKS[4][41] = {
+	// Version: (note that index 0 is for padding, and is set to an illegal value)
+	//0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
+	{-1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},  // Low
+	{-1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},  // Medium
+	{-1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},  // Quartile
+	{-1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},  // High
+};
 
 
-bool QrCode::module(int x, int y) const {
-	return modules.at(static_cast<size_t>(y)).at(static_cast<size_t>(x));
-}
+// Everything else that depends only on the version number and error correction level, indexed
+// by version number (index 0 is unused) and by the ordinal of the error correction level.
+struct VersionTables final {
+	int numRawDataModules[41];
+	int numDataCodewords[4][41];
+	std::uint8_t numAlignPatterns[41];
+	std::uint8_t alignPatternPositions[41][7];  // Ascending; the first numAlignPatterns[ver] entries are used
+	std::uint16_t formatBits[4][8];  // Masked 15-bit format information, by ECC ordinal and mask
+	std::uint32_t versionBits[41];   // 18-bit version information, or 0 below version 7
+};
 
 
-vector<uint8_t> QrCode::addEccAndInterleave(const vector<uint8_t> &data) const {
-	if (data.size() != static_cast<unsigned int>(getNumDataCodewords(version, errorCorrectionLevel)))
-		throw std::invalid_argument("Invalid argument");
-	
-	// Calculate parameter numbers
-	int numBlocks = NUM_ERROR_CORRECTION_BLOCKS[static_cast<int>(errorCorrectionLevel)][version];
-	int blockEccLen = ECC_CODEWORDS_PER_BLOCK  [static_cast<int>(errorCorrectionLevel)][version];
-	int rawCodewords = getNumRawDataModules(version) / 8;
-	int numShortBlocks = numBlocks - rawCodewords % numBlocks;
-	int shortBlockLen = rawCodewords / numBlocks;
-	
-	// Split data into blocks and append ECC to each block
-	vector<vector<uint8_t> > blocks;
-	const vector<uint8_t> rsDiv = reedSolomonComputeDivisor(blockEccLen);
-	for (int i = 0, k = 0; i < numBlocks; i++) {
-		vector<uint8_t> dat(data.cbegin() + k, data.cbegin() + (k + shortBlockLen - blockEccLen + (i < numShortBlocks ? 0 : 1)));
-		k += static_cast<int>(dat.size());
-		const vector<uint8_t> ecc = reedSolomonComputeRemainder(dat, rsDiv);
-		if (i < numShortBlocks)
-			dat.push_back(0);
-		dat.insert(dat.end(), ecc.cbegin(), ecc.cend());
-		blocks.push_back(std::move(dat));
+static constexpr VersionTables makeVersionTables() {
+	VersionTables result{};
+	for (int ver = QrCode::MIN_VERSION; ver <= QrCode::MAX_VERSION; ver++) {
+		// Data modules left after the function patterns
+		int numAlign = ver == 1 ? 0 : ver / 7 + 2;
+		int raw = (16 * ver + 128) * ver + 64;
+		if (ver >= 2) {
+			raw -= (25 * numAlign - 10) * numAlign - 55;
+			if (ver >= 7)
+				raw -= 36;
+		}
+		if (raw < 208 || raw > 29648)
+			throw std::logic_error("Raw data modules out of range");  // Never happens; would fail compilation
+		result.numRawDataModules[ver] = raw;
+		for (int e = 0; e < 4; e++) {
+			result.numDataCodewords[e][ver] = raw / 8 - ECC_CODEWORDS_PER_BLOCK[e][ver] * NUM_ERROR_CORRECTION_BLOCKS[e][ver];
+			if (ver > QrCode::MIN_VERSION && result.numDataCodewords[e][ver] <= result.numDataCodewords[e][ver - 1])
+				throw std::logic_error("Capacity not increasing");  // Never happens; the binary search relies on it
+		}
+		
+		// Alignment pattern positions: 6, then evenly spaced up to the last one at size - 7
+		result.numAlignPatterns[ver] = static_cast<std::uint8_t>(numAlign);
+		if (numAlign > 0) {
+			int step = (ver * 8 + numAlign * 3 + 5) / (numAlign * 4 - 4) * 2;
+			result.alignPatternPositions[ver][0] = 6;
+			for (int i = numAlign - 1, pos = ver * 4 + 10; i >= 1; i--, pos -= step)
+				result.alignPatternPositions[ver][i] = static_cast<std::uint8_t>(pos);
+		}
+		
+		// Version information with its BCH error correction code
+		if (ver >= 7) {
+			int rem = ver;  // ver is uint6, in the range [7, 40]
+			for (int i = 0; i < 12; i++)
+				rem = (rem << 1) ^ ((rem >> 11) * 0x1F25);
+			result.versionBits[ver] = static_cast<std::uint32_t>(ver) << 12 | static_cast<std::uint32_t>(rem);
+		}
 	}
 	
-	// Interleave (not concatenate) the bytes from every block into a single sequence
-	vector<uint8_t> result;
-	for (size_t i = 0; i < blocks.at(0).size(); i++) {
-		for (size_t j = 0; j < blocks.size(); j++) {
-			// Skip the padding byte in short blocks
-			if (i != static_cast<unsigned int>(shortBlockLen - blockEccLen) || j >= static_cast<unsigned int>(numShortBlocks))
-				result.push_back(blocks.at(j).at(i));
+	// Format information with its BCH error correction code, for every level and mask
+	const int eccFormatBits[4] = {1, 0, 3, 2};  // LOW, MEDIUM, QUARTILE, HIGH
+	for (int e = 0; e < 4; e++) {
+		for (int msk = 0; msk < 8; msk++) {
+			int data = eccFormatBits[e] << 3 | msk;  // errCorrLvl is uint2, msk is uint3
+			int rem = data;
+			for (int i = 0; i < 10; i++)
+				rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+			result.formatBits[e][msk] = static_cast<std::uint16_t>((data << 10 | rem) ^ 0x5412);  // uint15
 		}
 	}
-	assert(result.size() == static_cast<unsigned int>(rawCodewords));
 	return result;
 }
 
+static constexpr VersionTables VERSION_TABLES = makeVersionTables();
 
-void QrCode::drawCodewords(const vector<uint8_t> &data) {
-	if (data.size() != static_cast<unsigned int>(getNumRawDataModules(version) / 8))
-		throw std::invalid_argument("Invalid argument");
+
+// Returns the last version number whose character count fields have the same widths as the given
+// version's (see QrSegment::Mode::numCharCountBits()), so a segment list has the same bit length
+// for all versions from the given one up to the result.
+static constexpr int getCharCountGroupEnd(int ver) {
+	return ver <= 9 ? 9 : (ver <= 26 ? 26 : 40);
+}
+
+
+
+/*---- Class QrCode::FunctionTemplate ----*/
+
+/* 
+ * Everything in a QR Code that depends only on its version number: the function modules (finder,
+ * timing and alignment patterns, the version bits, and the reserved format bit area) and the zigzag
+ * path that drawCodewords() takes through the data modules. Each version's template is built on
+ * first use and then shared, read-only, by every code of that version, so the constructor copies
+ * the module grid instead of redrawing it, and needs no isFunction grid of its own.
+ */
+class QrCode::FunctionTemplate final {
+	
+	// Returns the template for the given version, which must be in range. Thread-safe.
+	public: static const FunctionTemplate &get(int ver) {
+		static std::once_flag built[MAX_VERSION + 1];
+		static std::unique_ptr<const FunctionTemplate> templates[MAX_VERSION + 1];
+		std::call_once(built[ver], [ver]() {
+			templates[ver].reset(new FunctionTemplate(ver));
+		});
+		return *templates[ver];
+	}
+	
+	
+	// The function modules; data modules and the format bits (except the always-dark module) are light.
+	public: BitGrid modules;
+	
+	// Indicates function modules, which are not subjected to masking.
+	public: BitGrid isFunction;
+	
+	// The data modules in the order that codeword bits are placed, each as y << 8 | x.
+	// Has getNumRawDataModules(version) entries, so it includes the remainder bits.
+	public: vector<std::uint16_t> dataPath;
 	
-	size_t i = 0;  // Bit index into the data
-	// Do the funny zigzag scan
-	for (int right = size - 1; right >= 1; right -= 2) {  // Index of right column in each column pair
-		if (right == 6)
-			right = 5;
-		for (int vert = 0; vert < size; vert++) {  // Vertical counter
-			for (int j = 0; j < 2; j++) {
-				size_t x = static_cast<size_t>(right - j);  // Actual x coordinate
-				bool upward = ((right + 1) & 2) == 0;
-				size_t y = static_cast<size_t>(upward ? size - 1 - vert : vert);  // Actual y coordinate
-				if (!isFunction.at(y).at(x) && i < data.size() * 8) {
-					modules.at(y).at(x) = getBit(data.at(i >> 3), 7 - static_cast<int>(i & 7));
-					i++;
+	
+	private: int size;
+	
+	
+	private: explicit FunctionTemplate(int ver) :
+			modules(ver * 4 + 17),
+			isFunction(ver * 4 + 17),
+			size(ver * 4 + 17) {
+		// Draw horizontal and vertical timing patterns
+		for (int i = 0; i < size; i++) {
+			setFunctionModule(6, i, i % 2 == 0);
+			setFunctionModule(i, 6, i % 2 == 0);
+		}
+		
+		// Draw 3 finder patterns (all corners except bottom right; overwrites some timing modules)
+		drawFinderPattern(3, 3);
+		drawFinderPattern(size - 4, 3);
+		drawFinderPattern(3, size - 4);
+		
+		// Draw numerous alignment patterns
+		const uint8_t *alignPatPos = getAlignmentPatternPositions(ver);
+		int numAlign = getNumAlignmentPatterns(ver);
+		for (int i = 0; i < numAlign; i++) {
+			for (int j = 0; j < numAlign; j++) {
+				// Don't draw on the three finder corners
+				if (!((i == 0 && j == 0) || (i == 0 && j == numAlign - 1) || (i == numAlign - 1 && j == 0)))
+					drawAlignmentPattern(alignPatPos[i], alignPatPos[j]);
+			}
+		}
+		
+		// Reserve both copies of the format bits, which QrCode::drawFormatBits() fills in
+		for (int i = 0; i <= 8; i++) {
+			if (i != 6) {  // Skip the timing patterns
+				setFunctionModule(8, i, false);
+				setFunctionModule(i, 8, false);
+			}
+		}
+		for (int i = 0; i < 8; i++) {
+			setFunctionModule(size - 1 - i, 8, false);
+			setFunctionModule(8, size - 1 - i, false);
+		}
+		setFunctionModule(8, size - 8, true);  // Always dark
+		
+		// Draw two copies of the version bits (with its own error correction code), iff 7 <= version <= 40
+		if (ver >= 7) {
+			long bits = static_cast<long>(VERSION_TABLES.versionBits[ver]);  // uint18
+			for (int i = 0; i < 18; i++) {
+				bool bit = getBit(bits, i);
+				int a = size - 11 + i % 3;
+				int b = i / 3;
+				setFunctionModule(a, b, bit);
+				setFunctionModule(b, a, bit);
+			}
+		}
+		
+		// Do the funny zigzag scan over the remaining modules
+		dataPath.reserve(static_cast<size_t>(getNumRawDataModules(ver)));
+		for (int right = size - 1; right >= 1; right -= 2) {  // Index of right column in each column pair
+			if (right == 6)
+				right = 5;
+			for (int vert = 0; vert < size; vert++) {  // Vertical counter
+				for (int j = 0; j < 2; j++) {
+					int x = right - j;  // Actual x coordinate
+					bool upward = ((right + 1) & 2) == 0;
+					int y = upward ? size - 1 - vert : vert;  // Actual y coordinate
+					if (!isFunction.get(x, y))
+						dataPath.push_back(static_cast<std::uint16_t>(y << 8 | x));
 				}
-				// If this QR Code has any remainder bits (0 to 7), they were assigned as
-				// 0/false/light by the constructor and are left unchanged by this method
+			}
+		}
+		if (dataPath.size() != static_cast<size_t>(getNumRawDataModules(ver)))
+			throw std::logic_error("Assertion error");
+	}
+	
+	
+	// Draws a 9*9 finder pattern including the border separator,
+	// with the center module at (x, y). Modules can be out of bounds.
+	private: void drawFinderPattern(int x, int y) {
+		for (int dy = -4; dy <= 4; dy++) {
+			for (int dx = -4; dx <= 4; dx++) {
+				int dist = std::max(std::abs(dx), std::abs(dy));  // Chebyshev/infinity norm
+				int xx = x + dx, yy = y + dy;
+				if (0 <= xx && xx < size && 0 <= yy && yy < size)
+					setFunctionModule(xx, yy, dist != 2 && dist != 4);
+			}
+		}
+	}
+	
+	
+	// Draws a 5*5 alignment pattern, with the center module
+	// at (x, y). All modules must be in bounds.
+	private: void drawAlignmentPattern(int x, int y) {
+		for (int dy = -2; dy <= 2; dy++) {
+			for (int dx = -2; dx <= 2; dx++)
+				setFunctionModule(x + dx, y + dy, std::max(std::abs(dx), std::abs(dy)) != 1);
+		}
+	}
+	
+	
+	// Sets the color of a module and marks it as a function module. Coordinates must be in bounds.
+	private: void setFunctionModule(int x, int y, bool isDark) {
+		modules   .set(x, y, isDark);
+		isFunction.set(x, y, true);
+	}
+	
+};
+
+
+
+/*---- Class QrCode ----*/
+
+QrCode QrCode::encodeText(const char *text, Ecc ecl) {
+	vector<QrSegment> segs = QrSegment::makeSegments(text);
+	return encodeSegments(segs, ecl);
+}
+
+
+QrCode QrCode::encodeTextOptimal(const char *text, Ecc ecl) {
+	// The optimal segmentation only changes where the character count field widths do
+	for (int groupStart = MIN_VERSION; ; ) {
+		int groupEnd = getCharCountGroupEnd(groupStart);
+		vector<QrSegment> segs = QrSegment::makeSegmentsOptimally(text, groupStart);
+		int dataUsedBits = QrSegment::getTotalBits(segs, groupEnd);
+		if ((dataUsedBits != -1 && dataUsedBits <= getNumDataCodewords(groupEnd, ecl) * 8) || groupEnd >= MAX_VERSION)
+			return encodeSegments(segs, ecl, groupStart, groupEnd);  // Throws data_too_long if even version 40 is too small
+		groupStart = groupEnd + 1;
+	}
+}
+
+
+QrCode QrCode::encodeBinary(const vector<uint8_t> &data, Ecc ecl) {
+	vector<QrSegment> segs{QrSegment::makeBytes(data)};
+	return encodeSegments(segs, ecl);
+}
+
+
+QrCode QrCode::encodeSegments(const vector<QrSegment> &segs, Ecc ecl,
+		int minVersion, int maxVersion, int mask, bool boostEcl) {
+	if (!(MIN_VERSION <= minVersion && minVersion <= maxVersion && maxVersion <= MAX_VERSION) || mask < -1 || mask > 7)
+		throw std::invalid_argument("Invalid value");
+	
+	int dataUsedBits;
+	int version = selectVersion(segs, ecl, minVersion, maxVersion, boostEcl, dataUsedBits);
+	
+	// Concatenate all segments to create the data bit string, padded to the data capacity
+	BitBuffer bb;
+	bb.reserve(static_cast<size_t>(getNumDataCodewords(version, ecl)) * 8);
+	appendDataCodewords(segs, version, ecl, bb);
+	assert(bb.size() == static_cast<size_t>(getNumDataCodewords(version, ecl)) * 8);
+	
+	// The bits are already packed into bytes in big endian
+	const vector<uint8_t> dataCodewords = bb.getBytes();
+	
+	// Create the QR Code object
+	return QrCode(version, ecl, dataCodewords, mask);
+}
+
+
+int QrCode::selectVersion(const vector<QrSegment> &segs, Ecc &ecl,
+		int minVersion, int maxVersion, bool boostEcl, int &dataUsedBits) {
+	// Find the minimal version number to use. The data length is the same for all versions
+	// with the same character count field widths, so each such group needs one binary search.
+	int version = -1;
+	dataUsedBits = -1;
+	for (int groupStart = minVersion; groupStart <= maxVersion && version == -1; ) {
+		int groupEnd = std::min(getCharCountGroupEnd(groupStart), maxVersion);
+		dataUsedBits = QrSegment::getTotalBits(segs, groupStart);
+		if (dataUsedBits != -1) {
+			int ver = getMinVersionForCapacity(dataUsedBits, ecl, groupStart, groupEnd);
+			if (ver <= groupEnd)
+				version = ver;  // This version number is found to be suitable
+		}
+		groupStart = groupEnd + 1;
+	}
+	if (version == -1) {  // All versions in the range could not fit the given data
+		std::ostringstream sb;
+		if (dataUsedBits == -1)
+			sb << "Segment too long";
+		else {
+			sb << "Data length = " << dataUsedBits << " bits, ";
+			sb << "Max capacity = " << getNumDataCodewords(maxVersion, ecl) * 8 << " bits";
+		}
+		throw data_too_long(sb.str());
+	}
+	
+	// Increase the error correction level while the data still fits in the current version number
+	for (Ecc newEcl : {Ecc::MEDIUM, Ecc::QUARTILE, Ecc::HIGH}) {  // From low to high
+		if (boostEcl && dataUsedBits <= getNumDataCodewords(version, newEcl) * 8)
+			ecl = newEcl;
+	}
+	
+	return version;
+}
+
+
+void QrCode::appendDataCodewords(const vector<QrSegment> &segs, int version, Ecc ecl, BitBuffer &bb) {
+	// Concatenate all segments to create the data bit string
+	for (const QrSegment &seg : segs) {
+		bb.appendBits(static_cast<uint32_t>(seg.getMode().getModeBits()), 4);
+		bb.appendBits(static_cast<uint32_t>(seg.getNumChars()), seg.getMode().numCharCountBits(version));
+		bb.appendData(seg.getData());
+	}
+	
+	// Add terminator and pad up to a byte if applicable
+	size_t dataCapacityBits = static_cast<size_t>(getNumDataCodewords(version, ecl)) * 8;
+	assert(bb.size() <= dataCapacityBits);
+	bb.appendBits(0, std::min(4, static_cast<int>(dataCapacityBits - bb.size())));
+	bb.appendBits(0, (8 - static_cast<int>(bb.size() % 8)) % 8);
+	assert(bb.size() % 8 == 0);
+	
+	// Pad with alternating bytes until data capacity is reached
+	for (uint8_t padByte = 0xEC; bb.size() < dataCapacityBits; padByte ^= 0xEC ^ 0x11)
+		bb.appendBits(padByte, 8);
+}
+
+
+QrCode::QrCode(int ver, Ecc ecl, const vector<uint8_t> &dataCodewords, int msk) :
+		// Initialize fields and check arguments
+		version(ver),
+		errorCorrectionLevel(ecl) {
+	if (ver < MIN_VERSION || ver > MAX_VERSION)
+		throw std::domain_error("Version value out of range");
+	if (msk < -1 || msk > 7)
+		throw std::domain_error("Mask value out of range");
+	if (dataCodewords.size() != static_cast<unsigned int>(getNumDataCodewords(ver, ecl)))
+		throw std::invalid_argument("Invalid argument");
+	vector<uint8_t> allCodewords(static_cast<size_t>(getNumRawDataModules(ver) / 8));
+	initialize(ver, ecl, dataCodewords.data(), allCodewords.data(), msk);
+}
+
+
+QrCode::QrCode() :
+		version(0),
+		size(0),
+		errorCorrectionLevel(Ecc::LOW),
+		mask(0),
+		functionTemplate(nullptr) {}
+
+
+void QrCode::initialize(int ver, Ecc ecl, const uint8_t *dataCodewords, uint8_t *allCodewords, int msk) {
+	version = ver;
+	size = ver * 4 + 17;
+	errorCorrectionLevel = ecl;
+	
+	// Start from the version's function modules, compute ECC, draw modules
+	functionTemplate = &FunctionTemplate::get(ver);
+	modules = functionTemplate->modules;
+	addEccAndInterleave(ver, ecl, dataCodewords, allCodewords);
+	drawCodewords(allCodewords);
+	
+	// Do masking
+	if (msk == -1) {  // Automatically choose best mask
+		std::array<long,8> penalties;
+#ifdef QRCODEGEN_SCALAR_MASKING
+		for (int i = 0; i < 8; i++) {
+			applyMask(i);
+			drawFormatBits(i);
+			penalties[i] = getPenaltyScore();
+			applyMask(i);  // Undoes the mask due to XOR
+		}
+#else
+		if (version < parallelMaskMinVersion.load(std::memory_order_relaxed) || !scoreMasksInParallel(penalties)) {
+			for (int i = 0; i < 8; i++)
+				penalties[i] = getMaskPenaltyScore(i);
+		}
+#endif
+		long minPenalty = LONG_MAX;
+		for (int i = 0; i < 8; i++) {
+			if (penalties[i] < minPenalty) {  // Ties go to the lowest mask number
+				msk = i;
+				minPenalty = penalties[i];
+			}
+		}
+	}
+	assert(0 <= msk && msk <= 7);
+	mask = msk;
+	applyMask(msk);  // Apply the final choice of mask
+	drawFormatBits(msk);  // Overwrite old format bits
+	
+	functionTemplate = nullptr;
+}
+
+
+void QrCode::setParallelMaskMinVersion(int ver) {
+	if (ver < MIN_VERSION)
+		throw std::domain_error("Version value out of range");
+	parallelMaskMinVersion.store(ver, std::memory_order_relaxed);
+}
+
+
+int QrCode::getParallelMaskMinVersion() {
+	return parallelMaskMinVersion.load(std::memory_order_relaxed);
+}
+
+
+void QrCode::scoreMasks(int ver, Ecc ecl, const vector<uint8_t> &dataCodewords,
+		std::array<long,8> &wordParallel, std::array<long,8> &scalar) {
+	vector<uint8_t> allCodewords;
+	computeEccAndInterleave(ver, ecl, dataCodewords, allCodewords);  // Checks the arguments
+	
+	// Draw the unmasked modules as initialize() does
+	QrCode qr;
+	qr.version = ver;
+	qr.size = ver * 4 + 17;
+	qr.errorCorrectionLevel = ecl;
+	qr.functionTemplate = &FunctionTemplate::get(ver);
+	qr.modules = qr.functionTemplate->modules;
+	qr.drawCodewords(allCodewords.data());
+	
+	for (int i = 0; i < 8; i++) {
+		wordParallel[i] = qr.getMaskPenaltyScore(i);
+		qr.applyMask(i);
+		qr.drawFormatBits(i);
+		scalar[i] = qr.getPenaltyScore();
+		qr.applyMask(i);  // Undoes the mask due to XOR
+	}
+}
+
+
+QrCode::SimdLevel QrCode::getMaxSimdLevel() {
+#ifdef QRCODEGEN_SIMD_RS
+	__builtin_cpu_init();
+#ifdef QRCODEGEN_SIMD_RS_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return SimdLevel::AVX2;
+#endif
+	if (__builtin_cpu_supports("ssse3"))
+		return SimdLevel::SSSE3;
+#endif
+	return SimdLevel::SCALAR;
+}
+
+
+void QrCode::setSimdLevel(SimdLevel level) {
+	level = std::min(level, getMaxSimdLevel());
+	simdLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+
+QrCode::SimdLevel QrCode::getSimdLevel() {
+	int level = simdLevel.load(std::memory_order_relaxed);
+	if (level == -1) {  // Not detected yet
+		level = static_cast<int>(getMaxSimdLevel());
+		simdLevel.store(level, std::memory_order_relaxed);
+	}
+	return static_cast<SimdLevel>(level);
+}
+
+
+void QrCode::computeEccAndInterleave(int ver, Ecc ecl,
+		const vector<uint8_t> &dataCodewords, vector<uint8_t> &allCodewords) {
+	if (ver < MIN_VERSION || ver > MAX_VERSION)
+		throw std::domain_error("Version value out of range");
+	if (dataCodewords.size() != static_cast<unsigned int>(getNumDataCodewords(ver, ecl)))
+		throw std::invalid_argument("Invalid argument");
+	allCodewords.resize(static_cast<size_t>(getNumRawDataModules(ver) / 8));
+	addEccAndInterleave(ver, ecl, dataCodewords.data(), allCodewords.data());
+}
+
+
+int QrCode::getVersion() const {
+	return version;
+}
+
+
+int QrCode::getSize() const {
+	return size;
+}
+
+
+QrCode::Ecc QrCode::getErrorCorrectionLevel() const {
+	return errorCorrectionLevel;
+}
+
+
+int QrCode::getMask() const {
+	return mask;
+}
+
+
+bool QrCode::getModule(int x, int y) const {
+	return 0 <= x && x < size && 0 <= y && y < size && module(x, y);
+}
+
+
+const BitGrid &QrCode::getModules() const {
+	return modules;
+}
+
+
+template <typename Func>
+void QrCode::forEachFormatModule(int msk, Func setter) const {
+	// The format bits with their error correction code are precomputed
+	int bits = VERSION_TABLES.formatBits[static_cast<int>(errorCorrectionLevel)][msk];  // uint15
+	
+	// Draw first copy
+	for (int i = 0; i <= 5; i++)
+		setter(8, i, getBit(bits, i));
+	setter(8, 7, getBit(bits, 6));
+	setter(8, 8, getBit(bits, 7));
+	setter(7, 8, getBit(bits, 8));
+	for (int i = 9; i < 15; i++)
+		setter(14 - i, 8, getBit(bits, i));
+	
+	// Draw second copy
+	for (int i = 0; i < 8; i++)
+		setter(size - 1 - i, 8, getBit(bits, i));
+	for (int i = 8; i < 15; i++)
+		setter(8, size - 15 + i, getBit(bits, i));
+	setter(8, size - 8, true);  // Always dark
+}
+
+
+void QrCode::drawFormatBits(int msk) {
+	forEachFormatModule(msk, [this](int x, int y, bool isDark) {
+		modules.set(x, y, isDark);  // Marked as function modules by the template
+	});
+}
+
+
+bool QrCode::module(int x, int y) const {
+	return modules.get(x, y);
+}
+
+
+void QrCode::addEccAndInterleave(int ver, Ecc ecl, const uint8_t *data, uint8_t *result) {
+	// Calculate parameter numbers
+	int numBlocks = NUM_ERROR_CORRECTION_BLOCKS[static_cast<int>(ecl)][ver];
+	int blockEccLen = ECC_CODEWORDS_PER_BLOCK  [static_cast<int>(ecl)][ver];
+	int rawCodewords = getNumRawDataModules(ver) / 8;
+	int numShortBlocks = numBlocks - rawCodewords % numBlocks;
+	int shortBlockLen = rawCodewords / numBlocks;
+	int shortDataLen = shortBlockLen - blockEccLen;
+	
+	// Split data into blocks, writing every byte straight to its interleaved (not concatenated)
+	// position: first column j of all blocks' data for j < shortDataLen, then the extra data byte
+	// of each long block, then column j of all blocks' ECC
+	for (int i = 0, k = 0; i < numBlocks; i++) {
+		int datLen = shortDataLen + (i < numShortBlocks ? 0 : 1);
+		const uint8_t *dat = &data[static_cast<size_t>(k)];
+		k += datLen;
+		for (int j = 0; j < shortDataLen; j++)
+			result[static_cast<size_t>(j * numBlocks + i)] = dat[j];
+		if (i >= numShortBlocks)
+			result[static_cast<size_t>(shortDataLen * numBlocks + (i - numShortBlocks))] = dat[shortDataLen];
+	}
+	reedSolomonComputeInterleaved(data, result, numBlocks, numShortBlocks, shortDataLen, blockEccLen);
+}
+
+
+void QrCode::drawCodewords(const uint8_t *data) {
+	// Follow the template's zigzag path. The data modules start out light, so only dark bits are set.
+	// If this QR Code has any remainder bits (0 to 7), they are left light at the end of the path.
+	const std::uint16_t *path = functionTemplate->dataPath.data();
+	for (int k = getNumRawDataModules(version) / 8; k > 0; k--, data++) {
+		uint8_t b = *data;
+		for (int i = 7; i >= 0; i--, path++) {
+			if (getBit(b, i)) {
+				int x = *path & 0xFF, y = *path >> 8;
+				modules.row(y)[x >> 6] |= static_cast<std::uint64_t>(1) << (x & 63);
 			}
 		}
 	}
-	assert(i == data.size() * 8);
 }
 
 
 void QrCode::applyMask(int msk) {
 	if (msk < 0 || msk > 7)
 		throw std::domain_error("Mask value out of range");
-	size_t sz = static_cast<size_t>(size);
-	for (size_t y = 0; y < sz; y++) {
-		for (size_t x = 0; x < sz; x++) {
+#ifndef QRCODEGEN_SCALAR_MASKING
+	int numWords = modules.getWordsPerRow();
+	std::uint64_t lastWordMask = getWordMask(numWords - 1, size);
+	for (int y = 0; y < size; y++) {
+		std::uint64_t *modRow = modules.row(y);
+		const std::uint64_t *funcRow = functionTemplate->isFunction.row(y);
+		const std::uint64_t *maskRow = getMaskRow(msk, y);
+		for (int i = 0; i < numWords; i++)
+			modRow[i] ^= maskRow[i] & ~funcRow[i];
+		modRow[numWords - 1] &= lastWordMask;
+	}
+#else
+	for (int y = 0; y < size; y++) {
+		std::uint64_t *modRow = modules.row(y);
+		const std::uint64_t *funcRow = functionTemplate->isFunction.row(y);
+		for (int x = 0; x < size; x++) {
 			bool invert;
 			switch (msk) {
 				case 0:  invert = (x + y) % 2 == 0;                    break;
@@ -578,9 +1320,11 @@ void QrCode::applyMask(int msk) {
 				case 7:  invert = ((x + y) % 2 + x * y % 3) % 2 == 0;  break;
 				default:  throw std::logic_error("Unreachable");
 			}
-			modules.at(y).at(x) = modules.at(y).at(x) ^ (invert & !isFunction.at(y).at(x));
+			std::uint64_t bit = static_cast<std::uint64_t>(invert) << (x & 63);
+			modRow[x >> 6] ^= bit & ~funcRow[x >> 6];
 		}
 	}
+#endif
 }
 
 
@@ -645,12 +1389,100 @@ long QrCode::getPenaltyScore() const {
 	
 	// Balance of dark and light modules
 	int dark = 0;
-	for (const vector<bool> &row : modules) {
-		for (bool color : row) {
-			if (color)
-				dark++;
+	for (int y = 0; y < size; y++) {
+		const std::uint64_t *row = modules.row(y);
+		for (int i = 0; i < modules.getWordsPerRow(); i++)
+			dark += popCount(row[i]);
+	}
+	int total = size * size;  // Note that size is odd, so dark/total != 1/2
+	// Compute the smallest integer k >= 0 such that (45-5k)% <= dark/total <= (55+5k)%
+	int k = static_cast<int>((std::abs(dark * 20L - total * 10L) + total - 1) / total) - 1;
+	assert(0 <= k && k <= 9);
+	result += k * PENALTY_N4;
+	assert(0 <= result && result <= 2568888L);  // Non-tight upper bound based on default values of PENALTY_N1, ..., N4
+	return result;
+}
+
+
+bool QrCode::scoreMasksInParallel(std::array<long,8> &penalties) const {
+	MaskScoringJob job{this, &penalties};
+	return MaskWorkerPool::getInstance().tryRun(8, scoreMaskTask, &job);
+}
+
+
+void QrCode::scoreMaskTask(void *context, int msk) {
+	MaskScoringJob &job = *static_cast<MaskScoringJob*>(context);
+	(*job.penalties)[static_cast<size_t>(msk)] = job.qrCode->getMaskPenaltyScore(msk);
+}
+
+
+long QrCode::getMaskPenaltyScore(int msk) const {
+	constexpr int MAX_PADDED_SIZE = MAX_ROW_WORDS * 64;
+	int numWords = modules.getWordsPerRow();
+	int paddedSize = numWords * 64;
+	
+	// Apply the mask and format bits to a copy of the modules, padded with light rows to a multiple of 64
+	std::uint64_t grid[MAX_PADDED_SIZE][MAX_ROW_WORDS];
+	std::uint64_t lastWordMask = getWordMask(numWords - 1, size);
+	for (int y = 0; y < size; y++) {
+		const std::uint64_t *modRow = modules.row(y);
+		const std::uint64_t *funcRow = functionTemplate->isFunction.row(y);
+		const std::uint64_t *maskRow = getMaskRow(msk, y);
+		for (int i = 0; i < numWords; i++)
+			grid[y][i] = modRow[i] ^ (maskRow[i] & ~funcRow[i]);
+		grid[y][numWords - 1] &= lastWordMask;
+	}
+	for (int y = size; y < paddedSize; y++)
+		std::fill_n(grid[y], numWords, 0);
+	forEachFormatModule(msk, [&grid](int x, int y, bool isDark) {
+		std::uint64_t &word = grid[y][x >> 6];
+		std::uint64_t bit = static_cast<std::uint64_t>(1) << (x & 63);
+		word = isDark ? (word | bit) : (word & ~bit);
+	});
+	
+	// Adjacent modules in row having same color, finder-like patterns, and the dark module count
+	long result = 0;
+	int dark = 0;
+	for (int y = 0; y < size; y++) {
+		result += getLinePenaltyScore(grid[y]);
+		for (int i = 0; i < numWords; i++)
+			dark += popCount(grid[y][i]);
+	}
+	
+	// 2*2 blocks of modules having same color: bit x is set iff module x equals module
+	// x + 1 in the upper row, and both equal the modules below them in the lower row
+	int blocks = 0;
+	for (int y = 0; y < size - 1; y++) {
+		const std::uint64_t *upper = grid[y];
+		const std::uint64_t *lower = grid[y + 1];
+		std::uint64_t sameBelow[MAX_ROW_WORDS];
+		std::uint64_t sameBelowNext[MAX_ROW_WORDS];
+		std::uint64_t upperNext[MAX_ROW_WORDS];
+		for (int i = 0; i < numWords; i++)
+			sameBelow[i] = ~(upper[i] ^ lower[i]);
+		shiftWordsDown(sameBelow, 1, sameBelowNext, numWords);
+		shiftWordsDown(upper, 1, upperNext, numWords);
+		for (int i = 0; i < numWords; i++)
+			blocks += popCount(sameBelow[i] & sameBelowNext[i] & ~(upper[i] ^ upperNext[i]) & getWordMask(i, size - 1));
+	}
+	result += static_cast<long>(blocks) * PENALTY_N2;
+	
+	// Adjacent modules in column having same color, and finder-like patterns, on the transposed grid
+	std::uint64_t transposed[MAX_PADDED_SIZE][MAX_ROW_WORDS];
+	std::uint64_t block[64];
+	for (int by = 0; by < numWords; by++) {
+		for (int bx = 0; bx < numWords; bx++) {
+			for (int k = 0; k < 64; k++)
+				block[k] = grid[by * 64 + k][bx];
+			transposeBitBlock(block);
+			for (int k = 0; k < 64; k++)
+				transposed[bx * 64 + k][by] = block[k];
 		}
 	}
+	for (int x = 0; x < size; x++)
+		result += getLinePenaltyScore(transposed[x]);
+	
+	// Balance of dark and light modules
 	int total = size * size;  // Note that size is odd, so dark/total != 1/2
 	// Compute the smallest integer k >= 0 such that (45-5k)% <= dark/total <= (55+5k)%
 	int k = static_cast<int>((std::abs(dark * 20L - total * 10L) + total - 1) / total) - 1;
@@ -661,90 +1493,196 @@ long QrCode::getPenaltyScore() const {
 }
 
 
-vector<int> QrCode::getAlignmentPatternPositions() const {
-	if (version == 1)
-		return vector<int>();
-	else {
-		int numAlign = version / 7 + 2;
-		int step = (version * 8 + numAlign * 3 + 5) / (numAlign * 4 - 4) * 2;
-		vector<int> result;
-		for (int i = 0, pos = size - 7; i < numAlign - 1; i++, pos -= step)
-			result.insert(result.begin(), pos);
-		result.insert(result.begin(), 6);
-		return result;
+long QrCode::getLinePenaltyScore(const std::uint64_t *line) const {
+	int numWords = (size + 63) / 64;
+	
+	// Bit x of 'changes' is set iff modules x and x + 1 differ, and bit x of 'same' iff they are equal
+	std::uint64_t next[MAX_ROW_WORDS];
+	std::uint64_t changes[MAX_ROW_WORDS];
+	std::uint64_t same[MAX_ROW_WORDS];
+	shiftWordsDown(line, 1, next, numWords);
+	for (int i = 0; i < numWords; i++) {
+		std::uint64_t valid = getWordMask(i, size - 1);
+		changes[i] = (line[i] ^ next[i]) & valid;
+		same[i] = ~changes[i] & valid;
 	}
+	
+	// Bit x of 'windows' is set iff modules x to x + 4 all have the same color. A run of
+	// length n >= 5 covers n - 4 windows and begins at exactly one of them, so it scores
+	// PENALTY_N1 + (n - 5) = (n - 4) + (PENALTY_N1 - 1) points
+	std::uint64_t windows[MAX_ROW_WORDS];
+	std::uint64_t shifted[MAX_ROW_WORDS];
+	std::copy_n(same, numWords, windows);
+	for (int k = 1; k <= 3; k++) {
+		shiftWordsDown(same, k, shifted, numWords);
+		for (int i = 0; i < numWords; i++)
+			windows[i] &= shifted[i];
+	}
+	long result = 0;
+	for (int i = 0; i < numWords; i++) {
+		std::uint64_t prev = i > 0 ? windows[i - 1] >> 63 : 0;
+		std::uint64_t starts = windows[i] & ~(windows[i] << 1 | prev);
+		result += popCount(windows[i]) + popCount(starts) * (PENALTY_N1 - 1);
+	}
+	
+	// Finder-like patterns, by feeding each run length into the same history that getPenaltyScore() uses
+	std::array<int,7> runHistory = {};
+	bool runColor = (line[0] & 1) != 0;
+	if (runColor)
+		finderPenaltyAddHistory(0, runHistory);  // Empty light run before a leading dark module
+	int runStart = 0;
+	int finders = 0;
+	for (int i = 0; i < numWords; i++) {
+		for (std::uint64_t w = changes[i]; w != 0; w &= w - 1) {
+			int runEnd = i * 64 + countTrailingZeros(w) + 1;
+			finderPenaltyAddHistory(runEnd - runStart, runHistory);
+			if (!runColor)
+				finders += finderPenaltyCountPatterns(runHistory);
+			runColor = !runColor;
+			runStart = runEnd;
+		}
+	}
+	finders += finderPenaltyTerminateAndCount(runColor, size - runStart, runHistory);
+	return result + static_cast<long>(finders) * PENALTY_N3;
+}
+
+
+int QrCode::getNumAlignmentPatterns(int ver) {
+	return VERSION_TABLES.numAlignPatterns[ver];
+}
+
+
+const uint8_t *QrCode::getAlignmentPatternPositions(int ver) {
+	return VERSION_TABLES.alignPatternPositions[ver];
 }
 
 
 int QrCode::getNumRawDataModules(int ver) {
 	if (ver < MIN_VERSION || ver > MAX_VERSION)
 		throw std::domain_error("Version number out of range");
-	int result = (16 * ver + 128) * ver + 64;
-	if (ver >= 2) {
-		int numAlign = ver / 7 + 2;
-		result -= (25 * numAlign - 10) * numAlign - 55;
-		if (ver >= 7)
-			result -= 36;
-	}
-	assert(208 <= result && result <= 29648);
-	return result;
+	return VERSION_TABLES.numRawDataModules[ver];
 }
 
 
 int QrCode::getNumDataCodewords(int ver, Ecc ecl) {
-	return getNumRawDataModules(ver) / 8
-		- ECC_CODEWORDS_PER_BLOCK    [static_cast<int>(ecl)][ver]
-		* NUM_ERROR_CORRECTION_BLOCKS[static_cast<int>(ecl)][ver];
+	return VERSION_TABLES.numDataCodewords[static_cast<int>(ecl)][ver];
 }
 
 
-vector<uint8_t> QrCode::reedSolomonComputeDivisor(int degree) {
-	if (degree < 1 || degree > 255)
+int QrCode::getNumErrorCorrectionBlocks(int ver, Ecc ecl) {
+	return NUM_ERROR_CORRECTION_BLOCKS[static_cast<int>(ecl)][ver];
+}
+
+
+int QrCode::getEccCodewordsPerBlock(int ver, Ecc ecl) {
+	return ECC_CODEWORDS_PER_BLOCK[static_cast<int>(ecl)][ver];
+}
+
+
+int QrCode::getFormatInformation(Ecc ecl, int msk) {
+	return VERSION_TABLES.formatBits[static_cast<int>(ecl)][msk];
+}
+
+
+long QrCode::getVersionInformation(int ver) {
+	return static_cast<long>(VERSION_TABLES.versionBits[ver]);
+}
+
+
+const std::uint16_t *QrCode::getDataModulePath(int ver) {
+	return FunctionTemplate::get(ver).dataPath.data();
+}
+
+
+int QrCode::getMinVersionForCapacity(int dataBits, Ecc ecl, int minVersion, int maxVersion) {
+	// Capacities strictly increase with the version number (checked when building the tables)
+	const int *capacity = VERSION_TABLES.numDataCodewords[static_cast<int>(ecl)];
+	int lo = minVersion;
+	int hi = maxVersion + 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (capacity[mid] * 8 >= dataBits)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+
+const uint8_t *QrCode::reedSolomonGetDivisor(int degree) {
+	if (degree < 1 || degree > MAX_ECC_CODEWORDS_PER_BLOCK)
 		throw std::domain_error("Degree out of range");
-	// Polynomial coefficients are stored from highest to lowest power, excluding the leading term which is always 1.
-	// For example the polynomial x^3 + 255x^2 + 8x + 93 is stored as the uint8 array {255, 8, 93}.
-	vector<uint8_t> result(static_cast<size_t>(degree));
-	result.at(result.size() - 1) = 1;  // Start off with the monomial x^0
-	
-	// Compute the product polynomial (x - r^0) * (x - r^1) * (x - r^2) * ... * (x - r^{degree-1}),
-	// and drop the highest monomial term which is always 1x^degree.
-	// Note that r = 0x02, which is a generator element of this field GF(2^8/0x11D).
-	uint8_t root = 1;
-	for (int i = 0; i < degree; i++) {
-		// Multiply the current product by (x - r^i)
-		for (size_t j = 0; j < result.size(); j++) {
-			result.at(j) = reedSolomonMultiply(result.at(j), root);
-			if (j + 1 < result.size())
-				result.at(j) ^= result.at(j + 1);
+	return RS_DIVISORS.logCoefs[degree];
+}
+
+
+void QrCode::reedSolomonComputeInterleaved(const uint8_t *data, uint8_t *codewords,
+		int numBlocks, int numShortBlocks, int shortDataLen, int degree) {
+#ifdef QRCODEGEN_SIMD_RS
+	// The columns of interleaved data are the blocks' bytes side by side, ready to load into lanes.
+	// With fewer than 4 blocks most lanes would be empty, and the scalar code is as fast.
+	SimdLevel level = numBlocks >= 4 ? getSimdLevel() : SimdLevel::SCALAR;
+	if (level != SimdLevel::SCALAR) {
+		int width = level == SimdLevel::AVX2 ? 32 : 16;
+		for (int i = 0; i < numBlocks; i += width) {
+			int lanes = std::min(width, numBlocks - i);
+#ifdef QRCODEGEN_SIMD_RS_AVX2
+			if (level == SimdLevel::AVX2)
+				reedSolomonLanesAvx2(codewords, numBlocks, numShortBlocks, shortDataLen, degree, i, lanes);
+			else
+#endif
+				reedSolomonLanesSsse3(codewords, numBlocks, numShortBlocks, shortDataLen, degree, i, lanes);
 		}
-		root = reedSolomonMultiply(root, 0x02);
+		return;
+	}
+#endif
+	uint8_t ecc[MAX_ECC_CODEWORDS_PER_BLOCK];
+	size_t eccStart = static_cast<size_t>(shortDataLen * numBlocks + (numBlocks - numShortBlocks));
+	for (int i = 0, k = 0; i < numBlocks; i++) {
+		int datLen = shortDataLen + (i < numShortBlocks ? 0 : 1);
+		reedSolomonComputeRemainder(&data[static_cast<size_t>(k)], static_cast<size_t>(datLen), degree, ecc);
+		k += datLen;
+		for (int j = 0; j < degree; j++)
+			codewords[eccStart + static_cast<size_t>(j * numBlocks + i)] = ecc[j];
 	}
-	return result;
 }
 
 
-vector<uint8_t> QrCode::reedSolomonComputeRemainder(const vector<uint8_t> &data, const vector<uint8_t> &divisor) {
-	vector<uint8_t> result(divisor.size());
-	for (uint8_t b : data) {  // Polynomial division
-		uint8_t factor = b ^ result.at(0);
-		result.erase(result.begin());
-		result.push_back(0);
-		for (size_t i = 0; i < result.size(); i++)
-			result.at(i) ^= reedSolomonMultiply(divisor.at(i), factor);
+void QrCode::reedSolomonComputeRemainder(const uint8_t *data, size_t dataLen, int degree, uint8_t *result) {
+	const uint8_t *divisorLogs = reedSolomonGetDivisor(degree);
+	std::fill_n(result, degree, 0);
+	for (size_t k = 0; k < dataLen; k++) {  // Polynomial division
+		uint8_t factor = data[k] ^ result[0];
+		if (factor == 0) {  // Just shift the remainder
+			std::memmove(result, result + 1, static_cast<size_t>(degree - 1));
+			result[degree - 1] = 0;
+			continue;
+		}
+		int factorLog = GF_TABLES.log[factor];
+		for (int i = 0; i + 1 < degree; i++)
+			result[i] = result[i + 1] ^ GF_TABLES.exp[divisorLogs[i] + factorLog];
+		result[degree - 1] = GF_TABLES.exp[divisorLogs[degree - 1] + factorLog];
 	}
-	return result;
 }
 
 
 uint8_t QrCode::reedSolomonMultiply(uint8_t x, uint8_t y) {
-	// Russian peasant multiplication
-	int z = 0;
-	for (int i = 7; i >= 0; i--) {
-		z = (z << 1) ^ ((z >> 7) * 0x11D);
-		z ^= ((y >> i) & 1) * x;
-	}
-	assert(z >> 8 == 0);
-	return static_cast<uint8_t>(z);
+	if (x == 0 || y == 0)
+		return 0;
+	return GF_TABLES.exp[GF_TABLES.log[x] + GF_TABLES.log[y]];
+}
+
+
+uint8_t QrCode::reedSolomonExp(int e) {
+	assert(0 <= e && e < 510);
+	return GF_TABLES.exp[e];
+}
+
+
+int QrCode::reedSolomonLog(uint8_t x) {
+	assert(x != 0);
+	return GF_TABLES.log[x];
 }
 
 
@@ -781,31 +1719,227 @@ bool QrCode::getBit(long x, int i) {
 }
 
 
+int QrCode::popCount(std::uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(x);
+#else
+	int result = 0;
+	for (; x != 0; x &= x - 1)
+		result++;
+	return result;
+#endif
+}
+
+
+int QrCode::countTrailingZeros(std::uint64_t x) {
+	assert(x != 0);
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(x);
+#else
+	int result = 0;
+	for (; (x & 1) == 0; x >>= 1)
+		result++;
+	return result;
+#endif
+}
+
+
+std::uint64_t QrCode::getWordMask(int wordIndex, int numBits) {
+	int bits = std::min(std::max(numBits - wordIndex * 64, 0), 64);
+	return bits == 64 ? ~static_cast<std::uint64_t>(0) : (static_cast<std::uint64_t>(1) << bits) - 1;
+}
+
+
+void QrCode::shiftWordsDown(const std::uint64_t *src, int shift, std::uint64_t *dest, int numWords) {
+	assert(1 <= shift && shift <= 63);
+	for (int i = 0; i < numWords; i++) {
+		std::uint64_t carry = i + 1 < numWords ? src[i + 1] << (64 - shift) : 0;
+		dest[i] = src[i] >> shift | carry;
+	}
+}
+
+
+void QrCode::transposeBitBlock(std::uint64_t block[64]) {
+	// Swap the off-diagonal 32*32 sub-blocks, then the 16*16 ones within each of those, etc.
+	std::uint64_t m = 0x00000000FFFFFFFFULL;
+	for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+		for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+			std::uint64_t t = ((block[k] >> j) ^ block[k | j]) & m;
+			block[k] ^= t << j;
+			block[k | j] ^= t;
+		}
+	}
+}
+
+
+const std::uint64_t *QrCode::getMaskRow(int msk, int y) {
+	using MaskRow = std::array<std::uint64_t, MAX_ROW_WORDS>;
+	// All 8 patterns repeat every 12 rows, so the table has 8 * 12 rows; built once on first use
+	static const std::array<MaskRow, 8 * 12> table = [] {
+		std::array<MaskRow, 8 * 12> result = {};
+		for (int m = 0; m < 8; m++) {
+			for (int yy = 0; yy < 12; yy++) {
+				for (int x = 0; x < MAX_ROW_WORDS * 64; x++) {
+					bool invert;
+					switch (m) {
+						case 0:  invert = (x + yy) % 2 == 0;                     break;
+						case 1:  invert = yy % 2 == 0;                           break;
+						case 2:  invert = x % 3 == 0;                            break;
+						case 3:  invert = (x + yy) % 3 == 0;                     break;
+						case 4:  invert = (x / 3 + yy / 2) % 2 == 0;             break;
+						case 5:  invert = x * yy % 2 + x * yy % 3 == 0;          break;
+						case 6:  invert = (x * yy % 2 + x * yy % 3) % 2 == 0;    break;
+						case 7:  invert = ((x + yy) % 2 + x * yy % 3) % 2 == 0;  break;
+						default:  throw std::logic_error("Unreachable");
+					}
+					if (invert)
+						result[static_cast<size_t>(m * 12 + yy)][static_cast<size_t>(x >> 6)] |= static_cast<std::uint64_t>(1) << (x & 63);
+				}
+			}
+		}
+		return result;
+	}();
+	assert(0 <= msk && msk <= 7 && y >= 0);
+	return table[static_cast<size_t>(msk * 12 + y % 12)].data();
+}
+
+
 /*---- Tables of constants ----*/
 
+std::atomic<int> QrCode::parallelMaskMinVersion(DEFAULT_PARALLEL_MASK_MIN_VERSION);
+
+std::atomic<int> QrCode::simdLevel(-1);
+
+
 const int QrCode::PENALTY_N1 =  3;
 const int QrCode::PENALTY_N2 =  3;
 const int QrCode::PENALTY_N3 = 40;
 const int QrCode::PENALTY_N4 = 10;
 
 
-const int8_t QrCode::ECC_CODEWORDS_PER_BLOCK[4][41] = {
-	// Version: (note that index 0 is for padding, and is set to an illegal value)
-	//0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
-	{-1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // Low
-	{-1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},  // Medium
-	{-1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // Quartile
-	{-1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // High
-};
+/*---- Class QrEncoder ----*/
+
+QrEncoder::QrEncoder() :
+		oneSegment{QrSegment(QrSegment::Mode::BYTE, 0, BitBuffer())},
+		dataCodewords(static_cast<size_t>(QrCode::getNumDataCodewords(QrCode::MAX_VERSION, QrCode::Ecc::LOW))),
+		allCodewords(static_cast<size_t>(QrCode::getNumRawDataModules(QrCode::MAX_VERSION) / 8)) {
+	dataBits.reserve(dataCodewords.size() * 8);
+	oneSegment[0].data.reserve(dataCodewords.size() * 8);
+	qrCode.modules.reset(QrCode::MAX_VERSION * 4 + 17);
+}
+
+
+const QrCode &QrEncoder::encodeText(const char *text, QrCode::Ecc ecl) {
+	// Select the segment mode like QrSegment::makeSegments(), but refill the one reused segment
+	if (*text == '\0')
+		return encodeSegments(noSegments, ecl);
+	QrSegment &seg = oneSegment[0];
+	seg.data.clear();
+	if (QrSegment::isNumeric(text)) {
+		seg.mode = &QrSegment::Mode::NUMERIC;
+		seg.numChars = QrSegment::appendNumeric(text, seg.data);
+	} else if (QrSegment::isAlphanumeric(text)) {
+		seg.mode = &QrSegment::Mode::ALPHANUMERIC;
+		seg.numChars = QrSegment::appendAlphanumeric(text, seg.data);
+	} else {
+		size_t len = std::strlen(text);
+		if (len > static_cast<unsigned int>(INT_MAX))
+			throw std::length_error("Data too long");
+		seg.mode = &QrSegment::Mode::BYTE;
+		seg.numChars = static_cast<int>(len);
+		seg.data.appendBytes(reinterpret_cast<const uint8_t*>(text), len);
+	}
+	return encodeSegments(oneSegment, ecl);
+}
+
+
+const QrCode &QrEncoder::encodeTextOptimal(const char *text, QrCode::Ecc ecl) {
+	size_t len = std::strlen(text);
+	if (len > static_cast<unsigned int>(INT_MAX))
+		throw std::length_error("Data too long");
+	// The same version groups as QrCode::encodeTextOptimal()
+	for (int groupStart = QrCode::MIN_VERSION; ; ) {
+		int groupEnd = getCharCountGroupEnd(groupStart);
+		
+		// Group runs of bytes with the same mode into segments, like QrSegment::makeSegmentsOptimally(),
+		// refilling the segments of the previous text
+		size_t numSegs = 0;
+		if (len > 0) {
+			QrSegment::computeOptimalModes(text, len, groupStart, charModes, byteModes);
+			numSegs = 1;
+			for (size_t i = 1; i < len; i++)
+				numSegs += byteModes[i] != byteModes[i - 1] ? 1 : 0;
+		}
+		while (optimalSegments.size() > numSegs) {
+			spareSegments.push_back(std::move(optimalSegments.back()));
+			optimalSegments.pop_back();
+		}
+		while (optimalSegments.size() < numSegs) {
+			if (spareSegments.empty())
+				optimalSegments.emplace_back(QrSegment::Mode::BYTE, 0, BitBuffer());
+			else {
+				optimalSegments.push_back(std::move(spareSegments.back()));
+				spareSegments.pop_back();
+			}
+		}
+		for (size_t start = 0, k = 0; start < len; k++) {
+			size_t end = start + 1;
+			while (end < len && byteModes[end] == byteModes[start])
+				end++;
+			QrSegment &seg = optimalSegments[k];
+			seg.data.clear();
+			if (byteModes[start] == 0) {
+				seg.mode = &QrSegment::Mode::BYTE;
+				seg.numChars = static_cast<int>(end - start);
+				seg.data.appendBytes(reinterpret_cast<const uint8_t*>(text + start), end - start);
+			} else {
+				run.assign(text + start, end - start);
+				if (byteModes[start] == 1) {
+					seg.mode = &QrSegment::Mode::ALPHANUMERIC;
+					seg.numChars = QrSegment::appendAlphanumeric(run.c_str(), seg.data);
+				} else {
+					seg.mode = &QrSegment::Mode::NUMERIC;
+					seg.numChars = QrSegment::appendNumeric(run.c_str(), seg.data);
+				}
+			}
+			start = end;
+		}
+		
+		int dataUsedBits = QrSegment::getTotalBits(optimalSegments, groupEnd);
+		if ((dataUsedBits != -1 && dataUsedBits <= QrCode::getNumDataCodewords(groupEnd, ecl) * 8) || groupEnd >= QrCode::MAX_VERSION)
+			return encodeSegments(optimalSegments, ecl, groupStart, groupEnd);  // Throws data_too_long if even version 40 is too small
+		groupStart = groupEnd + 1;
+	}
+}
+
+
+const QrCode &QrEncoder::encodeBinary(const uint8_t *data, size_t len, QrCode::Ecc ecl) {
+	if (len > static_cast<unsigned int>(INT_MAX))
+		throw std::length_error("Data too long");
+	QrSegment &seg = oneSegment[0];
+	seg.data.clear();
+	seg.mode = &QrSegment::Mode::BYTE;
+	seg.numChars = static_cast<int>(len);
+	seg.data.appendBytes(data, len);
+	return encodeSegments(oneSegment, ecl);
+}
+
+
+const QrCode &QrEncoder::encodeSegments(const vector<QrSegment> &segs, QrCode::Ecc ecl,
+		int minVersion, int maxVersion, int mask, bool boostEcl) {
+	if (!(QrCode::MIN_VERSION <= minVersion && minVersion <= maxVersion && maxVersion <= QrCode::MAX_VERSION) || mask < -1 || mask > 7)
+		throw std::invalid_argument("Invalid value");
+	
+	int dataUsedBits;
+	int version = QrCode::selectVersion(segs, ecl, minVersion, maxVersion, boostEcl, dataUsedBits);
+	dataBits.clear();
+	QrCode::appendDataCodewords(segs, version, ecl, dataBits);
+	assert(dataBits.size() == static_cast<size_t>(QrCode::getNumDataCodewords(version, ecl)) * 8);
+	dataBits.getBytes(dataCodewords.data());
+	qrCode.initialize(version, ecl, dataCodewords.data(), allCodewords.data(), mask);
+	return qrCode;
+}
 
-const int8_t QrCode::NUM_ERROR_CORRECTION_BLOCKS[4][41] = {
-	// Version: (note that index 0 is for padding, and is set to an illegal value)
-	//0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
-	{-1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},  // Low
-	{-1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},  // Medium
-	{-1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},  // Quartile
-	{-1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},  // High
-};
 
 
 data_too_long::data_too_long(const std::string &msg) :
@@ -813,17 +1947,156 @@ data_too_long::data_too_long(const std::string &msg) :
 
 
 
+/*---- Class BitGrid ----*/
+
+BitGrid::BitGrid() :
+	size(0),
+	wordsPerRow(0) {}
+
+
+BitGrid::BitGrid(int sz) {
+	reset(sz);
+}
+
+
+int BitGrid::getSize() const {
+	return size;
+}
+
+
+int BitGrid::getWordsPerRow() const {
+	return wordsPerRow;
+}
+
+
+bool BitGrid::get(int x, int y) const {
+	assert(0 <= x && x < size && 0 <= y && y < size);
+	return ((words[static_cast<size_t>(y * wordsPerRow + (x >> 6))] >> (x & 63)) & 1) != 0;
+}
+
+
+void BitGrid::set(int x, int y, bool val) {
+	assert(0 <= x && x < size && 0 <= y && y < size);
+	std::uint64_t &word = words[static_cast<size_t>(y * wordsPerRow + (x >> 6))];
+	std::uint64_t bit = static_cast<std::uint64_t>(1) << (x & 63);
+	word = val ? (word | bit) : (word & ~bit);
+}
+
+
+const std::uint64_t *BitGrid::row(int y) const {
+	assert(0 <= y && y < size);
+	return &words[static_cast<size_t>(y * wordsPerRow)];
+}
+
+
+std::uint64_t *BitGrid::row(int y) {
+	assert(0 <= y && y < size);
+	return &words[static_cast<size_t>(y * wordsPerRow)];
+}
+
+
+void BitGrid::reset(int sz) {
+	if (sz < 0)
+		throw std::domain_error("Size out of range");
+	size = sz;
+	wordsPerRow = (sz + 63) / 64;
+	words.assign(static_cast<size_t>(sz) * static_cast<size_t>(wordsPerRow), 0);
+}
+
+
+
 /*---- Class BitBuffer ----*/
 
-BitBuffer::BitBuffer()
-	: std::vector<bool>() {}
+BitBuffer::BitBuffer() :
+	accumulator(0),
+	accumulatorBits(0) {}
 
 
 void BitBuffer::appendBits(std::uint32_t val, int len) {
 	if (len < 0 || len > 31 || val >> len != 0)
 		throw std::domain_error("Value out of range");
-	for (int i = len - 1; i >= 0; i--)  // Append bit by bit
-		this->push_back(((val >> i) & 1) != 0);
+	if (len == 0)
+		return;
+	accumulator = accumulator << len | val;
+	accumulatorBits += len;
+	if (accumulatorBits > 32)  // Keep room for another 31-bit append
+		flushBytes();
+}
+
+
+void BitBuffer::appendBytes(const uint8_t *data, size_t len) {
+	if (accumulatorBits % 8 == 0) {  // Byte-aligned, so copy the bytes directly
+		flushBytes();
+		bytes.insert(bytes.end(), data, data + len);
+	} else {
+		for (size_t i = 0; i < len; i++)
+			appendBits(data[i], 8);
+	}
+}
+
+
+void BitBuffer::appendData(const BitBuffer &other) {
+	appendBytes(other.bytes.data(), other.bytes.size());
+	int pending = other.accumulatorBits;
+	std::uint64_t pendingBits = other.accumulator & ((static_cast<std::uint64_t>(1) << pending) - 1);
+	if (pending > 31) {  // appendBits() takes at most 31 bits at a time
+		appendBits(static_cast<uint32_t>(pendingBits >> 8), pending - 8);
+		appendBits(static_cast<uint32_t>(pendingBits & 0xFF), 8);
+	} else
+		appendBits(static_cast<uint32_t>(pendingBits), pending);
+}
+
+
+size_t BitBuffer::size() const {
+	return bytes.size() * 8 + static_cast<size_t>(accumulatorBits);
+}
+
+
+bool BitBuffer::getBit(size_t index) const {
+	assert(index < size());
+	size_t byteBits = bytes.size() * 8;
+	if (index < byteBits)
+		return ((bytes[index >> 3] >> (7 - (index & 7))) & 1) != 0;
+	int shift = accumulatorBits - 1 - static_cast<int>(index - byteBits);
+	return ((accumulator >> shift) & 1) != 0;
+}
+
+
+void BitBuffer::getBytes(uint8_t *out) const {
+	if (!bytes.empty())
+		std::memcpy(out, bytes.data(), bytes.size());
+	out += bytes.size();
+	// Left-align the pending bits and emit them one byte at a time, zero-padding the last one
+	for (int remain = accumulatorBits; remain > 0; remain -= 8, out++) {
+		*out = static_cast<uint8_t>(remain >= 8 ? accumulator >> (remain - 8) : accumulator << (8 - remain));
+	}
+}
+
+
+vector<uint8_t> BitBuffer::getBytes() const {
+	vector<uint8_t> result((size() + 7) / 8);
+	getBytes(result.data());
+	return result;
+}
+
+
+void BitBuffer::clear() {
+	bytes.clear();
+	accumulator = 0;
+	accumulatorBits = 0;
+}
+
+
+void BitBuffer::reserve(size_t numBits) {
+	bytes.reserve((numBits + 7) / 8);
+}
+
+
+void BitBuffer::flushBytes() {
+	while (accumulatorBits >= 8) {
+		accumulatorBits -= 8;
+		bytes.push_back(static_cast<uint8_t>(accumulator >> accumulatorBits));
+	}
 }
 
 }
@@ -24,6 +24,8 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <stdexcept>
 #include <string>
@@ -32,6 +34,80 @@
 
 namespace qrcodegen {
 
+/* 
+ * An appendable sequence of bits (0s and 1s), packed into bytes in big endian. Mainly used by
+ * QrSegment. Appended bits collect in a 64-bit accumulator, which is flushed to the byte array
+ * a few whole bytes at a time, so no work is done per individual bit.
+ */
+class BitBuffer final {
+	
+	/*---- Constructor ----*/
+	
+	// Creates an empty bit buffer (length 0).
+	public: BitBuffer();
+	
+	
+	
+	/*---- Methods ----*/
+	
+	// Appends the given number of low-order bits of the given value
+	// to this buffer. Requires 0 <= len <= 31 and val < 2^len.
+	public: void appendBits(std::uint32_t val, int len);
+	
+	
+	// Appends the given bytes to this buffer, 8 bits each, most significant bit first.
+	public: void appendBytes(const std::uint8_t *data, std::size_t len);
+	
+	
+	// Appends all the bits of the given buffer to this buffer.
+	public: void appendData(const BitBuffer &other);
+	
+	
+	// Returns the number of bits in this buffer.
+	public: std::size_t size() const;
+	
+	
+	// Returns the bit at the given index, which must be less than size().
+	public: bool getBit(std::size_t index) const;
+	
+	
+	// Writes the bits of this buffer packed into ceil(size() / 8) bytes in big endian,
+	// with the unused low bits of the last byte set to 0, to the given array.
+	public: void getBytes(std::uint8_t *out) const;
+	
+	
+	// Returns the bits of this buffer packed into bytes, as described for getBytes(std::uint8_t*).
+	public: std::vector<std::uint8_t> getBytes() const;
+	
+	
+	// Removes all bits from this buffer, keeping its allocated storage.
+	public: void clear();
+	
+	
+	// Allocates storage for at least the given total number of bits.
+	public: void reserve(std::size_t numBits);
+	
+	
+	// Moves all complete bytes from the accumulator to the byte array.
+	private: void flushBytes();
+	
+	
+	
+	/*---- Fields ----*/
+	
+	// The complete bytes of this buffer.
+	private: std::vector<std::uint8_t> bytes;
+	
+	// The bits after the complete bytes, right-aligned. Only the low accumulatorBits bits are meaningful.
+	private: std::uint64_t accumulator;
+	
+	// The number of bits in the accumulator, in the range [0, 63].
+	private: int accumulatorBits;
+	
+};
+
+
+
 /* 
  * A segment of character/binary/control data in a QR Code symbol.
  * Instances of this class are immutable.
@@ -123,6 +199,16 @@ class QrSegment final {
 	public: static std::vector<QrSegment> makeSegments(const char *text);
 	
 	
+	/* 
+	 * Returns a list of zero or more segments to represent the given text string with the fewest
+	 * total bits at the given version number, splitting the text into runs of numeric, alphanumeric
+	 * and byte mode wherever switching modes saves space. Because the character count field widths
+	 * depend on the version, the result is optimal for all versions in the same group as the given
+	 * one (1 to 9, 10 to 26, or 27 to 40). Kanji mode is not used.
+	 */
+	public: static std::vector<QrSegment> makeSegmentsOptimally(const char *text, int version);
+	
+	
 	/* 
 	 * Returns a segment representing an Extended Channel Interpretation
 	 * (ECI) designator with the given assignment value.
@@ -160,7 +246,7 @@ class QrSegment final {
 	private: int numChars;
 	
 	/* The data bits of this segment. Accessed through getData(). */
-	private: std::vector<bool> data;
+	private: BitBuffer data;
 	
 	
 	/*---- Constructors (low level) ----*/
@@ -170,7 +256,7 @@ class QrSegment final {
 	 * The character count (numCh) must agree with the mode and the bit buffer length,
 	 * but the constraint isn't checked. The given bit buffer is copied and stored.
 	 */
-	public: QrSegment(const Mode &md, int numCh, const std::vector<bool> &dt);
+	public: QrSegment(const Mode &md, int numCh, const BitBuffer &dt);
 	
 	
 	/* 
@@ -178,7 +264,15 @@ class QrSegment final {
 	 * The character count (numCh) must agree with the mode and the bit buffer length,
 	 * but the constraint isn't checked. The given bit buffer is moved and stored.
 	 */
-	public: QrSegment(const Mode &md, int numCh, std::vector<bool> &&dt);
+	public: QrSegment(const Mode &md, int numCh, BitBuffer &&dt);
+	
+	
+	/* 
+	 * Creates a new QR Code segment with the given attributes and data.
+	 * The character count (numCh) must agree with the mode and the bit list length,
+	 * but the constraint isn't checked. The given bits are copied into a BitBuffer.
+	 */
+	public: QrSegment(const Mode &md, int numCh, const std::vector<bool> &dt);
 	
 	
 	/*---- Methods ----*/
@@ -198,7 +292,7 @@ class QrSegment final {
 	/* 
 	 * Returns the data bits of this segment.
 	 */
-	public: const std::vector<bool> &getData() const;
+	public: const BitBuffer &getData() const;
 	
 	
 	// (Package-private) Calculates the number of bits needed to encode the given segments at
@@ -207,6 +301,32 @@ class QrSegment final {
 	public: static int getTotalBits(const std::vector<QrSegment> &segs, int version);
 	
 	
+	/*---- Private helper functions ----*/
+	
+	// Appends the numeric mode data bits of the given decimal digits to bb and returns the number of
+	// characters. Throws domain_error on any other character. Used by makeNumeric() and QrEncoder.
+	private: static int appendNumeric(const char *digits, BitBuffer &bb);
+	
+	
+	// Appends the alphanumeric mode data bits of the given text to bb and returns the number of
+	// characters. Throws domain_error on an unencodable character. Used by makeAlphanumeric() and QrEncoder.
+	private: static int appendAlphanumeric(const char *text, BitBuffer &bb);
+	
+	
+	// Sets byteModes[i] to the mode that byte i of the given text of len bytes is encoded in by
+	// makeSegmentsOptimally() at the given version: 0 = byte, 1 = alphanumeric, 2 = numeric.
+	// charModes is scratch space. Used by makeSegmentsOptimally() and QrEncoder.
+	private: static void computeOptimalModes(const char *text, std::size_t len, int version,
+		std::vector<std::array<signed char,3> > &charModes, std::vector<signed char> &byteModes);
+	
+	
+	// Reuses a segment's data buffer between codes.
+	friend class QrEncoder;
+	
+	// Maps alphanumeric mode values back to characters.
+	friend class QrReader;
+	
+	
 	/*---- Private constant ----*/
 	
 	/* The set of all legal characters in alphanumeric mode, where
@@ -217,6 +337,69 @@ class QrSegment final {
 
 
 
+/* 
+ * A square grid of bits, stored row by row in contiguous 64-bit words. Each row
+ * starts on a word boundary; bit x of a row lives in bit (x % 64) of word (x / 64),
+ * and the unused high bits of the last word in each row are always zero.
+ * Used by QrCode as the backing store for its module grids.
+ */
+class BitGrid final {
+	
+	/*---- Constructors ----*/
+	
+	// Creates an empty grid with a side length of 0.
+	public: BitGrid();
+	
+	
+	// Creates a grid with the given side length, with all bits initially zero.
+	public: explicit BitGrid(int sz);
+	
+	
+	/*---- Methods ----*/
+	
+	// Returns the side length of this grid.
+	public: int getSize() const;
+	
+	
+	// Returns the number of 64-bit words used to store each row.
+	public: int getWordsPerRow() const;
+	
+	
+	// Returns the bit at the given coordinates, which must be in bounds.
+	public: bool get(int x, int y) const;
+	
+	
+	// Sets the bit at the given coordinates, which must be in bounds.
+	public: void set(int x, int y, bool val);
+	
+	
+	// Returns a pointer to the words of the given row, which must be in bounds.
+	public: const std::uint64_t *row(int y) const;
+	
+	
+	// Returns a pointer to the words of the given row, which must be in bounds.
+	public: std::uint64_t *row(int y);
+	
+	
+	// Resizes this grid to the given side length and clears all bits to zero.
+	public: void reset(int sz);
+	
+	
+	/*---- Fields ----*/
+	
+	// The number of rows and columns.
+	private: int size;
+	
+	// The number of words per row, equal to ceil(size / 64).
+	private: int wordsPerRow;
+	
+	// All rows concatenated, with a length of size * wordsPerRow.
+	private: std::vector<std::uint64_t> words;
+	
+};
+
+
+
 /* 
  * A QR Code symbol, which is a type of two-dimension barcode.
  * Invented by Denso Wave and described in the ISO/IEC 18004 standard.
@@ -248,10 +431,6 @@ class QrCode final {
 	};
 	
 	
-	// Returns a value in the range 0 to 3 (unsigned 2-bit integer).
-	private: static int getFormatBits(Ecc ecl);
-	
-	
 	
 	/*---- Static factory functions (high level) ----*/
 	
@@ -265,6 +444,16 @@ class QrCode final {
 	public: static QrCode encodeText(const char *text, Ecc ecl);
 	
 	
+	/* 
+	 * Returns a QR Code representing the given Unicode text string at the given error correction level,
+	 * like encodeText(), but with the text split optimally into numeric, alphanumeric and byte mode
+	 * segments (see QrSegment::makeSegmentsOptimally()). For text that mixes digits, uppercase codes
+	 * and other characters, this often yields a smaller version than encodeText(). The scanned text
+	 * is the same either way.
+	 */
+	public: static QrCode encodeTextOptimal(const char *text, Ecc ecl);
+	
+	
 	/* 
 	 * Returns a QR Code representing the given binary data at the given error correction level.
 	 * This function always encodes using the binary segment mode, not any text mode. The maximum number of
@@ -291,6 +480,75 @@ class QrCode final {
 		int minVersion=1, int maxVersion=40, int mask=-1, bool boostEcl=true);  // All optional parameters
 	
 	
+	/*---- Static configuration ----*/
+	
+	/* 
+	 * Sets the lowest version number at which automatic mask selection scores the 8 candidate
+	 * masks concurrently on a shared pool of worker threads, instead of one after another.
+	 * A value above MAX_VERSION turns the parallel mode off. Parallel scoring is also skipped
+	 * when the machine has a single hardware thread or the pool is busy with another QR Code.
+	 * The chosen mask is the same in both modes. The default is DEFAULT_PARALLEL_MASK_MIN_VERSION;
+	 * the qr-benchmark program measures the crossover point on a given machine.
+	 */
+	public: static void setParallelMaskMinVersion(int ver);
+	
+	
+	/* 
+	 * Returns the lowest version number at which masks are scored in parallel.
+	 */
+	public: static int getParallelMaskMinVersion();
+	
+	
+	/* 
+	 * Draws a QR Code of the given version and error correction level from the given data codewords,
+	 * and scores all 8 masks on it twice: wordParallel[i] the way automatic mask selection does, on whole
+	 * 64-bit words, and scalar[i] by applying mask i and counting module by module. The two must be
+	 * equal; this is for tests and benchmarks. Throws domain_error if the version is out of range,
+	 * or invalid_argument if the number of data codewords does not match it.
+	 */
+	public: static void scoreMasks(int ver, Ecc ecl, const std::vector<std::uint8_t> &dataCodewords,
+		std::array<long,8> &wordParallel, std::array<long,8> &scalar);
+	
+	
+	/* 
+	 * The instruction sets that Reed-Solomon error correction can use. With SSSE3 or AVX2, the ECC
+	 * of 16 or 32 blocks is computed side by side in vector lanes (only for codes with 4 or more blocks).
+	 */
+	public: enum class SimdLevel { SCALAR, SSSE3, AVX2 };
+	
+	
+	/* 
+	 * Returns the best level that this build and CPU support. GCC and Clang builds for x86 detect it
+	 * at run time, up to SSSE3 on Windows, where GCC cannot align the stack for AVX2. Other builds, and
+	 * builds with QRCODEGEN_SCALAR_RS defined, only support SCALAR.
+	 */
+	public: static SimdLevel getMaxSimdLevel();
+	
+	
+	/* 
+	 * Sets the level used from now on, lowered to getMaxSimdLevel() if the CPU lacks it. The default
+	 * is getMaxSimdLevel(). The QR Codes are the same at every level; this is for tests and benchmarks.
+	 */
+	public: static void setSimdLevel(SimdLevel level);
+	
+	
+	/* 
+	 * Returns the level currently used for Reed-Solomon error correction.
+	 */
+	public: static SimdLevel getSimdLevel();
+	
+	
+	/* 
+	 * Computes the error correction codewords of the given data codewords for a QR Code of the given
+	 * version and error correction level, and writes all codewords, interleaved in the order they are
+	 * drawn, to allCodewords (resized to fit). This is the Reed-Solomon step of encoding on its own, at
+	 * the current SIMD level, for tests and benchmarks. Throws domain_error if the version is out of
+	 * range, or invalid_argument if the number of data codewords does not match it.
+	 */
+	public: static void computeEccAndInterleave(int ver, Ecc ecl,
+		const std::vector<std::uint8_t> &dataCodewords, std::vector<std::uint8_t> &allCodewords);
+	
+	
 	
 	/*---- Instance fields ----*/
 	
@@ -316,10 +574,12 @@ class QrCode final {
 	
 	// The modules of this QR Code (false = light, true = dark).
 	// Immutable after constructor finishes. Accessed through getModule().
-	private: std::vector<std::vector<bool> > modules;
+	private: BitGrid modules;
 	
-	// Indicates function modules that are not subjected to masking. Discarded when constructor finishes.
-	private: std::vector<std::vector<bool> > isFunction;
+	// The version's function modules (not subjected to masking) and data module order, shared by all
+	// QR Codes of that version and defined in the implementation file. Null when constructor finishes.
+	private: class FunctionTemplate;
+	private: const FunctionTemplate *functionTemplate;
 	
 	
 	
@@ -334,6 +594,24 @@ class QrCode final {
 	public: QrCode(int ver, Ecc ecl, const std::vector<std::uint8_t> &dataCodewords, int msk);
 	
 	
+	// Creates an empty placeholder that is not a valid QR Code, for QrEncoder to fill in.
+	private: QrCode();
+	
+	
+	// Does the work of the constructor above for the given version, error correction level, data
+	// codewords (getNumDataCodewords(ver, ecl) bytes) and mask, which must all be valid. allCodewords
+	// (getNumRawDataModules(ver) / 8 bytes) is used as scratch space. Reuses the capacity of this
+	// object's module grid, so this does not allocate if the grid was at least as large before.
+	private: void initialize(int ver, Ecc ecl, const std::uint8_t *dataCodewords, std::uint8_t *allCodewords, int msk);
+	
+	
+	// Encodes into a reused QrCode object through the private functions.
+	friend class QrEncoder;
+	
+	// Decodes with the same tables and data module layout that encoding uses.
+	friend class QrReader;
+	
+	
 	
 	/*---- Public instance methods ----*/
 	
@@ -369,36 +647,24 @@ class QrCode final {
 	public: bool getModule(int x, int y) const;
 	
 	
+	/* 
+	 * Returns the grid of all modules, where bit (x, y) is true for dark. Renderers can read
+	 * whole rows of 64 modules at a time through BitGrid::row() instead of calling getModule().
+	 */
+	public: const BitGrid &getModules() const;
 	
-	/*---- Private helper methods for constructor: Drawing function modules ----*/
 	
-	// Reads this object's version field, and draws and marks all function modules.
-	private: void drawFunctionPatterns();
 	
+	/*---- Private helper methods for constructor: Drawing function modules ----*/
 	
 	// Draws two copies of the format bits (with its own error correction code)
 	// based on the given mask and this object's error correction level field.
 	private: void drawFormatBits(int msk);
 	
 	
-	// Draws two copies of the version bits (with its own error correction code),
-	// based on this object's version field, iff 7 <= version <= 40.
-	private: void drawVersion();
-	
-	
-	// Draws a 9*9 finder pattern including the border separator,
-	// with the center module at (x, y). Modules can be out of bounds.
-	private: void drawFinderPattern(int x, int y);
-	
-	
-	// Draws a 5*5 alignment pattern, with the center module
-	// at (x, y). All modules must be in bounds.
-	private: void drawAlignmentPattern(int x, int y);
-	
-	
-	// Sets the color of a module and marks it as a function module.
-	// Only used by the constructor. Coordinates must be in bounds.
-	private: void setFunctionModule(int x, int y, bool isDark);
+	// Calls setter(x, y, isDark) for each module of both copies of the format bits (and
+	// the always-dark module) for the given mask and this object's error correction level.
+	private: template <typename Func> void forEachFormatModule(int msk, Func setter) const;
 	
 	
 	// Returns the color of the module at the given coordinates, which must be in range.
@@ -407,14 +673,15 @@ class QrCode final {
 	
 	/*---- Private helper methods for constructor: Codewords and masking ----*/
 	
-	// Returns a new byte string representing the given data with the appropriate error correction
-	// codewords appended to it, based on this object's version and error correction level.
-	private: std::vector<std::uint8_t> addEccAndInterleave(const std::vector<std::uint8_t> &data) const;
+	// Writes the given data codewords interleaved with the appropriate error correction codewords
+	// to result, based on the given version and error correction level. The data has
+	// getNumDataCodewords() bytes and the result getNumRawDataModules() / 8 bytes.
+	private: static void addEccAndInterleave(int ver, Ecc ecl, const std::uint8_t *data, std::uint8_t *result);
 	
 	
-	// Draws the given sequence of 8-bit codewords (data and error correction) onto the entire
-	// data area of this QR Code. Function modules need to be marked off before this is called.
-	private: void drawCodewords(const std::vector<std::uint8_t> &data);
+	// Draws the given sequence of getNumRawDataModules() / 8 codewords (data and error correction) onto
+	// the entire data area of this QR Code, along the data module path of the version's function template.
+	private: void drawCodewords(const std::uint8_t *data);
 	
 	
 	// XORs the codeword modules in this QR Code with the given mask pattern.
@@ -425,46 +692,126 @@ class QrCode final {
 	private: void applyMask(int msk);
 	
 	
+	// Sets penalties[i] to getMaskPenaltyScore(i) for all 8 masks, using the shared worker
+	// pool. Returns false without computing anything if the pool is not available.
+	private: bool scoreMasksInParallel(std::array<long,8> &penalties) const;
+	
+	
 	// Calculates and returns the penalty score based on state of this QR Code's current modules.
 	// This is used by the automatic mask choice algorithm to find the mask pattern that yields the lowest score.
 	private: long getPenaltyScore() const;
 	
 	
+	// Returns the penalty score that this QR Code would have after calling applyMask(msk) and
+	// drawFormatBits(msk), without modifying this object. The result is always equal to that of
+	// getPenaltyScore() in that state, but the mask is XORed and the modules are counted on whole
+	// words at a time, using a transposed copy of the grid for the column rules.
+	private: long getMaskPenaltyScore(int msk) const;
+	
+	
+	// Worker pool task that scores one mask. The context points to a MaskScoringJob.
+	private: static void scoreMaskTask(void *context, int msk);
+	
+	
+	// Returns the penalty points for runs of same-colored modules and finder-like patterns
+	// in the given line (row or column) of this QR Code, packed in the BitGrid row layout.
+	// A helper function for getMaskPenaltyScore().
+	private: long getLinePenaltyScore(const std::uint64_t *line) const;
+	
+	
 	
 	/*---- Private helper functions ----*/
 	
-	// Returns an ascending list of positions of alignment patterns for this version number.
-	// Each position is in the range [0,177), and are used on both the x and y axes.
-	// This could be implemented as lookup table of 40 variable-length lists of unsigned bytes.
-	private: std::vector<int> getAlignmentPatternPositions() const;
+	// Returns the number of alignment pattern positions on each axis for the given version number,
+	// in the range [0, 7]. Like the functions below, this reads a table computed at compile time.
+	private: static int getNumAlignmentPatterns(int ver);
+	
+	
+	// Returns an ascending list of positions of alignment patterns for the given version number,
+	// with getNumAlignmentPatterns(ver) entries. Each position is in the range [0,177), and are
+	// used on both the x and y axes.
+	private: static const std::uint8_t *getAlignmentPatternPositions(int ver);
 	
 	
 	// Returns the number of data bits that can be stored in a QR Code of the given version number, after
 	// all function modules are excluded. This includes remainder bits, so it might not be a multiple of 8.
-	// The result is in the range [208, 29648]. This could be implemented as a 40-entry lookup table.
+	// The result is in the range [208, 29648].
 	private: static int getNumRawDataModules(int ver);
 	
 	
 	// Returns the number of 8-bit data (i.e. not error correction) codewords contained in any
 	// QR Code of the given version number and error correction level, with remainder bits discarded.
-	// This stateless pure function could be implemented as a (40*4)-cell lookup table.
 	private: static int getNumDataCodewords(int ver, Ecc ecl);
 	
 	
-	// Returns a Reed-Solomon ECC generator polynomial for the given degree. This could be
-	// implemented as a lookup table over all possible parameter values, instead of as an algorithm.
-	private: static std::vector<std::uint8_t> reedSolomonComputeDivisor(int degree);
+	// Returns the number of error correction blocks, and the number of ECC codewords in each
+	// block, for the given version number and error correction level. Used by QrReader.
+	private: static int getNumErrorCorrectionBlocks(int ver, Ecc ecl);
+	private: static int getEccCodewordsPerBlock(int ver, Ecc ecl);
+	
+	
+	// Returns the masked 15-bit format information for the given error correction level and mask,
+	// and the 18-bit version information for the given version number (0 below version 7).
+	// QrReader matches the bits it reads against these.
+	private: static int getFormatInformation(Ecc ecl, int msk);
+	private: static long getVersionInformation(int ver);
+	
+	
+	// Returns the coordinates (y << 8 | x) of the data modules of the given version in the order that
+	// drawCodewords() fills them, getNumRawDataModules(ver) entries. QrReader reads them back in this order.
+	private: static const std::uint16_t *getDataModulePath(int ver);
+	
+	
+	// Returns the smallest version number in [minVersion, maxVersion] that can hold the given segments,
+	// and sets dataUsedBits to their length at that version. Iff boostEcl is true, raises ecl as far as
+	// the data still fits that version. Throws data_too_long if no version in the range is large enough.
+	private: static int selectVersion(const std::vector<QrSegment> &segs, Ecc &ecl,
+		int minVersion, int maxVersion, bool boostEcl, int &dataUsedBits);
+	
+	
+	// Appends the mode indicators, character counts and data of the given segments to bb, then the
+	// terminator and padding up to the data capacity of the given version and error correction level.
+	// The segments must fit, and bb must be empty or the padding will be wrong.
+	private: static void appendDataCodewords(const std::vector<QrSegment> &segs, int version, Ecc ecl, BitBuffer &bb);
+	
 	
+	// Returns the smallest version number in [minVersion, maxVersion] that can hold the given number
+	// of data bits at the given error correction level, or maxVersion + 1 if none can. This is a
+	// binary search over the capacity table, so O(log 40) instead of a scan over the versions.
+	private: static int getMinVersionForCapacity(int dataBits, Ecc ecl, int minVersion, int maxVersion);
 	
-	// Returns the Reed-Solomon error correction codeword for the given data and divisor polynomials.
-	private: static std::vector<std::uint8_t> reedSolomonComputeRemainder(const std::vector<std::uint8_t> &data, const std::vector<std::uint8_t> &divisor);
+	
+	// Returns the Reed-Solomon ECC generator polynomial for the given degree, in the range
+	// [1, MAX_ECC_CODEWORDS_PER_BLOCK], as the discrete logarithms of its coefficients from highest
+	// to lowest power, excluding the leading term which is always 1. The polynomials for every
+	// degree are computed at compile time, so this is a table lookup.
+	private: static const std::uint8_t *reedSolomonGetDivisor(int degree);
+	
+	
+	// Computes the ECC of all blocks, with SIMD lanes if enabled. data holds the blocks concatenated
+	// and codewords their data interleaved, as written by addEccAndInterleave(), which is where
+	// the SIMD path reads them. Writes the ECC bytes to their interleaved positions in codewords.
+	private: static void reedSolomonComputeInterleaved(const std::uint8_t *data, std::uint8_t *codewords,
+		int numBlocks, int numShortBlocks, int shortDataLen, int degree);
+	
+	
+	// Computes the Reed-Solomon error correction codeword for the given data bytes and the generator
+	// polynomial of the given degree, and writes its degree bytes to result. Does not allocate memory.
+	private: static void reedSolomonComputeRemainder(const std::uint8_t *data, std::size_t dataLen, int degree, std::uint8_t *result);
 	
 	
 	// Returns the product of the two given field elements modulo GF(2^8/0x11D).
-	// All inputs are valid. This could be implemented as a 256*256 lookup table.
+	// All inputs are valid. Uses log/antilog tables computed at compile time.
 	private: static std::uint8_t reedSolomonMultiply(std::uint8_t x, std::uint8_t y);
 	
 	
+	// Returns r^e for the generator element r = 0x02 and an exponent e in the range [0, 510),
+	// and the discrete logarithm of the given nonzero field element, in the range [0, 255).
+	// Table lookups for the Reed-Solomon decoder in QrReader.
+	private: static std::uint8_t reedSolomonExp(int e);
+	private: static int reedSolomonLog(std::uint8_t x);
+	
+	
 	// Can only be called immediately after a light run is added, and
 	// returns either 0, 1, or 2. A helper function for getPenaltyScore().
 	private: int finderPenaltyCountPatterns(const std::array<int,7> &runHistory) const;
@@ -482,6 +829,33 @@ class QrCode final {
 	private: static bool getBit(long x, int i);
 	
 	
+	// Returns the number of bits set to 1 in x.
+	private: static int popCount(std::uint64_t x);
+	
+	
+	// Returns the index of the lowest bit set to 1 in x, which must be non-zero.
+	private: static int countTrailingZeros(std::uint64_t x);
+	
+	
+	// Returns word number wordIndex of a multi-word bit string whose lowest numBits bits are 1 and the rest are 0.
+	private: static std::uint64_t getWordMask(int wordIndex, int numBits);
+	
+	
+	// Sets dest to the multi-word bit string src shifted towards bit 0 by the given
+	// number of bits (in the range [1, 63]), filling in zeros at the high end.
+	private: static void shiftWordsDown(const std::uint64_t *src, int shift, std::uint64_t *dest, int numWords);
+	
+	
+	// Transposes the given 64*64 bit matrix in place, so that
+	// bit j of word i becomes bit i of word j.
+	private: static void transposeBitBlock(std::uint64_t block[64]);
+	
+	
+	// Returns the words of the given mask pattern (1 = invert) for row y, covering
+	// columns 0 to MAX_ROW_WORDS * 64 - 1. The pattern repeats every 12 rows.
+	private: static const std::uint64_t *getMaskRow(int msk, int y);
+	
+	
 	/*---- Constants and tables ----*/
 	
 	// The minimum version number supported in the QR Code Model 2 standard.
@@ -490,6 +864,18 @@ class QrCode final {
 	// The maximum version number supported in the QR Code Model 2 standard.
 	public: static constexpr int MAX_VERSION = 40;
 	
+	// The default value of the parallel mask scoring threshold; see setParallelMaskMinVersion().
+	public: static constexpr int DEFAULT_PARALLEL_MASK_MIN_VERSION = 20;
+	
+	// The current parallel mask scoring threshold.
+	private: static std::atomic<int> parallelMaskMinVersion;
+	
+	// The current Reed-Solomon SIMD level as an int, or -1 until first use.
+	private: static std::atomic<int> simdLevel;
+	
+	// The number of 64-bit words in a BitGrid row of the largest QR Code (size 177).
+	private: static constexpr int MAX_ROW_WORDS = 3;
+	
 	
 	// For use in getPenaltyScore(), when evaluating which mask is best.
 	private: static const int PENALTY_N1;
@@ -498,8 +884,86 @@ class QrCode final {
 	private: static const int PENALTY_N4;
 	
 	
-	private: static const std::int8_t ECC_CODEWORDS_PER_BLOCK[4][41];
-	private: static const std::int8_t NUM_ERROR_CORRECTION_BLOCKS[4][41];
+	// The largest value in the table of ECC codewords per block. That table, the number of
+	// error correction blocks and the tables derived from them live in the implementation file.
+	private: static constexpr int MAX_ECC_CODEWORDS_PER_BLOCK = 30;
+	
+};
+
+
+
+/* 
+ * Encodes QR Codes into scratch space that is reused from one call to the next, for callers
+ * that create many codes, such as a ticket issuing service. The constructor reserves room for
+ * the largest code (version 40), so in steady state encoding performs no heap allocations;
+ * only inputs that grow a segment buffer past its previous size allocate. The results are
+ * equal to those of the corresponding QrCode factory functions. An instance is not thread-safe,
+ * so use one encoder per thread.
+ */
+class QrEncoder final {
+	
+	/*---- Constructor ----*/
+	
+	public: QrEncoder();
+	
+	
+	/*---- Methods ----*/
+	
+	/* 
+	 * Same as QrCode::encodeText(). The returned QR Code is owned by this encoder and
+	 * stays valid until the next call; copy it to keep it longer.
+	 */
+	public: const QrCode &encodeText(const char *text, QrCode::Ecc ecl);
+	
+	
+	/* 
+	 * Same as QrCode::encodeTextOptimal(). The segments are built in buffers that are kept for the
+	 * next call, so only a text that needs more or longer segments than before allocates. The returned
+	 * QR Code is owned by this encoder and stays valid until the next call.
+	 */
+	public: const QrCode &encodeTextOptimal(const char *text, QrCode::Ecc ecl);
+	
+	
+	/* 
+	 * Same as QrCode::encodeBinary() for the given len bytes. The returned
+	 * QR Code is owned by this encoder and stays valid until the next call.
+	 */
+	public: const QrCode &encodeBinary(const std::uint8_t *data, std::size_t len, QrCode::Ecc ecl);
+	
+	
+	/* 
+	 * Same as QrCode::encodeSegments(). The segments are the caller's, so creating them may allocate.
+	 * The returned QR Code is owned by this encoder and stays valid until the next call.
+	 */
+	public: const QrCode &encodeSegments(const std::vector<QrSegment> &segs, QrCode::Ecc ecl,
+		int minVersion=1, int maxVersion=40, int mask=-1, bool boostEcl=true);  // All optional parameters
+	
+	
+	/*---- Private fields ----*/
+	
+	// Always empty; stands for the segment list of empty text.
+	private: std::vector<QrSegment> noSegments;
+	
+	// Holds the single segment of encodeText() and encodeBinary(), whose buffer is refilled each time.
+	private: std::vector<QrSegment> oneSegment;
+	
+	// For encodeTextOptimal(): the segments, segments not needed by the current text (kept for their
+	// buffers), the mode of each byte with its scratch space, and one numeric or alphanumeric run.
+	private: std::vector<QrSegment> optimalSegments;
+	private: std::vector<QrSegment> spareSegments;
+	private: std::vector<std::array<signed char,3> > charModes;
+	private: std::vector<signed char> byteModes;
+	private: std::string run;
+	
+	// The data bit string, reserved for the largest data capacity.
+	private: BitBuffer dataBits;
+	
+	// The padded data codewords and the interleaved data and ECC codewords, sized for version 40.
+	private: std::vector<std::uint8_t> dataCodewords;
+	private: std::vector<std::uint8_t> allCodewords;
+	
+	// The result of the last call, whose module grid is reserved for version 40.
+	private: QrCode qrCode;
 	
 };
 
@@ -524,26 +988,4 @@ class data_too_long : public std::length_error {
 	
 };
 
-
-
-/* 
- * An appendable sequence of bits (0s and 1s). Mainly used by QrSegment.
- */
-class BitBuffer final : public std::vector<bool> {
-	
-	/*---- Constructor ----*/
-	
-	// Creates an empty bit buffer (length 0).
-	public: BitBuffer();
-	
-	
-	
-	/*---- Method ----*/
-	
-	// Appends the given number of low-order bits of the given value
-	// to this buffer. Requires 0 <= len <= 31 and val < 2^len.
-	public: void appendBits(std::uint32_t val, int len);
-	
-};
-
 }
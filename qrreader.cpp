@@ -0,0 +1,1386 @@
+/* 
+ * QR Code reader (C++)
+ * 
+ * Finds and decodes QR Code symbols in grayscale or color camera frames, in process. This is the
+ * inverse of the qrcodegen library, and reuses its version tables, Galois field and data module layout.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "qrreader.hpp"
+
+// The vectorized binarization needs GCC or Clang (for target attributes) on x86, like the Reed-Solomon
+// code of qrcodegen, and follows its run-time level (QrCode::getSimdLevel())
+#if !defined(QRCODEGEN_SCALAR_BINARIZE) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define QRCODEGEN_SIMD_BINARIZE
+	#include <immintrin.h>
+#endif
+
+using std::uint8_t;
+using std::size_t;
+
+
+namespace qrcodegen {
+
+/*---- Perspective transform ----*/
+
+/* 
+ * A projective mapping of the plane, as the 3x3 matrix that acts on column vectors (x, y, 1).
+ */
+struct PerspectiveTransform final {
+	double m[3][3];
+};
+
+
+// Returns the transform that maps (0,0), (1,0), (1,1), (0,1) to the four given points in order.
+static PerspectiveTransform squareToQuadrilateral(const float p[4][2]) {
+	double dx3 = p[0][0] - p[1][0] + p[2][0] - p[3][0];
+	double dy3 = p[0][1] - p[1][1] + p[2][1] - p[3][1];
+	double dx1 = p[1][0] - p[2][0], dx2 = p[3][0] - p[2][0];
+	double dy1 = p[1][1] - p[2][1], dy2 = p[3][1] - p[2][1];
+	double denom = dx1 * dy2 - dx2 * dy1;
+	double g = denom != 0 ? (dx3 * dy2 - dx2 * dy3) / denom : 0;
+	double h = denom != 0 ? (dx1 * dy3 - dx3 * dy1) / denom : 0;
+	return PerspectiveTransform{{
+		{p[1][0] - p[0][0] + g * p[1][0], p[3][0] - p[0][0] + h * p[3][0], p[0][0]},
+		{p[1][1] - p[0][1] + g * p[1][1], p[3][1] - p[0][1] + h * p[3][1], p[0][1]},
+		{g, h, 1},
+	}};
+}
+
+
+// Returns the adjugate, which is the inverse up to a scale factor that does not matter here.
+static PerspectiveTransform adjugate(const PerspectiveTransform &t) {
+	const double (*a)[3] = t.m;
+	return PerspectiveTransform{{
+		{a[1][1] * a[2][2] - a[1][2] * a[2][1], a[0][2] * a[2][1] - a[0][1] * a[2][2], a[0][1] * a[1][2] - a[0][2] * a[1][1]},
+		{a[1][2] * a[2][0] - a[1][0] * a[2][2], a[0][0] * a[2][2] - a[0][2] * a[2][0], a[0][2] * a[1][0] - a[0][0] * a[1][2]},
+		{a[1][0] * a[2][1] - a[1][1] * a[2][0], a[0][1] * a[2][0] - a[0][0] * a[2][1], a[0][0] * a[1][1] - a[0][1] * a[1][0]},
+	}};
+}
+
+
+// Returns the transform that applies b first and then a.
+static PerspectiveTransform compose(const PerspectiveTransform &a, const PerspectiveTransform &b) {
+	PerspectiveTransform result{};
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			for (int k = 0; k < 3; k++)
+				result.m[i][j] += a.m[i][k] * b.m[k][j];
+		}
+	}
+	return result;
+}
+
+
+// Returns the transform that maps the four module space points to the four image points, in the same order.
+static PerspectiveTransform quadrilateralToQuadrilateral(const float from[4][2], const float to[4][2]) {
+	return compose(squareToQuadrilateral(to), adjugate(squareToQuadrilateral(from)));
+}
+
+
+// Maps the given point, and returns false if it lands at infinity or behind the viewer.
+static bool transformPoint(const PerspectiveTransform &t, double x, double y, float &outX, float &outY) {
+	double w = t.m[2][0] * x + t.m[2][1] * y + t.m[2][2];
+	if (w <= 0)
+		return false;
+	outX = static_cast<float>((t.m[0][0] * x + t.m[0][1] * y + t.m[0][2]) / w);
+	outY = static_cast<float>((t.m[1][0] * x + t.m[1][1] * y + t.m[1][2]) / w);
+	return true;
+}
+
+
+/*---- Finder pattern runs ----*/
+
+// Returns true iff the five run lengths are close enough to the ratio 1:1:3:1:1.
+static bool foundPatternCross(const int stateCount[5]) {
+	int total = 0;
+	for (int i = 0; i < 5; i++) {
+		if (stateCount[i] == 0)
+			return false;
+		total += stateCount[i];
+	}
+	if (total < 7)
+		return false;
+	float moduleSize = total / 7.0f;
+	float maxVariance = moduleSize / 2;
+	return std::abs(moduleSize - stateCount[0]) < maxVariance
+		&& std::abs(moduleSize - stateCount[1]) < maxVariance
+		&& std::abs(3 * moduleSize - stateCount[2]) < 3 * maxVariance
+		&& std::abs(moduleSize - stateCount[3]) < maxVariance
+		&& std::abs(moduleSize - stateCount[4]) < maxVariance;
+}
+
+
+// Returns the center of the middle run, given the coordinate just past the end of the last run.
+static float centerFromEnd(const int stateCount[5], int end) {
+	return static_cast<float>(end - stateCount[4] - stateCount[3]) - stateCount[2] / 2.0f;
+}
+
+
+static float distance(float x0, float y0, float x1, float y1) {
+	return std::hypot(x1 - x0, y1 - y0);
+}
+
+
+
+/*---- Class QrReader ----*/
+
+QrReader::QrReader() :
+	width(0),
+	height(0),
+	trackLeft(0),
+	trackTop(0),
+	trackRight(0),
+	trackBottom(0),
+	trackFrameWidth(0),
+	trackFrameHeight(0),
+	trackModuleSize(0),
+	trackingMisses(0),
+	maxTrackingMisses(5) {}
+
+
+int QrReader::bytesPerPixel(PixelFormat format) {
+	switch (format) {
+		case PixelFormat::GRAY8 :  return 1;
+		case PixelFormat::BGR24 :  return 3;
+		case PixelFormat::BGRA32:  return 4;
+		default:  throw std::invalid_argument("Invalid pixel format");
+	}
+}
+
+
+bool QrReader::decode(const uint8_t *pixels, int width, int height, int stride, Result &result) {
+	return decode(pixels, width, height, stride, PixelFormat::GRAY8, result);
+}
+
+
+bool QrReader::decode(const uint8_t *pixels, int width, int height, int stride,
+		PixelFormat format, Result &result) {
+	if (pixels == nullptr || width <= 0 || height <= 0 || stride / bytesPerPixel(format) < width)
+		throw std::invalid_argument("Invalid image dimensions");
+	this->width = width;
+	this->height = height;
+	FinderCandidate corners[3];
+	bool foundFinders;
+	// Every row up to 360 lines, then every second or third row, so that the 3 module center of a
+	// small or noisy pattern is still crossed by several rows, which confirms it
+	return decodeImage(pixels, stride, format, std::max(1, height / 360), result, corners, foundFinders);
+}
+
+
+bool QrReader::decodeTracked(const uint8_t *pixels, int width, int height, int stride, Result &result) {
+	return decodeTracked(pixels, width, height, stride, PixelFormat::GRAY8, result);
+}
+
+
+bool QrReader::decodeTracked(const uint8_t *pixels, int width, int height, int stride,
+		PixelFormat format, Result &result) {
+	int pixelBytes = bytesPerPixel(format);
+	if (pixels == nullptr || width <= 0 || height <= 0 || stride / pixelBytes < width)
+		throw std::invalid_argument("Invalid image dimensions");
+	if (width != trackFrameWidth || height != trackFrameHeight) {
+		resetTracking();
+		trackFrameWidth = width;
+		trackFrameHeight = height;
+	}
+	bool windowed = isTracking();
+	int left = windowed ? trackLeft : 0;
+	int top = windowed ? trackTop : 0;
+	this->width = windowed ? trackRight - trackLeft : width;
+	this->height = windowed ? trackBottom - trackTop : height;
+	
+	// In the window the module size is known, so rows half a module apart still cross the
+	// 3 module center of each finder pattern several times
+	int skip = windowed ? std::max(1, static_cast<int>(trackModuleSize / 2)) : std::max(1, height / 360);
+	FinderCandidate corners[3];
+	bool foundFinders;
+	const uint8_t *origin = pixels + static_cast<size_t>(top) * static_cast<size_t>(stride)
+		+ static_cast<size_t>(left) * static_cast<size_t>(pixelBytes);
+	bool decoded = decodeImage(origin, stride, format, skip, result, corners, foundFinders);
+	if (foundFinders) {
+		for (int i = 0; i < 3; i++) {
+			corners[i].x += left;
+			corners[i].y += top;
+			if (decoded) {
+				result.finderCenters[i][0] += left;
+				result.finderCenters[i][1] += top;
+			}
+		}
+		setTrackingWindow(corners, width, height);
+	}
+	if (decoded)
+		trackingMisses = 0;
+	else if (isTracking() && ++trackingMisses >= maxTrackingMisses)
+		resetTracking();
+	return decoded;
+}
+
+
+int QrReader::decodeAll(const uint8_t *pixels, int width, int height, int stride, std::vector<Result> &results) {
+	return decodeAll(pixels, width, height, stride, PixelFormat::GRAY8, results);
+}
+
+
+int QrReader::decodeAll(const uint8_t *pixels, int width, int height, int stride,
+		PixelFormat format, std::vector<Result> &results) {
+	if (pixels == nullptr || width <= 0 || height <= 0 || stride / bytesPerPixel(format) < width)
+		throw std::invalid_argument("Invalid image dimensions");
+	this->width = width;
+	this->height = height;
+	results.clear();
+	binarize(pixels, stride, format);
+	findFinderPatterns(std::max(1, height / 360));
+	rejectedTriples.clear();
+	
+	// A failed decode costs a few samplings of the grid and alignment searches, so give up after a
+	// handful; a failed timing check is cheap, but the number of triples grows with the cube
+	const int maxFailures = 8, maxRejections = 64;
+	FinderCandidate corners[3];
+	int chosen[3];
+	Result result;
+	int failures = 0;
+	while (failures < maxFailures && static_cast<int>(rejectedTriples.size()) < maxRejections
+			&& selectFinderPatterns(corners, chosen)) {
+		const FinderCandidate &topLeft = corners[0], &topRight = corners[1], &bottomLeft = corners[2];
+		if (!hasTimingPattern(topLeft, topRight, bottomLeft) || !hasTimingPattern(topLeft, bottomLeft, topRight)) {
+			rejectedTriples.push_back(tripleKey(chosen));
+			continue;
+		}
+		if (!decodeSymbol(corners, result)) {
+			rejectedTriples.push_back(tripleKey(chosen));
+			failures++;
+			continue;
+		}
+		results.push_back(result);
+		
+		// Symbols do not overlap, so the other candidates inside this one are lookalikes in its data.
+		// In the coordinates along its edges the finder centers are 0 and 1, and the symbol reaches
+		// 3.5 modules beyond them.
+		float ax = topRight.x - topLeft.x, ay = topRight.y - topLeft.y;
+		float bx = bottomLeft.x - topLeft.x, by = bottomLeft.y - topLeft.y;
+		float det = ax * by - ay * bx;
+		float moduleSize = (topLeft.moduleSize + topRight.moduleSize + bottomLeft.moduleSize) / 3;
+		float marginU = 3.5f * moduleSize / std::sqrt(ax * ax + ay * ay);
+		float marginV = 3.5f * moduleSize / std::sqrt(bx * bx + by * by);
+		for (FinderCandidate &c : candidates) {
+			float dx = c.x - topLeft.x, dy = c.y - topLeft.y;
+			float u = (dx * by - dy * bx) / det, v = (ax * dy - ay * dx) / det;
+			if (u >= -marginU && u <= 1 + marginU && v >= -marginV && v <= 1 + marginV)
+				c.count = 0;
+		}
+	}
+	return static_cast<int>(results.size());
+}
+
+
+void QrReader::resetTracking() {
+	trackLeft = trackTop = trackRight = trackBottom = 0;
+	trackingMisses = 0;
+}
+
+
+bool QrReader::isTracking() const {
+	return trackRight > trackLeft && trackBottom > trackTop;
+}
+
+
+int QrReader::getMaxTrackingMisses() const {
+	return maxTrackingMisses;
+}
+
+
+void QrReader::setMaxTrackingMisses(int misses) {
+	if (misses < 1)
+		throw std::domain_error("Tracking misses out of range");
+	maxTrackingMisses = misses;
+}
+
+
+void QrReader::setTrackingWindow(const FinderCandidate corners[3], int frameWidth, int frameHeight) {
+	// The fourth corner of the parallelogram, then the bounding box of all four finder centers
+	float xs[4] = {corners[0].x, corners[1].x, corners[2].x, corners[1].x + corners[2].x - corners[0].x};
+	float ys[4] = {corners[0].y, corners[1].y, corners[2].y, corners[1].y + corners[2].y - corners[0].y};
+	float minX = *std::min_element(xs, xs + 4), maxX = *std::max_element(xs, xs + 4);
+	float minY = *std::min_element(ys, ys + 4), maxY = *std::max_element(ys, ys + 4);
+	
+	// The centers are 3.5 modules inside the symbol, which needs 4 more of quiet zone; beyond
+	// that, leave room for the symbol to move by an eighth of its size between frames
+	float moduleSize = (corners[0].moduleSize + corners[1].moduleSize + corners[2].moduleSize) / 3;
+	trackModuleSize = moduleSize;
+	float pad = 8 * moduleSize + std::max(maxX - minX, maxY - minY) / 8;
+	trackLeft = std::max(static_cast<int>(minX - pad), 0);
+	trackTop = std::max(static_cast<int>(minY - pad), 0);
+	trackRight = std::min(static_cast<int>(maxX + pad) + 1, frameWidth);
+	trackBottom = std::min(static_cast<int>(maxY + pad) + 1, frameHeight);
+	if (!isTracking())
+		resetTracking();
+}
+
+
+bool QrReader::decodeImage(const uint8_t *pixels, int stride, PixelFormat format, int rowSkip,
+		Result &result, FinderCandidate corners[3], bool &foundFinders) {
+	binarize(pixels, stride, format);
+	findFinderPatterns(rowSkip);
+	rejectedTriples.clear();
+	int chosen[3];
+	foundFinders = selectFinderPatterns(corners, chosen);
+	return foundFinders && decodeSymbol(corners, result);
+}
+
+
+bool QrReader::decodeSymbol(const FinderCandidate corners[3], Result &result) {
+	const FinderCandidate &topLeft = corners[0], &topRight = corners[1], &bottomLeft = corners[2];
+	
+	// Measure the module size along both edges of the symbol, which is not thrown off by rotation
+	// like the horizontal runs are, and estimate the version from the distances between the centers
+	float moduleSizeX = (sizeOfBlackWhiteBlackRunBoth(topLeft.x, topLeft.y, topRight.x, topRight.y)
+		+ sizeOfBlackWhiteBlackRunBoth(topRight.x, topRight.y, topLeft.x, topLeft.y)) / 14;
+	float moduleSizeY = (sizeOfBlackWhiteBlackRunBoth(topLeft.x, topLeft.y, bottomLeft.x, bottomLeft.y)
+		+ sizeOfBlackWhiteBlackRunBoth(bottomLeft.x, bottomLeft.y, topLeft.x, topLeft.y)) / 14;
+	if (!(moduleSizeX >= 1) || !(moduleSizeY >= 1))  // Also catches NaN
+		moduleSizeX = moduleSizeY = (topLeft.moduleSize + topRight.moduleSize + bottomLeft.moduleSize) / 3;
+	float modulesBetween = (distance(topLeft.x, topLeft.y, topRight.x, topRight.y) / moduleSizeX
+		+ distance(topLeft.x, topLeft.y, bottomLeft.x, bottomLeft.y) / moduleSizeY) / 2;
+	int estimatedVersion = static_cast<int>(std::lround((modulesBetween + 7 - 17) / 4));
+	float moduleSize = (moduleSizeX + moduleSizeY) / 2;
+	
+	// The estimate can be one version off for small or tilted symbols, and decoding a wrong size fails
+	// quickly at the format information or the Reed-Solomon check, so the neighbors are tried too
+	for (int delta : {0, 1, -1}) {
+		int ver = estimatedVersion + delta;
+		if (ver < QrCode::MIN_VERSION || ver > QrCode::MAX_VERSION)
+			continue;
+		int size = ver * 4 + 17;
+		float far = size - 3.5f;
+		float modulePoints[4][2] = {{3.5f, 3.5f}, {far, 3.5f}, {far, far}, {3.5f, far}};
+		float imagePoints[4][2] = {
+			{topLeft.x, topLeft.y},
+			{topRight.x, topRight.y},
+			{topRight.x + bottomLeft.x - topLeft.x, topRight.y + bottomLeft.y - topLeft.y},
+			{bottomLeft.x, bottomLeft.y},
+		};
+		
+		// From version 2, the bottom right alignment pattern pins down the perspective
+		bool decoded = false;
+		if (ver >= 2) {
+			PerspectiveTransform affine = quadrilateralToQuadrilateral(modulePoints, imagePoints);
+			float alignCenter = size - 6.5f;
+			float px, py, rx, ry, dx, dy, foundX, foundY;
+			if (transformPoint(affine, alignCenter, alignCenter, px, py)
+					&& transformPoint(affine, alignCenter + 1, alignCenter, rx, ry)
+					&& transformPoint(affine, alignCenter, alignCenter + 1, dx, dy)) {
+				float right[2] = {rx - px, ry - py};
+				float down[2] = {dx - px, dy - py};
+				if (findAlignmentPattern(px, py, right, down, moduleSize, foundX, foundY)) {
+					float alignedModulePoints[4][2] = {{3.5f, 3.5f}, {far, 3.5f}, {alignCenter, alignCenter}, {3.5f, far}};
+					float alignedImagePoints[4][2] = {
+						{topLeft.x, topLeft.y},
+						{topRight.x, topRight.y},
+						{foundX, foundY},
+						{bottomLeft.x, bottomLeft.y},
+					};
+					decoded = sampleGrid(size, alignedModulePoints, alignedImagePoints) && decodeModules(grid, result);
+				}
+			}
+		}
+		if (!decoded)
+			decoded = sampleGrid(size, modulePoints, imagePoints) && decodeModules(grid, result);
+		
+		// Version 1 has no alignment pattern, so under perspective the parallelogram corner can be
+		// a module or two off. Try the nearby corners; sampling 441 modules is cheap.
+		if (!decoded && ver == 1) {
+			float cornerX = imagePoints[2][0], cornerY = imagePoints[2][1];
+			float rightX = (topRight.x - topLeft.x) / (size - 7), rightY = (topRight.y - topLeft.y) / (size - 7);
+			float downX = (bottomLeft.x - topLeft.x) / (size - 7), downY = (bottomLeft.y - topLeft.y) / (size - 7);
+			for (int dy = -2; dy <= 2 && !decoded; dy++) {
+				for (int dx = -2; dx <= 2 && !decoded; dx++) {
+					if (dx == 0 && dy == 0)
+						continue;
+					imagePoints[2][0] = cornerX + dx * rightX + dy * downX;
+					imagePoints[2][1] = cornerY + dx * rightY + dy * downY;
+					decoded = sampleGrid(size, modulePoints, imagePoints) && decodeModules(grid, result);
+				}
+			}
+		}
+		if (decoded) {
+			for (int i = 0; i < 3; i++) {
+				result.finderCenters[i][0] = corners[i].x;
+				result.finderCenters[i][1] = corners[i].y;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+
+bool QrReader::decodeModules(const BitGrid &modules, Result &result) {
+	int size = modules.getSize();
+	if (size < 21 || size > 177 || (size - 17) % 4 != 0)
+		return false;
+	int ver = (size - 17) / 4;
+	int format = readFormatInformation(modules);
+	if (format == -1)
+		return false;
+	if (ver >= 7 && readVersionInformation(modules) != ver)
+		return false;
+	QrCode::Ecc ecl = static_cast<QrCode::Ecc>(format >> 3);
+	int msk = format & 7;
+	
+	// Read the codewords along the same path that QrCode::drawCodewords() fills, undoing the mask
+	int rawCodewords = QrCode::getNumRawDataModules(ver) / 8;
+	codewords.resize(static_cast<size_t>(rawCodewords));
+	const std::uint16_t *path = QrCode::getDataModulePath(ver);
+	for (int k = 0; k < rawCodewords; k++) {
+		int b = 0;
+		for (int i = 0; i < 8; i++, path++) {
+			int x = *path & 0xFF, y = *path >> 8;
+			const std::uint64_t *maskRow = QrCode::getMaskRow(msk, y);
+			bool masked = ((maskRow[x >> 6] >> (x & 63)) & 1) != 0;
+			b = b << 1 | static_cast<int>(modules.get(x, y) != masked);
+		}
+		codewords[static_cast<size_t>(k)] = static_cast<uint8_t>(b);
+	}
+	
+	// Undo QrCode::addEccAndInterleave() one block at a time, and correct each block
+	int numBlocks = QrCode::getNumErrorCorrectionBlocks(ver, ecl);
+	int blockEccLen = QrCode::getEccCodewordsPerBlock(ver, ecl);
+	int numShortBlocks = numBlocks - rawCodewords % numBlocks;
+	int shortDataLen = rawCodewords / numBlocks - blockEccLen;
+	size_t eccStart = static_cast<size_t>(shortDataLen * numBlocks + (numBlocks - numShortBlocks));
+	dataCodewords.resize(static_cast<size_t>(QrCode::getNumDataCodewords(ver, ecl)));
+	block.resize(static_cast<size_t>(shortDataLen + 1 + blockEccLen));
+	int corrected = 0;
+	for (int i = 0, k = 0; i < numBlocks; i++) {
+		int datLen = shortDataLen + (i < numShortBlocks ? 0 : 1);
+		for (int j = 0; j < shortDataLen; j++)
+			block[static_cast<size_t>(j)] = codewords[static_cast<size_t>(j * numBlocks + i)];
+		if (i >= numShortBlocks)
+			block[static_cast<size_t>(shortDataLen)] = codewords[static_cast<size_t>(shortDataLen * numBlocks + (i - numShortBlocks))];
+		for (int j = 0; j < blockEccLen; j++)
+			block[static_cast<size_t>(datLen + j)] = codewords[eccStart + static_cast<size_t>(j * numBlocks + i)];
+		int errors = correctBlock(block.data(), datLen + blockEccLen, blockEccLen);
+		if (errors == -1)
+			return false;
+		corrected += errors;
+		std::memcpy(&dataCodewords[static_cast<size_t>(k)], block.data(), static_cast<size_t>(datLen));
+		k += datLen;
+	}
+	
+	if (!parseSegments(dataCodewords.data(), static_cast<int>(dataCodewords.size()), ver, result.text))
+		return false;
+	result.version = ver;
+	result.errorCorrectionLevel = ecl;
+	result.mask = msk;
+	result.correctedErrors = corrected;
+	std::memset(result.finderCenters, 0, sizeof(result.finderCenters));
+	return true;
+}
+
+
+/*---- Binarization kernels ----*/
+
+// Gray = (1868 B + 9617 G + 4899 R) / 2^14 rounded, the BT.601 weights in the fixed point of OpenCV.
+static constexpr int GRAY_SHIFT = 14;
+static constexpr int GRAY_BLUE = 1868, GRAY_GREEN = 9617, GRAY_RED = 4899;
+
+
+// Converts the pixels [start, width) of a row of step-byte BGR(A) pixels to gray.
+static void convertToGray(const uint8_t *row, size_t step, int start, int width, uint8_t *out) {
+	for (int x = start; x < width; x++) {
+		const uint8_t *p = &row[static_cast<size_t>(x) * step];
+		out[x] = static_cast<uint8_t>((p[0] * GRAY_BLUE + p[1] * GRAY_GREEN + p[2] * GRAY_RED
+			+ (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT);
+	}
+}
+
+
+// Adds the row entering the window to the column sums and subtracts the one leaving it (either
+// may be null), and writes the running total of the sums along the row to prefix[x + 1], for the
+// columns [start, width). The total before start is prefix[start].
+static void updateColumnSums(std::uint32_t *sums, const uint8_t *entering, const uint8_t *leaving,
+		int start, int width, std::uint32_t *prefix) {
+	std::uint32_t total = prefix[start];
+	for (int x = start; x < width; x++) {
+		std::uint32_t sum = sums[x];
+		if (entering != nullptr)
+			sum += entering[x];
+		if (leaving != nullptr)
+			sum -= leaving[x];
+		sums[x] = sum;
+		total += sum;
+		prefix[x + 1] = total;
+	}
+}
+
+
+// Thresholds the pixels [start, width) of a row. The window of pixel x spans the columns
+// [max(x - radius, 0), min(x + radius + 1, width)) of the given number of rows, and its sum is
+// prefix[x + 2 * radius + 1] - prefix[x]. Sets out[x] = 1 iff gray[x] is at least 10% below
+// the window mean, i.e. gray * area * 10 <= sum * 9, computed in Word, which must hold the
+// largest window area times 2550.
+template <typename Word>
+static void thresholdRow(const uint8_t *gray, const std::uint32_t *prefix, int radius, int width, int rows,
+		int start, uint8_t *out) {
+	for (int x = start; x < width; x++) {
+		Word sum = prefix[x + 2 * radius + 1] - prefix[x];
+		int columns = std::min(x + radius + 1, width) - std::max(x - radius, 0);
+		Word area = static_cast<Word>(columns) * static_cast<Word>(rows);
+		out[x] = static_cast<uint8_t>(gray[x] * area * 10 <= sum * 9);
+	}
+}
+
+
+#ifdef QRCODEGEN_SIMD_BINARIZE
+
+// Eight bytes of 0 or 1 for each 8-bit mask, to store the comparison results of 8 lanes at once.
+struct MaskBytes final {
+	std::uint64_t bytes[256];
+};
+
+
+static constexpr MaskBytes makeMaskBytes() {
+	MaskBytes result{};
+	for (int mask = 0; mask < 256; mask++) {
+		for (int i = 0; i < 8; i++)
+			result.bytes[mask] |= static_cast<std::uint64_t>((mask >> i) & 1) << (i * 8);
+	}
+	return result;
+}
+
+static constexpr MaskBytes MASK_BYTES = makeMaskBytes();
+
+
+// convertToGray() 8 pixels at a time, returning the first pixel it did not convert. Each 128-bit
+// half takes 4 pixels, whose blue and green bytes become 16-bit pairs for one multiply-add and
+// whose red bytes another; it never reads past the end of the row.
+__attribute__((target("avx2")))
+static int convertToGrayAvx2(const uint8_t *row, size_t step, int width, uint8_t *out) {
+	const __m256i blueGreen = step == 3
+		? _mm256_setr_epi8(0,-1,1,-1, 3,-1,4,-1, 6,-1,7,-1, 9,-1,10,-1, 0,-1,1,-1, 3,-1,4,-1, 6,-1,7,-1, 9,-1,10,-1)
+		: _mm256_setr_epi8(0,-1,1,-1, 4,-1,5,-1, 8,-1,9,-1, 12,-1,13,-1, 0,-1,1,-1, 4,-1,5,-1, 8,-1,9,-1, 12,-1,13,-1);
+	const __m256i red = step == 3
+		? _mm256_setr_epi8(2,-1,-1,-1, 5,-1,-1,-1, 8,-1,-1,-1, 11,-1,-1,-1, 2,-1,-1,-1, 5,-1,-1,-1, 8,-1,-1,-1, 11,-1,-1,-1)
+		: _mm256_setr_epi8(2,-1,-1,-1, 6,-1,-1,-1, 10,-1,-1,-1, 14,-1,-1,-1, 2,-1,-1,-1, 6,-1,-1,-1, 10,-1,-1,-1, 14,-1,-1,-1);
+	const __m256i blueGreenWeights = _mm256_set1_epi32(GRAY_GREEN << 16 | GRAY_BLUE);
+	const __m256i redWeights = _mm256_set1_epi32(GRAY_RED);
+	const __m256i rounding = _mm256_set1_epi32(1 << (GRAY_SHIFT - 1));
+	const __m256i lowBytes = _mm256_setr_epi8(0,4,8,12, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1,
+		0,4,8,12, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1);
+	// The second load starts 4 pixels in and reads 16 bytes, so the last 8 pixels need some slack
+	int end = width - (step == 3 ? 9 : 7);
+	int x = 0;
+	for (; x < end; x += 8) {
+		const uint8_t *p = &row[static_cast<size_t>(x) * step];
+		__m256i bytes = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 4 * step)), 1);
+		__m256i gray = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_shuffle_epi8(bytes, blueGreen), blueGreenWeights),
+			_mm256_madd_epi16(_mm256_shuffle_epi8(bytes, red), redWeights));
+		gray = _mm256_srli_epi32(_mm256_add_epi32(gray, rounding), GRAY_SHIFT);
+		gray = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(gray, lowBytes), _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(&out[x]), _mm256_castsi256_si128(gray));
+	}
+	return x;
+}
+
+
+// updateColumnSums() 8 columns at a time from column 0, returning the first column it did not update.
+__attribute__((target("avx2")))
+static int updateColumnSumsAvx2(std::uint32_t *sums, const uint8_t *entering, const uint8_t *leaving,
+		int width, std::uint32_t *prefix) {
+	__m256i total = _mm256_set1_epi32(static_cast<int>(prefix[0]));
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&sums[x]));
+		if (entering != nullptr)
+			s = _mm256_add_epi32(s, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&entering[x]))));
+		if (leaving != nullptr)
+			s = _mm256_sub_epi32(s, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&leaving[x]))));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&sums[x]), s);
+		
+		// Running totals within each half, then the low half's total carried into the high half
+		s = _mm256_add_epi32(s, _mm256_slli_si256(s, 4));
+		s = _mm256_add_epi32(s, _mm256_slli_si256(s, 8));
+		s = _mm256_add_epi32(s, _mm256_blend_epi32(_mm256_setzero_si256(),
+			_mm256_permutevar8x32_epi32(s, _mm256_set1_epi32(3)), 0xF0));
+		s = _mm256_add_epi32(s, total);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&prefix[x + 1]), s);
+		total = _mm256_permutevar8x32_epi32(s, _mm256_set1_epi32(7));
+	}
+	return x;
+}
+
+
+// thresholdRow() 8 pixels at a time from pixel 0, returning the first pixel it did not threshold.
+// The largest window area times 2550 must fit in 32 bits.
+__attribute__((target("avx2")))
+static int thresholdRowAvx2(const uint8_t *gray, const std::uint32_t *prefix, int radius, int width, int rows,
+		uint8_t *out) {
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i rows10 = _mm256_set1_epi32(rows * 10);
+	const __m256i nine = _mm256_set1_epi32(9);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i widthVec = _mm256_set1_epi32(width);
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		// Columns in each window, clipped to the image
+		__m256i xs = _mm256_add_epi32(_mm256_set1_epi32(x), lanes);
+		__m256i right = _mm256_min_epi32(_mm256_add_epi32(xs, _mm256_set1_epi32(radius + 1)), widthVec);
+		__m256i left = _mm256_max_epi32(_mm256_sub_epi32(xs, _mm256_set1_epi32(radius)), zero);
+		__m256i area10 = _mm256_mullo_epi32(_mm256_sub_epi32(right, left), rows10);
+		
+		__m256i g = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&gray[x])));
+		__m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&prefix[x + 2 * radius + 1]));
+		__m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&prefix[x]));
+		__m256i lhs = _mm256_mullo_epi32(g, area10);
+		__m256i rhs = _mm256_mullo_epi32(_mm256_sub_epi32(hi, lo), nine);
+		// Unsigned lhs <= rhs iff max(lhs, rhs) == rhs
+		__m256i dark = _mm256_cmpeq_epi32(_mm256_max_epu32(lhs, rhs), rhs);
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(dark));
+		std::memcpy(&out[x], &MASK_BYTES.bytes[mask], 8);
+	}
+	return x;
+}
+
+#endif
+
+
+const uint8_t *QrReader::grayRow(const uint8_t *pixels, int stride, PixelFormat format,
+		int width, int y, uint8_t *out) {
+	const uint8_t *row = &pixels[static_cast<size_t>(y) * static_cast<size_t>(stride)];
+	if (format == PixelFormat::GRAY8)
+		return row;
+	size_t step = format == PixelFormat::BGR24 ? 3 : 4;
+	int x = 0;
+#ifdef QRCODEGEN_SIMD_BINARIZE
+	if (QrCode::getSimdLevel() == QrCode::SimdLevel::AVX2)
+		x = convertToGrayAvx2(row, step, width, out);
+#endif
+	convertToGray(row, step, x, width, out);
+	return out;
+}
+
+
+void QrReader::binarize(const uint8_t *pixels, int stride, PixelFormat format) {
+	// The window is a quarter of the larger dimension wide, so that even the 3x3 module center
+	// of a finder pattern filling most of the frame has light pixels in its window. A pixel
+	// is dark if it is at least 10% below the mean, or if the whole window is black. Scaling
+	// the contrast first would not change which pixels are dark, as the threshold is relative.
+	int radius = std::max(8, std::max(width, height) / 8);
+	size_t w = static_cast<size_t>(width);
+	size_t r = static_cast<size_t>(radius);
+	columnSums.assign(w, 0);
+	// rowSums[radius + x] is the sum of the columns left of x, for x in [0, width], and it stays
+	// 0 before and the row total after, so that every window sum has the same form. Unsigned
+	// sums may wrap around for huge images, but every window sum is still exact.
+	rowSums.assign(w + r * 2 + 2, 0);
+	grayRows.resize(w * 3);
+	binary.resize(w * static_cast<size_t>(height));
+	uint8_t *entering = &grayRows[0], *leaving = &grayRows[w], *current = &grayRows[w * 2];
+	std::uint32_t *prefix = &rowSums[r];
+	
+	// The comparison fits in 32 bits up to a window of about 1297 pixels square
+	std::uint64_t maxArea = static_cast<std::uint64_t>(std::min(2 * radius + 1, width))
+		* static_cast<std::uint64_t>(std::min(2 * radius + 1, height));
+	bool narrow = maxArea * 2550 <= UINT32_MAX;
+#ifdef QRCODEGEN_SIMD_BINARIZE
+	bool simd = narrow && QrCode::getSimdLevel() == QrCode::SimdLevel::AVX2;
+#endif
+	
+	// The rows before 0 only fill the window of row 0, rows [0, radius];
+	// from then on each row takes one row into the window and one out
+	for (int y = -radius; y < height; y++) {
+		int enterY = y + radius, leaveY = y - radius - 1;
+		const uint8_t *enter = enterY < height ? grayRow(pixels, stride, format, width, enterY, entering) : nullptr;
+		const uint8_t *leave = leaveY >= 0 ? grayRow(pixels, stride, format, width, leaveY, leaving) : nullptr;
+		int x = 0;
+#ifdef QRCODEGEN_SIMD_BINARIZE
+		if (simd)
+			x = updateColumnSumsAvx2(columnSums.data(), enter, leave, width, prefix);
+#endif
+		updateColumnSums(columnSums.data(), enter, leave, x, width, prefix);
+		if (y < 0)
+			continue;
+		
+		std::fill(&prefix[w + 1], &rowSums[rowSums.size()], prefix[w]);
+		int rows = std::min(y + radius + 1, height) - std::max(y - radius, 0);
+		const uint8_t *gray = grayRow(pixels, stride, format, width, y, current);
+		uint8_t *out = &binary[static_cast<size_t>(y) * w];
+		x = 0;
+#ifdef QRCODEGEN_SIMD_BINARIZE
+		if (simd)
+			x = thresholdRowAvx2(gray, rowSums.data(), radius, width, rows, out);
+#endif
+		if (narrow)
+			thresholdRow<std::uint32_t>(gray, rowSums.data(), radius, width, rows, x, out);
+		else
+			thresholdRow<std::uint64_t>(gray, rowSums.data(), radius, width, rows, x, out);
+	}
+}
+
+
+bool QrReader::isDark(int x, int y) const {
+	return binary[static_cast<size_t>(y) * static_cast<size_t>(width) + static_cast<size_t>(x)] != 0;
+}
+
+
+void QrReader::findFinderPatterns(int skip) {
+	candidates.clear();
+	for (int y = skip - 1; y < height; y += skip) {
+		// Runs of dark, light, dark, light, dark pixels
+		int stateCount[5] = {};
+		int currentState = 0;
+		const uint8_t *row = &binary[static_cast<size_t>(y) * static_cast<size_t>(width)];
+		for (int x = 0; x < width; x++) {
+			if (row[x] != 0) {
+				if ((currentState & 1) == 1)
+					currentState++;
+				stateCount[currentState]++;
+			} else if ((currentState & 1) == 1) {
+				stateCount[currentState]++;
+			} else if (currentState == 4) {
+				if (foundPatternCross(stateCount) && handlePossibleCenter(stateCount, y, x)) {
+					std::memset(stateCount, 0, sizeof(stateCount));
+					currentState = 0;
+				} else {
+					// Keep the last dark-light-dark runs as the start of the next pattern
+					stateCount[0] = stateCount[2];
+					stateCount[1] = stateCount[3];
+					stateCount[2] = stateCount[4];
+					stateCount[3] = 1;
+					stateCount[4] = 0;
+					currentState = 3;
+				}
+			} else {
+				currentState++;
+				stateCount[currentState]++;
+			}
+		}
+		if (foundPatternCross(stateCount))
+			handlePossibleCenter(stateCount, y, width);
+	}
+}
+
+
+bool QrReader::handlePossibleCenter(const int stateCount[5], int y, int endX) {
+	int total = stateCount[0] + stateCount[1] + stateCount[2] + stateCount[3] + stateCount[4];
+	float centerX = centerFromEnd(stateCount, endX);
+	float centerY = crossCheckVertical(static_cast<int>(centerX), y, stateCount[2], total);
+	if (centerY < 0)
+		return false;
+	centerX = crossCheckHorizontal(static_cast<int>(centerX), static_cast<int>(centerY), stateCount[2], total);
+	if (centerX < 0)
+		return false;
+	
+	float moduleSize = total / 7.0f;
+	for (FinderCandidate &c : candidates) {
+		if (std::abs(centerY - c.y) <= moduleSize && std::abs(centerX - c.x) <= moduleSize) {
+			float diff = std::abs(moduleSize - c.moduleSize);
+			if (diff <= 1 || diff <= c.moduleSize) {
+				float n = static_cast<float>(c.count);
+				c.x = (c.x * n + centerX) / (n + 1);
+				c.y = (c.y * n + centerY) / (n + 1);
+				c.moduleSize = (c.moduleSize * n + moduleSize) / (n + 1);
+				c.count++;
+				return true;
+			}
+		}
+	}
+	candidates.push_back(FinderCandidate{centerX, centerY, moduleSize, 1});
+	return true;
+}
+
+
+float QrReader::crossCheckVertical(int centerX, int startY, int maxCount, int originalTotal) const {
+	int stateCount[5] = {};
+	int y = startY;
+	while (y >= 0 && isDark(centerX, y)) {
+		stateCount[2]++;
+		y--;
+	}
+	if (y < 0)
+		return -1;
+	while (y >= 0 && !isDark(centerX, y) && stateCount[1] <= maxCount) {
+		stateCount[1]++;
+		y--;
+	}
+	if (y < 0 || stateCount[1] > maxCount)
+		return -1;
+	while (y >= 0 && isDark(centerX, y) && stateCount[0] <= maxCount) {
+		stateCount[0]++;
+		y--;
+	}
+	if (stateCount[0] > maxCount)
+		return -1;
+	
+	y = startY + 1;
+	while (y < height && isDark(centerX, y)) {
+		stateCount[2]++;
+		y++;
+	}
+	if (y == height)
+		return -1;
+	while (y < height && !isDark(centerX, y) && stateCount[3] <= maxCount) {
+		stateCount[3]++;
+		y++;
+	}
+	if (y == height || stateCount[3] > maxCount)
+		return -1;
+	while (y < height && isDark(centerX, y) && stateCount[4] <= maxCount) {
+		stateCount[4]++;
+		y++;
+	}
+	if (stateCount[4] > maxCount)
+		return -1;
+	
+	// The runs across must add up to about the same length as the runs along
+	int total = stateCount[0] + stateCount[1] + stateCount[2] + stateCount[3] + stateCount[4];
+	if (5 * std::abs(total - originalTotal) >= 2 * originalTotal)
+		return -1;
+	return foundPatternCross(stateCount) ? centerFromEnd(stateCount, y) : -1;
+}
+
+
+float QrReader::crossCheckHorizontal(int startX, int centerY, int maxCount, int originalTotal) const {
+	int stateCount[5] = {};
+	int x = startX;
+	while (x >= 0 && isDark(x, centerY)) {
+		stateCount[2]++;
+		x--;
+	}
+	if (x < 0)
+		return -1;
+	while (x >= 0 && !isDark(x, centerY) && stateCount[1] <= maxCount) {
+		stateCount[1]++;
+		x--;
+	}
+	if (x < 0 || stateCount[1] > maxCount)
+		return -1;
+	while (x >= 0 && isDark(x, centerY) && stateCount[0] <= maxCount) {
+		stateCount[0]++;
+		x--;
+	}
+	if (stateCount[0] > maxCount)
+		return -1;
+	
+	x = startX + 1;
+	while (x < width && isDark(x, centerY)) {
+		stateCount[2]++;
+		x++;
+	}
+	if (x == width)
+		return -1;
+	while (x < width && !isDark(x, centerY) && stateCount[3] <= maxCount) {
+		stateCount[3]++;
+		x++;
+	}
+	if (x == width || stateCount[3] > maxCount)
+		return -1;
+	while (x < width && isDark(x, centerY) && stateCount[4] <= maxCount) {
+		stateCount[4]++;
+		x++;
+	}
+	if (stateCount[4] > maxCount)
+		return -1;
+	
+	int total = stateCount[0] + stateCount[1] + stateCount[2] + stateCount[3] + stateCount[4];
+	if (5 * std::abs(total - originalTotal) >= originalTotal)
+		return -1;
+	return foundPatternCross(stateCount) ? centerFromEnd(stateCount, x) : -1;
+}
+
+
+bool QrReader::selectFinderPatterns(FinderCandidate corners[3], int chosen[3]) const {
+	// A pattern that far fewer rows found than the best one is usually a lookalike in the data,
+	// unless ignoring those leaves fewer than three. Used up candidates have a count of 0.
+	int maxCount = 0;
+	for (const FinderCandidate &c : candidates)
+		maxCount = std::max(c.count, maxCount);
+	int minCount = std::max(2, maxCount / 4);
+	if (std::count_if(candidates.begin(), candidates.end(),
+			[minCount](const FinderCandidate &c) { return c.count >= minCount; }) < 3)
+		minCount = 1;
+	
+	// Try every triple and keep the one closest to a right isosceles triangle of equal patterns
+	// (allowing for perspective), whose legs span at least the 14 modules of a version 1 symbol
+	const int n = static_cast<int>(candidates.size());
+	float bestScore = 0.5f;
+	bool found = false;
+	for (int i = 0; i < n; i++) {
+		const FinderCandidate &a = candidates[static_cast<size_t>(i)];
+		if (a.count < minCount)
+			continue;
+		for (int j = i + 1; j < n; j++) {
+			const FinderCandidate &b = candidates[static_cast<size_t>(j)];
+			if (b.count < minCount)
+				continue;
+			for (int k = j + 1; k < n; k++) {
+				const FinderCandidate &c = candidates[static_cast<size_t>(k)];
+				if (c.count < minCount)
+					continue;
+				const int indices[3] = {i, j, k};
+				if (!rejectedTriples.empty() && std::find(rejectedTriples.begin(), rejectedTriples.end(),
+						tripleKey(indices)) != rejectedTriples.end())
+					continue;
+				float minSize = std::min({a.moduleSize, b.moduleSize, c.moduleSize});
+				float maxSize = std::max({a.moduleSize, b.moduleSize, c.moduleSize});
+				if (maxSize > minSize * 1.5f)
+					continue;
+				
+				// The corner is the vertex opposite the longest side
+				const FinderCandidate *tri[3] = {&a, &b, &c};
+				float ab = distance(a.x, a.y, b.x, b.y);
+				float bc = distance(b.x, b.y, c.x, c.y);
+				float ca = distance(c.x, c.y, a.x, a.y);
+				float hyp, leg1, leg2;
+				if (bc >= ab && bc >= ca) {
+					hyp = bc;  leg1 = ab;  leg2 = ca;
+				} else if (ca >= ab) {
+					hyp = ca;  leg1 = ab;  leg2 = bc;  std::swap(tri[0], tri[1]);
+				} else {
+					hyp = ab;  leg1 = ca;  leg2 = bc;  std::swap(tri[0], tri[2]);
+				}
+				float moduleSize = (a.moduleSize + b.moduleSize + c.moduleSize) / 3;
+				if (std::min(leg1, leg2) < 12 * moduleSize)
+					continue;
+				float legDiff = std::abs(leg1 - leg2) / std::max(leg1, leg2);
+				float hypDiff = std::abs(hyp * hyp - (leg1 * leg1 + leg2 * leg2)) / (hyp * hyp);
+				float score = legDiff + hypDiff + (maxSize - minSize) / maxSize;
+				if (score < bestScore) {
+					bestScore = score;
+					for (int m = 0; m < 3; m++) {
+						corners[m] = *tri[m];
+						chosen[m] = indices[m];
+					}
+					found = true;
+				}
+			}
+		}
+	}
+	if (!found)
+		return false;
+	
+	// Order the other two clockwise in image coordinates (y pointing down)
+	const FinderCandidate &o = corners[0], &p = corners[1], &q = corners[2];
+	if ((p.x - o.x) * (q.y - o.y) - (p.y - o.y) * (q.x - o.x) < 0)
+		std::swap(corners[1], corners[2]);
+	return true;
+}
+
+
+bool QrReader::hasTimingPattern(const FinderCandidate &from, const FinderCandidate &to,
+		const FinderCandidate &side) const {
+	// The finder centers are at module 3.5 and the timing pattern runs along module 6.5, from 5
+	// modules past one center to 5 modules before the other, dark at both ends. Data modules
+	// change color every other module on average and often run longer than 2.
+	float moduleSize = (from.moduleSize + to.moduleSize + side.moduleSize) / 3;
+	float length = distance(from.x, from.y, to.x, to.y);
+	float sideLength = distance(from.x, from.y, side.x, side.y);
+	float ux = (to.x - from.x) / length, uy = (to.y - from.y) / length;
+	float originX = from.x + (side.x - from.x) / sideLength * 3 * moduleSize;
+	float originY = from.y + (side.y - from.y) / sideLength * 3 * moduleSize;
+	float start = 5 * moduleSize, end = length - 5 * moduleSize;
+	int runs = 0;
+	float run = 0, longestRun = 0;
+	bool lastDark = false;
+	for (float t = start; t <= end; t += 1) {
+		int x = static_cast<int>(std::floor(originX + ux * t));
+		int y = static_cast<int>(std::floor(originY + uy * t));
+		if (x < 0 || y < 0 || x >= width || y >= height)
+			return false;
+		bool dark = isDark(x, y);
+		if (runs == 0 || dark != lastDark) {
+			longestRun = std::max(run, longestRun);
+			run = 0;
+			runs++;
+			lastDark = dark;
+		}
+		run++;
+	}
+	longestRun = std::max(run, longestRun);
+	return runs >= 0.6f * (end - start) / moduleSize && longestRun <= 2.5f * moduleSize;
+}
+
+
+std::uint64_t QrReader::tripleKey(const int chosen[3]) {
+	return static_cast<std::uint64_t>(chosen[0]) << 42 | static_cast<std::uint64_t>(chosen[1]) << 21
+		| static_cast<std::uint64_t>(chosen[2]);
+}
+
+
+float QrReader::sizeOfBlackWhiteBlackRunBoth(float fromX, float fromY, float toX, float toY) const {
+	float result = sizeOfBlackWhiteBlackRun(fromX, fromY, toX, toY);
+	return result + sizeOfBlackWhiteBlackRun(fromX, fromY, 2 * fromX - toX, 2 * fromY - toY) - 1;
+}
+
+
+float QrReader::sizeOfBlackWhiteBlackRun(float fromX, float fromY, float toX, float toY) const {
+	float len = distance(fromX, fromY, toX, toY);
+	if (len < 1)
+		return NAN;
+	float stepX = (toX - fromX) / len, stepY = (toY - fromY) / len;
+	// State 0 is the dark center, 1 the light ring and 2 the dark ring; the run ends at the light after it
+	int state = 0;
+	for (int i = 0; i <= len; i++) {
+		int x = static_cast<int>(std::floor(fromX + stepX * i));
+		int y = static_cast<int>(std::floor(fromY + stepY * i));
+		if (x < 0 || y < 0 || x >= width || y >= height)
+			return state == 2 ? static_cast<float>(i) : NAN;
+		if (isDark(x, y) == (state == 1)) {
+			if (state == 2)
+				return static_cast<float>(i);
+			state++;
+		}
+	}
+	return NAN;
+}
+
+
+bool QrReader::sampleGrid(int size, const float modulePoints[4][2], const float imagePoints[4][2]) {
+	PerspectiveTransform transform = quadrilateralToQuadrilateral(modulePoints, imagePoints);
+	grid.reset(size);
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			float ix, iy;
+			if (!transformPoint(transform, x + 0.5, y + 0.5, ix, iy))
+				return false;
+			// Allow module centers a pixel outside the image, as the edge of a symbol can be
+			int px = static_cast<int>(std::floor(ix)), py = static_cast<int>(std::floor(iy));
+			if (px < -1 || py < -1 || px > width || py > height)
+				return false;
+			px = std::min(std::max(px, 0), width - 1);
+			py = std::min(std::max(py, 0), height - 1);
+			if (isDark(px, py))
+				grid.set(x, y, true);
+		}
+	}
+	return true;
+}
+
+
+bool QrReader::findAlignmentPattern(float predictedX, float predictedY,
+		const float right[2], const float down[2], float moduleSize, float &foundX, float &foundY) const {
+	// Scores a position by sampling the 5x5 module centers around it:
+	// a dark center, a light ring and a dark ring, 25 points in all
+	auto score = [&](float cx, float cy) {
+		int result = 0;
+		for (int dy = -2; dy <= 2; dy++) {
+			for (int dx = -2; dx <= 2; dx++) {
+				int x = static_cast<int>(std::floor(cx + dx * right[0] + dy * down[0]));
+				int y = static_cast<int>(std::floor(cy + dx * right[1] + dy * down[1]));
+				if (x < 0 || y < 0 || x >= width || y >= height)
+					return 0;
+				bool expectDark = std::max(std::abs(dx), std::abs(dy)) != 1;
+				if (isDark(x, y) == expectDark)
+					result++;
+			}
+		}
+		return result;
+	};
+	
+	// Search a window of a few modules for the best score closest to the prediction, widening it if
+	// that fails as the prediction is off further under perspective. The coarse steps of a third of
+	// a module cannot miss the pattern, whose samples stay in their modules for about half a module.
+	int step = std::max(1, static_cast<int>(moduleSize / 3));
+	int bestScore = 22;  // Need at least 23 of 25 samples
+	float bestX = 0, bestY = 0;
+	for (int allowance = 4; allowance <= 16 && bestScore == 22; allowance *= 2) {
+		int radius = static_cast<int>(std::ceil(allowance * moduleSize)) / step * step;
+		int bestDist = 0;
+		for (int oy = -radius; oy <= radius; oy += step) {
+			for (int ox = -radius; ox <= radius; ox += step) {
+				float cx = predictedX + ox, cy = predictedY + oy;
+				int s = score(cx, cy);
+				int dist = ox * ox + oy * oy;
+				if (s > bestScore || (s == bestScore && s > 22 && dist < bestDist)) {
+					bestScore = s;
+					bestX = cx;
+					bestY = cy;
+					bestDist = dist;
+				}
+			}
+		}
+	}
+	if (bestScore == 22)
+		return false;
+	
+	// Then center on the pixel positions with the top score within a module of that
+	int reach = static_cast<int>(std::ceil(moduleSize));
+	for (int oy = -reach; oy <= reach; oy++) {
+		for (int ox = -reach; ox <= reach; ox++)
+			bestScore = std::max(score(bestX + ox, bestY + oy), bestScore);
+	}
+	float sumX = 0, sumY = 0;
+	int count = 0;
+	for (int oy = -reach; oy <= reach; oy++) {
+		for (int ox = -reach; ox <= reach; ox++) {
+			if (score(bestX + ox, bestY + oy) == bestScore) {
+				sumX += bestX + ox;
+				sumY += bestY + oy;
+				count++;
+			}
+		}
+	}
+	foundX = sumX / count + 0.5f;
+	foundY = sumY / count + 0.5f;
+	return true;
+}
+
+
+int QrReader::readFormatInformation(const BitGrid &modules) {
+	// Bit i of each copy is where QrCode::forEachFormatModule() draws it
+	int size = modules.getSize();
+	int first = 0, second = 0;
+	for (int i = 0; i <= 5; i++)
+		first |= static_cast<int>(modules.get(8, i)) << i;
+	first |= static_cast<int>(modules.get(8, 7)) << 6;
+	first |= static_cast<int>(modules.get(8, 8)) << 7;
+	first |= static_cast<int>(modules.get(7, 8)) << 8;
+	for (int i = 9; i < 15; i++)
+		first |= static_cast<int>(modules.get(14 - i, 8)) << i;
+	for (int i = 0; i < 8; i++)
+		second |= static_cast<int>(modules.get(size - 1 - i, 8)) << i;
+	for (int i = 8; i < 15; i++)
+		second |= static_cast<int>(modules.get(8, size - 15 + i)) << i;
+	
+	// The 32 codes are at least 7 bits apart, so up to 3 bit errors are corrected
+	int result = -1, bestDistance = 4;
+	for (int e = 0; e < 4; e++) {
+		for (int msk = 0; msk < 8; msk++) {
+			int code = QrCode::getFormatInformation(static_cast<QrCode::Ecc>(e), msk);
+			int dist = std::min(QrCode::popCount(static_cast<std::uint64_t>(first ^ code)),
+				QrCode::popCount(static_cast<std::uint64_t>(second ^ code)));
+			if (dist < bestDistance) {
+				bestDistance = dist;
+				result = e << 3 | msk;
+			}
+		}
+	}
+	return result;
+}
+
+
+int QrReader::readVersionInformation(const BitGrid &modules) {
+	// Bit i of the top right copy is at (size - 11 + i % 3, i / 3), and the bottom left copy is transposed
+	int size = modules.getSize();
+	long first = 0, second = 0;
+	for (int i = 0; i < 18; i++) {
+		int a = size - 11 + i % 3, b = i / 3;
+		first  |= static_cast<long>(modules.get(a, b)) << i;
+		second |= static_cast<long>(modules.get(b, a)) << i;
+	}
+	int result = -1, bestDistance = 4;
+	for (int ver = 7; ver <= QrCode::MAX_VERSION; ver++) {
+		long code = QrCode::getVersionInformation(ver);
+		int dist = std::min(QrCode::popCount(static_cast<std::uint64_t>(first ^ code)),
+			QrCode::popCount(static_cast<std::uint64_t>(second ^ code)));
+		if (dist < bestDistance) {
+			bestDistance = dist;
+			result = ver;
+		}
+	}
+	return result;
+}
+
+
+int QrReader::correctBlock(uint8_t *data, int len, int eccLen) {
+	// The generator polynomial has the roots r^0 to r^(eccLen-1), so the syndromes
+	// are the block (as a polynomial, first codeword highest) evaluated at those
+	uint8_t syndromes[30];
+	bool anyError = false;
+	for (int i = 0; i < eccLen; i++) {
+		uint8_t s = 0;
+		for (int k = 0; k < len; k++)
+			s = static_cast<uint8_t>((s == 0 ? 0 : QrCode::reedSolomonExp(QrCode::reedSolomonLog(s) + i)) ^ data[k]);
+		syndromes[i] = s;
+		anyError |= s != 0;
+	}
+	if (!anyError)
+		return 0;
+	
+	auto divide = [](uint8_t x, uint8_t y) -> uint8_t {
+		return x == 0 ? 0 : QrCode::reedSolomonExp(QrCode::reedSolomonLog(x) + 255 - QrCode::reedSolomonLog(y));
+	};
+	
+	// Berlekamp-Massey finds the error locator polynomial (coefficients from lowest power)
+	uint8_t locator[31] = {1}, previous[31] = {1}, temp[31];
+	int numErrors = 0, shift = 1;
+	uint8_t previousDiscrepancy = 1;
+	for (int r = 0; r < eccLen; r++) {
+		uint8_t discrepancy = syndromes[r];
+		for (int i = 1; i <= numErrors; i++)
+			discrepancy ^= QrCode::reedSolomonMultiply(locator[i], syndromes[r - i]);
+		if (discrepancy == 0) {
+			shift++;
+			continue;
+		}
+		uint8_t coef = divide(discrepancy, previousDiscrepancy);
+		std::memcpy(temp, locator, sizeof(temp));
+		for (int i = 0; i + shift <= 30; i++)
+			locator[i + shift] ^= QrCode::reedSolomonMultiply(coef, previous[i]);
+		if (2 * numErrors <= r) {
+			numErrors = r + 1 - numErrors;
+			std::memcpy(previous, temp, sizeof(previous));
+			previousDiscrepancy = discrepancy;
+			shift = 1;
+		} else
+			shift++;
+	}
+	if (2 * numErrors > eccLen)
+		return -1;
+	
+	// The error evaluator is syndromes * locator mod x^eccLen
+	uint8_t evaluator[30];
+	for (int i = 0; i < eccLen; i++) {
+		uint8_t sum = 0;
+		for (int j = 0; j <= i && j <= numErrors; j++)
+			sum ^= QrCode::reedSolomonMultiply(locator[j], syndromes[i - j]);
+		evaluator[i] = sum;
+	}
+	
+	// Chien search for the roots, which are the inverses of the error positions' locators X = r^power,
+	// and Forney's formula for the error values: X * evaluator(1/X) / locator'(1/X)
+	int found = 0;
+	for (int k = 0; k < len; k++) {
+		int power = len - 1 - k;
+		uint8_t inverse = QrCode::reedSolomonExp((255 - power) % 255);
+		uint8_t value = 0;
+		for (int i = numErrors; i >= 0; i--)
+			value = QrCode::reedSolomonMultiply(value, inverse) ^ locator[i];
+		if (value != 0)
+			continue;
+		
+		uint8_t numerator = 0;
+		for (int i = eccLen - 1; i >= 0; i--)
+			numerator = QrCode::reedSolomonMultiply(numerator, inverse) ^ evaluator[i];
+		uint8_t derivative = 0, term = 1;
+		for (int i = 1; i <= numErrors; i++) {
+			if ((i & 1) != 0)
+				derivative ^= QrCode::reedSolomonMultiply(locator[i], term);
+			term = QrCode::reedSolomonMultiply(term, inverse);
+		}
+		if (derivative == 0)
+			return -1;
+		uint8_t magnitude = QrCode::reedSolomonMultiply(QrCode::reedSolomonExp(power), divide(numerator, derivative));
+		if (magnitude == 0)
+			return -1;
+		data[k] ^= magnitude;
+		found++;
+	}
+	// Fewer roots than the degree means the errors are beyond the code's capability
+	return found == numErrors ? numErrors : -1;
+}
+
+
+bool QrReader::parseSegments(const uint8_t *data, int len, int version, std::string &text) {
+	text.clear();
+	size_t totalBits = static_cast<size_t>(len) * 8;
+	size_t pos = 0;
+	auto readBits = [&](int n) {
+		int result = 0;
+		for (int i = 0; i < n; i++, pos++)
+			result = result << 1 | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+		return result;
+	};
+	auto hasBits = [&](long n) { return n <= static_cast<long>(totalBits - pos); };
+	
+	// A full data capacity may leave less than 4 bits for the terminator, which is then omitted
+	while (hasBits(4)) {
+		int modeBits = readBits(4);
+		if (modeBits == 0)  // Terminator
+			break;
+		if (modeBits == QrSegment::Mode::ECI.getModeBits()) {
+			// The assignment number is 1 to 3 bytes, by its leading bits; the bytes are passed through as is
+			if (!hasBits(8))
+				return false;
+			int first = readBits(8);
+			int extraBytes = (first & 0x80) == 0 ? 0 : (first & 0xC0) == 0x80 ? 1 : (first & 0xE0) == 0xC0 ? 2 : -1;
+			if (extraBytes == -1 || !hasBits(extraBytes * 8))
+				return false;
+			readBits(extraBytes * 8);
+			continue;
+		}
+		if (modeBits == 3 || modeBits == 5 || modeBits == 9) {
+			// Structured append header, FNC1 in first position (no data) or second position (1 byte)
+			int skip = modeBits == 3 ? 16 : modeBits == 9 ? 8 : 0;
+			if (!hasBits(skip))
+				return false;
+			readBits(skip);
+			continue;
+		}
+		
+		const QrSegment::Mode *mode;
+		if (modeBits == QrSegment::Mode::NUMERIC.getModeBits())
+			mode = &QrSegment::Mode::NUMERIC;
+		else if (modeBits == QrSegment::Mode::ALPHANUMERIC.getModeBits())
+			mode = &QrSegment::Mode::ALPHANUMERIC;
+		else if (modeBits == QrSegment::Mode::BYTE.getModeBits())
+			mode = &QrSegment::Mode::BYTE;
+		else if (modeBits == QrSegment::Mode::KANJI.getModeBits())
+			mode = &QrSegment::Mode::KANJI;
+		else
+			return false;
+		int countBits = mode->numCharCountBits(version);
+		if (!hasBits(countBits))
+			return false;
+		long count = readBits(countBits);
+		
+		if (mode == &QrSegment::Mode::NUMERIC) {
+			// Groups of 3 digits in 10 bits, with a final group of 2 in 7 bits or 1 in 4 bits
+			if (!hasBits(count / 3 * 10 + (count % 3 == 0 ? 0 : count % 3 * 3 + 1)))
+				return false;
+			for (; count > 0; count -= 3) {
+				int digits = static_cast<int>(std::min(count, 3L));
+				int value = readBits(digits * 3 + 1);
+				if (value >= (digits == 3 ? 1000 : digits == 2 ? 100 : 10))
+					return false;
+				char group[3];
+				for (int i = digits - 1; i >= 0; i--, value /= 10)
+					group[i] = static_cast<char>('0' + value % 10);
+				text.append(group, static_cast<size_t>(digits));
+			}
+		} else if (mode == &QrSegment::Mode::ALPHANUMERIC) {
+			// Pairs of characters in 11 bits, with a final single character in 6 bits
+			if (!hasBits(count / 2 * 11 + count % 2 * 6))
+				return false;
+			for (; count >= 2; count -= 2) {
+				int value = readBits(11);
+				if (value >= 45 * 45)
+					return false;
+				text.push_back(QrSegment::ALPHANUMERIC_CHARSET[value / 45]);
+				text.push_back(QrSegment::ALPHANUMERIC_CHARSET[value % 45]);
+			}
+			if (count == 1) {
+				int value = readBits(6);
+				if (value >= 45)
+					return false;
+				text.push_back(QrSegment::ALPHANUMERIC_CHARSET[value]);
+			}
+		} else if (mode == &QrSegment::Mode::BYTE) {
+			if (!hasBits(count * 8))
+				return false;
+			for (; count > 0; count--)
+				text.push_back(static_cast<char>(readBits(8)));
+		} else {
+			// Each character is 13 bits, a compacted form of its two byte Shift JIS code
+			if (!hasBits(count * 13))
+				return false;
+			for (; count > 0; count--) {
+				int value = readBits(13);
+				int code = (value / 0xC0) << 8 | value % 0xC0;
+				code += code < 0x1F00 ? 0x8140 : 0xC140;
+				text.push_back(static_cast<char>(code >> 8));
+				text.push_back(static_cast<char>(code & 0xFF));
+			}
+		}
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,302 @@
+/* 
+ * QR Code reader (C++)
+ * 
+ * Finds and decodes QR Code symbols in grayscale or color camera frames, in process. This is the
+ * inverse of the qrcodegen library, and reuses its version tables, Galois field and data module layout.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "qrcodegen.hpp"
+
+
+namespace qrcodegen {
+
+/* 
+ * Reads a QR Code symbol from an 8-bit grayscale or BGR image. The steps are: adaptive binarization
+ * against the local mean (in one pass with the gray conversion of BGR pixels), finder pattern
+ * detection by 1:1:3:1:1 runs, perspective sampling of the module grid (anchored on the bottom right
+ * alignment pattern from version 2), format and version information reading, Reed-Solomon error
+ * correction of each block, and segment decoding.
+ * Supports versions 1 to 40, all error correction levels and masks, and numeric, alphanumeric,
+ * byte, kanji and ECI segments. The symbol must be dark on light and not mirrored.
+ * 
+ * An instance keeps its working buffers between calls, so decoding frames of the same size does
+ * not allocate after the first one. An instance is not thread-safe, so use one reader per thread.
+ */
+class QrReader final {
+	
+	/*---- Public helper types ----*/
+	
+	/* 
+	 * The layouts of the pixels that decode() and decodeTracked() accept.
+	 */
+	public: enum class PixelFormat {
+		GRAY8,   // One byte per pixel
+		BGR24,   // Blue, green and red bytes, as OpenCV captures frames
+		BGRA32,  // Blue, green, red and an ignored fourth byte
+	};
+	
+	
+	/* 
+	 * The content and parameters of a decoded symbol.
+	 */
+	public: class Result final {
+		
+		// The data of all segments concatenated. Byte segments are copied as is (usually UTF-8),
+		// and each kanji character becomes its two Shift JIS bytes.
+		public: std::string text;
+		
+		public: int version = 0;
+		public: QrCode::Ecc errorCorrectionLevel = QrCode::Ecc::LOW;
+		public: int mask = 0;
+		
+		// The number of codewords that Reed-Solomon decoding corrected, over all blocks.
+		public: int correctedErrors = 0;
+		
+		// The centers of the top left, top right and bottom left finder patterns, as (x, y) in pixels.
+		// All zero when decoding a module grid.
+		public: float finderCenters[3][2] = {};
+		
+	};
+	
+	
+	/*---- Constructor ----*/
+	
+	public: QrReader();
+	
+	
+	/*---- Methods ----*/
+	
+	// Returns the number of bytes of one pixel in the given format.
+	public: static int bytesPerPixel(PixelFormat format);
+	
+	
+	/* 
+	 * Searches the given image for a QR Code and decodes it. The image has height rows of width
+	 * pixels, with rows starting stride bytes apart, and dark modules have low values. Returns true
+	 * and fills result on success, or false if no symbol was found or it could not be decoded.
+	 * Throws invalid_argument if the dimensions are not positive or stride is less than width.
+	 */
+	public: bool decode(const std::uint8_t *pixels, int width, int height, int stride, Result &result);
+	
+	
+	/* 
+	 * Decodes an image in the given pixel format. Color pixels are converted to gray with the
+	 * BT.601 weights on the fly, while thresholding, without a gray copy of the image. Stride must be
+	 * at least width times the bytes per pixel. Otherwise the same as decode() on a gray image.
+	 */
+	public: bool decode(const std::uint8_t *pixels, int width, int height, int stride,
+		PixelFormat format, Result &result);
+	
+	
+	/* 
+	 * Decodes consecutive frames of a video, searching only where the symbol was. Once the finder
+	 * patterns of a symbol are found, the following frames are searched in a window around them
+	 * (padded by an eighth of the symbol size plus the quiet zone), and the window follows the
+	 * symbol as it moves. After getMaxTrackingMisses() frames in a row without a decode in the
+	 * window, the whole frame is searched again. Finder centers in the result are in frame
+	 * coordinates. Otherwise the same as decode().
+	 */
+	public: bool decodeTracked(const std::uint8_t *pixels, int width, int height, int stride, Result &result);
+	public: bool decodeTracked(const std::uint8_t *pixels, int width, int height, int stride,
+		PixelFormat format, Result &result);
+	
+	
+	/* 
+	 * Searches the whole image for every QR Code in it and decodes them, for several tickets held up
+	 * at once. Replaces the contents of results with one entry per decoded symbol, in no particular
+	 * order, and returns their number. The image is binarized once; each time the best remaining
+	 * triple of finder patterns whose timing patterns check out is decoded, and a decoded symbol uses
+	 * up the patterns in it. Triples that fail (such as the corners of three neighboring symbols, or
+	 * lookalikes in their data) are not tried again, and the search stops after 8 failed decodes.
+	 * Otherwise the same as decode().
+	 */
+	public: int decodeAll(const std::uint8_t *pixels, int width, int height, int stride,
+		std::vector<Result> &results);
+	public: int decodeAll(const std::uint8_t *pixels, int width, int height, int stride,
+		PixelFormat format, std::vector<Result> &results);
+	
+	
+	// Forgets the tracked window, so the next call to decodeTracked() searches the whole frame.
+	public: void resetTracking();
+	
+	
+	// Returns true iff decodeTracked() is currently searching a window rather than the whole frame.
+	public: bool isTracking() const;
+	
+	
+	// The number of frames in a row without a decode after which decodeTracked() searches the whole
+	// frame again, 5 by default. Throws domain_error if the value is less than 1.
+	public: int getMaxTrackingMisses() const;
+	public: void setMaxTrackingMisses(int misses);
+	
+	
+	/* 
+	 * Decodes an already sampled module grid (true = dark), such as the modules of a generated
+	 * QrCode with some of them damaged. Returns false if the size is not that of a QR Code, the format
+	 * or version information is unreadable, or a block has more errors than its ECC can correct.
+	 */
+	public: bool decodeModules(const BitGrid &modules, Result &result);
+	
+	
+	/*---- Private helper types ----*/
+	
+	// A possible finder pattern center, merged over the rows that cross it.
+	private: struct FinderCandidate {
+		float x;
+		float y;
+		float moduleSize;
+		int count;  // Number of rows that found it
+	};
+	
+	
+	/*---- Private helper methods ----*/
+	
+	// Decodes the image of the current width and height, looking for finder patterns on every
+	// rowSkip-th row. Sets foundFinders iff three finder patterns were selected, which are then
+	// in corners (also when decoding fails).
+	private: bool decodeImage(const std::uint8_t *pixels, int stride, PixelFormat format, int rowSkip,
+		Result &result, FinderCandidate corners[3], bool &foundFinders);
+	
+	
+	// Decodes the symbol with the given finder patterns (top left, top right, bottom left) in the
+	// binarized image. Returns false if no version near the estimated one decodes.
+	private: bool decodeSymbol(const FinderCandidate corners[3], Result &result);
+	
+	
+	// Returns true iff the line 3 modules from the centers of the finder patterns from and to, towards
+	// side, alternates like a timing pattern between them. A quick check before decodeSymbol().
+	private: bool hasTimingPattern(const FinderCandidate &from, const FinderCandidate &to,
+		const FinderCandidate &side) const;
+	
+	
+	// Sets the tracked window around the symbol with the given finder patterns, in frame coordinates.
+	private: void setTrackingWindow(const FinderCandidate corners[3], int frameWidth, int frameHeight);
+	
+	
+	// Thresholds the image into binary, each pixel against the mean of the window around it.
+	// Keeps the sums of the window's rows for each column, and slides them down one row at a
+	// time, so that apart from binary it needs only a few rows of memory.
+	private: void binarize(const std::uint8_t *pixels, int stride, PixelFormat format);
+	
+	
+	// Returns the given row of the image in gray, either in place or converted into out.
+	private: static const std::uint8_t *grayRow(const std::uint8_t *pixels, int stride, PixelFormat format,
+		int width, int y, std::uint8_t *out);
+	
+	
+	// Returns true iff the binarized pixel at the given coordinates is dark.
+	private: bool isDark(int x, int y) const;
+	
+	
+	// Scans every skip-th row of the binary image for 1:1:3:1:1 runs and collects them in candidates.
+	private: void findFinderPatterns(int skip);
+	
+	
+	// Checks a horizontal match ending at (endX, y) across the other axis, and
+	// adds or merges it into candidates. Returns true iff it was confirmed.
+	private: bool handlePossibleCenter(const int stateCount[5], int y, int endX);
+	
+	
+	// Scans the column (row) through the given point for a finder pattern whose center run contains it.
+	// Returns the refined center coordinate on that axis, or a negative value if there is none.
+	private: float crossCheckVertical(int centerX, int startY, int maxCount, int originalTotal) const;
+	private: float crossCheckHorizontal(int startX, int centerY, int maxCount, int originalTotal) const;
+	
+	
+	// Picks the three candidates that best form the corners of a square symbol, in the order top left,
+	// top right, bottom left (clockwise from the corner opposite the diagonal), and their indices in
+	// candidates in increasing order. Skips candidates with a count of 0 and the triples in
+	// rejectedTriples. Returns false if none do.
+	private: bool selectFinderPatterns(FinderCandidate corners[3], int chosen[3]) const;
+	
+	
+	// Returns the key of the triple of candidates with the given increasing indices in rejectedTriples.
+	private: static std::uint64_t tripleKey(const int chosen[3]);
+	
+	
+	// Returns the length of the dark-light-dark run from the center of a finder pattern towards the
+	// given point, plus the same in the opposite direction. This is about 7 modules.
+	private: float sizeOfBlackWhiteBlackRunBoth(float fromX, float fromY, float toX, float toY) const;
+	private: float sizeOfBlackWhiteBlackRun(float fromX, float fromY, float toX, float toY) const;
+	
+	
+	// Samples the module grid of the given size through the perspective transform that maps
+	// the four module space points to the four image points. Returns false if it leaves the image.
+	private: bool sampleGrid(int size, const float modulePoints[4][2], const float imagePoints[4][2]);
+	
+	
+	// Finds the alignment pattern near the predicted image point, where the module axes have the
+	// given pixel vectors. Returns false if no position matches well enough.
+	private: bool findAlignmentPattern(float predictedX, float predictedY,
+		const float right[2], const float down[2], float moduleSize, float &foundX, float &foundY) const;
+	
+	
+	// Reads the format information (both copies) and returns the index of the
+	// closest valid code as ecl * 8 + mask, or -1 if it is more than 3 bits away.
+	private: static int readFormatInformation(const BitGrid &modules);
+	
+	
+	// Reads the version information (both copies) and returns the closest
+	// version, or -1 if it is more than 3 bits away. Only for size >= 45.
+	private: static int readVersionInformation(const BitGrid &modules);
+	
+	
+	// Corrects the given block of data and ECC codewords in place, and returns the number of errors
+	// corrected, or -1 if there are more than the code can correct. Does not allocate memory.
+	private: static int correctBlock(std::uint8_t *data, int len, int eccLen);
+	
+	
+	// Parses the segments in the data codewords into text. Returns false if they are malformed.
+	private: static bool parseSegments(const std::uint8_t *data, int len, int version, std::string &text);
+	
+	
+	/*---- Private fields ----*/
+	
+	// Dimensions of the current image.
+	private: int width;
+	private: int height;
+	
+	// For binarize(): the sums of each column over the window's rows, their prefix sums along the
+	// row (width + 1), and three rows converted to gray (entering, leaving and current).
+	private: std::vector<std::uint32_t> columnSums;
+	private: std::vector<std::uint32_t> rowSums;
+	private: std::vector<std::uint8_t> grayRows;
+	
+	// The binarized image, one byte per pixel (1 = dark).
+	private: std::vector<std::uint8_t> binary;
+	
+	private: std::vector<FinderCandidate> candidates;
+	
+	// The triples of candidates that decodeAll() failed to decode in the current image.
+	private: std::vector<std::uint64_t> rejectedTriples;
+	
+	// The sampled module grid.
+	private: BitGrid grid;
+	
+	// The window that decodeTracked() searches, empty when it searches the whole frame, the
+	// size of the frame it belongs to, the module size of the symbol in it, and the number
+	// of frames in a row without a decode.
+	private: int trackLeft;
+	private: int trackTop;
+	private: int trackRight;
+	private: int trackBottom;
+	private: int trackFrameWidth;
+	private: int trackFrameHeight;
+	private: float trackModuleSize;
+	private: int trackingMisses;
+	private: int maxTrackingMisses;
+	
+	// The raw codewords, one block of them at a time, and the corrected data codewords.
+	private: std::vector<std::uint8_t> codewords;
+	private: std::vector<std::uint8_t> block;
+	private: std::vector<std::uint8_t> dataCodewords;
+	
+};
+
+}
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <fstream>
 // #include <filesystem>
 #include "json.hpp"
@@ -58,8 +59,8 @@ public:
     void setStationName(const string& name) { stationname = name; }
     void setStationCode(const string& code) { stationcode = code; }
 
-    string getStationName() const { return stationname; }
-    string getStationCode() const { return stationcode; }
+    const string& getStationName() const { return stationname; }
+    const string& getStationCode() const { return stationcode; }
 };
 
 // -------------------- Class: SaveStationIntoFile --------------------
@@ -121,14 +122,21 @@ public:
 
 // -------------------- Class: MetroStation --------------------
 // Represents a full metro system containing multiple stations.
+// Stations are identified by a dense ID (their position in the list), and hashed indexes
+// from code and from name to that ID make lookups O(1) without copying any Station.
 // ✔️ OOP Concepts: Association, Composition, Encapsulation
 class MetroStation {
 private:
     SaveStationIntoFile* save;         // ✔️ Association: uses SaveStationIntoFile (but doesn't own it)
     string metroname;
     vector<Station> stations;          // ✔️ Composition: MetroStation owns these Station objects
+    unordered_map<string, size_t> idByCode;   // Station code -> ID (first station with that code)
+    unordered_map<string, size_t> idByName;   // Station name -> ID (first station with that name)
 
 public:
+    // Returned by the find functions when there is no such station
+    static constexpr size_t NO_STATION = static_cast<size_t>(-1);
+
     MetroStation() = default;
 
     // Constructor to inject a SaveStationIntoFile dependency
@@ -138,16 +146,39 @@ public:
     void setMetroName(const string& name) { metroname = name; }
     string getMetroName() const { return metroname; }
 
-    // Add a new station to the metro
+    // Add a new station to the metro; its ID is the number of stations before it
     void addStation(const Station& station) {
+        size_t id = stations.size();
         stations.push_back(station);
+        idByCode.emplace(station.getStationCode(), id);   // Keeps an existing entry
+        idByName.emplace(station.getStationName(), id);
     }
 
-    // Get all added stations
-    vector<Station> returnStations() const {
+    // Get all added stations (by reference, valid until the next addStation)
+    const vector<Station>& returnStations() const {
         return stations;
     }
 
+    // Station ID from code or name, or NO_STATION
+    size_t findStationIdByCode(const string& code) const {
+        auto it = idByCode.find(code);
+        return it != idByCode.end() ? it->second : NO_STATION;
+    }
+
+    size_t findStationIdByName(const string& name) const {
+        auto it = idByName.find(name);
+        return it != idByName.end() ? it->second : NO_STATION;
+    }
+
+    bool hasStationCode(const string& code) const {
+        return idByCode.count(code) != 0;
+    }
+
+    // The station with the given ID, which must be valid
+    const Station& getStation(size_t id) const {
+        return stations[id];
+    }
+
     // Save stations using associated SaveStationIntoFile
     void saveStationsToFile(const string& filename) {
         if (save) {
@@ -217,13 +248,10 @@ public:
         loadStationsFromFile(filename);
     }
 
-    // Find station name from code (used in QR validation, etc.)
-    string getStationNameByCode(const string& code) {
-        for (const Station& s : returnStations()) {
-            if (s.getStationCode() == code) {
-                return s.getStationName();
-            }
-        }
-        return "";
+    // Find station name from code (used in QR validation, etc.); empty if there is none
+    const string& getStationNameByCode(const string& code) const {
+        static const string none;
+        size_t id = findStationIdByCode(code);
+        return id != NO_STATION ? stations[id].getStationName() : none;
     }
 };
\ No newline at end of file
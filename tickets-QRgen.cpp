@@ -1,5 +1,11 @@
 #include "tickets-QRgen.h"
 
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 // ******************** Ticket Info Class    ***************************
 int TicketInfo::ticketCount = 0;
 
@@ -25,21 +31,24 @@ void TicketInfo::displayTicketInfo() {
 }
 
 // Getter
-int TicketInfo::getNoOfTickects(){
+int TicketInfo::getNoOfTickects() const {
     return numberOfTickets;
 }
-double TicketInfo::getPricePerTickect(){
+double TicketInfo::getPricePerTickect() const {
     return pricePerTicket;
 }
-PassengerData TicketInfo::getPassenger(){
+const PassengerData& TicketInfo::getPassenger() const {
     return passenger;
 }
-Station TicketInfo::getArrivalStation(){
+const Station& TicketInfo::getArrivalStation() const {
     return arrival;
 }
-Station TicketInfo::getDepartureStation(){
+const Station& TicketInfo::getDepartureStation() const {
     return departure;
 }
+int TicketInfo::getTicketId() const {
+    return ticketId;
+}
 
 int TicketInfo::getTicketCount(){
     return ticketCount;
@@ -61,6 +70,9 @@ void TicketInfo::setArrivalStation(Station a){
 void TicketInfo::setDepartureStation(Station d){
     departure=d;
 }
+void TicketInfo::setTicketId(int id){
+    ticketId=id;
+}
 
 ostream& operator<<(ostream& out,TicketInfo& obj){
     out<<"Passenger: "<<obj.passenger.getName()<<endl
@@ -163,7 +175,7 @@ void TicketManager::cancelTicket(int id) {
 //****************** SaveTicketToFile Class ******************
 SaveTicketToFile::SaveTicketToFile(TicketInfo& i):info(i){}
 //Append‑safe save
-void SaveTicketToFile::saveAsJSON(const string& filename) const {
+void SaveTicketToFile::saveAsJSON(const string& filename) {
     // 1) Read existing file into JSON array (or start new)
     json arr = json::array();
     ifstream myfile;
@@ -178,13 +190,25 @@ void SaveTicketToFile::saveAsJSON(const string& filename) const {
             // invalid or empty → start fresh array
         }
     }
+    // 2) Give the ticket the next ID after those in the file, so the ID on its QR code can be looked up
+    if (info.getTicketId() == 0) {
+        int lastId = 99;
+        for (const auto& j : arr) {
+            if (j.contains("Ticket ID: ") && j["Ticket ID: "].is_number_integer())
+                lastId = max(lastId, j["Ticket ID: "].get<int>());
+        }
+        info.setTicketId(lastId + 1);
+    }
     // if((info.totalPrice()) < 60){
-        // 2) Append new ticket object                
+        // 3) Append new ticket object                
         arr.push_back({
+            {"Ticket ID: ", info.getTicketId()},
             {"Passenger Name: ", info.getPassenger().getName()},
             {"CNIC: ", info.getPassenger().getCnic()},
             {"Deparure Station: ",      info.getDepartureStation().getStationName()},
             {"Arrival Station: ",        info.getArrivalStation().getStationName()},
+            {"Departure Code: ", info.getDepartureStation().getStationCode()},
+            {"Arrival Code: ", info.getArrivalStation().getStationCode()},
             {"No. of Tickets: ",       info.getNoOfTickects()},
             {"Total Price: ",     info.totalPrice()},
             {"Price Per Ticket: ",  info.getPricePerTickect()}
@@ -193,7 +217,7 @@ void SaveTicketToFile::saveAsJSON(const string& filename) const {
     // else{
     //     cout<<"The total price is greater than 60 so this ticket is not save"<<endl;
     // }
-    // 3) Write back full array                   
+    // 4) Write back full array                   
     ofstream out(filename);
     out << arr.dump(4);
 }
@@ -214,9 +238,12 @@ vector<TicketInfo> SaveTicketToFile::loadAllFromJSON(const string& filename) {
         PassengerData p(j.at("Passenger Name: ").get<string>(), 0, j.at("CNIC: ").get<string>());
         Station d;
         d.setStationName(j.at("Deparure Station: ").get<string>());
+        d.setStationCode(j.value("Departure Code: ", ""));   // not in files from older versions
         Station a;
         a.setStationName(j.at("Arrival Station: ").get<string>());
+        a.setStationCode(j.value("Arrival Code: ", ""));
         TicketInfo t(j.at("No. of Tickets: ").get<int>(), j.at("Price Per Ticket: ").get<double>(), d, a, p);
+        t.setTicketId(j.value("Ticket ID: ", 0));
         result.push_back(t);
     }
     return result;
@@ -244,25 +271,187 @@ bool QRChecker::isValidJSON(const string& j){
 QRCodeData::QRCodeData(){
     qrData="";
 }
-QRCodeData::QRCodeData(PassengerData& p, TicketInfo& t) {
-    qrData = "{\"type\":\"QRCODE\",\"data\":{"
-             "\"Name\":\"" + p.getName() + "\","
-             "\"CNIC\":\"" + p.getCnic() + "\","
-             "\"Departure\":\"" + t.getDepartureStation().getStationName() + "\","
-             "\"Arrival\":\"" + t.getArrivalStation().getStationName() + "\""
-             "}}";
+QRCodeData::QRCodeData(const PassengerData& p, const TicketInfo& t) {
+    buildPayload(p, t, qrData);
+}
+
+void QRCodeData::setQrCodeData(const PassengerData& p, const TicketInfo& t) {
+    buildPayload(p, t, qrData);
+}
+
+// Payload layout: {"type":"QRCODE","data":{"Name":"..","CNIC":"..","Departure":"..","Arrival":".."}}
+void QRCodeData::buildPayload(const PassengerData& p, const TicketInfo& t, string& out) {
+    static const char HEAD[] = "{\"type\":\"QRCODE\",\"data\":{\"Name\":\"";
+    static const char CNIC[] = "\",\"CNIC\":\"";
+    static const char DEP[] = "\",\"Departure\":\"";
+    static const char ARR[] = "\",\"Arrival\":\"";
+    static const char TAIL[] = "\"}}";
+
+    const string& name = p.getName();
+    const string& cnic = p.getCnic();
+    const string& dep = t.getDepartureStation().getStationName();
+    const string& arr = t.getArrivalStation().getStationName();
+
+    size_t length = (sizeof(HEAD) - 1) + (sizeof(CNIC) - 1) + (sizeof(DEP) - 1) + (sizeof(ARR) - 1) + (sizeof(TAIL) - 1)
+                  + escapedLength(name) + escapedLength(cnic) + escapedLength(dep) + escapedLength(arr);
+    out.clear();
+    out.reserve(length);  // No-op when a reused payload is already big enough
+    out.append(HEAD, sizeof(HEAD) - 1);
+    appendEscaped(out, name);
+    out.append(CNIC, sizeof(CNIC) - 1);
+    appendEscaped(out, cnic);
+    out.append(DEP, sizeof(DEP) - 1);
+    appendEscaped(out, dep);
+    out.append(ARR, sizeof(ARR) - 1);
+    appendEscaped(out, arr);
+    out.append(TAIL, sizeof(TAIL) - 1);
+}
+
+// JSON string escaping: quote, backslash and control characters; other bytes (UTF-8) pass through
+size_t QRCodeData::escapedLength(const string& s) {
+    size_t length = 0;
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t')
+            length += 2;
+        else if (c < 0x20)
+            length += 6;  // \u00XX
+        else
+            length += 1;
+    }
+    return length;
+}
+
+void QRCodeData::appendEscaped(string& out, const string& s) {
+    static const char HEX[] = "0123456789abcdef";
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += HEX[c >> 4];
+                    out += HEX[c & 0xF];
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+}
+const string& QRCodeData::getQrCodeData() const {
+    return qrData;
+}
+
+
+// ******************** QR Code Cache Class  ***************************
+QRCodeCache::QRCodeCache(size_t maxB) : maxBytes(maxB), usedBytes(0), hits(0), misses(0) {}
+
+size_t QRCodeCache::makeKey(const string& payload, QrCode::Ecc ecl) {
+    size_t h = hash<string>()(payload);
+    return h ^ (static_cast<size_t>(ecl) + 1) * static_cast<size_t>(0x9E3779B97F4A7C15ull);
 }
 
-void QRCodeData::setQrCodeData(PassengerData& p, TicketInfo& t) {
-    qrData = "{\"type\":\"QRCODE\",\"data\":{"
-             "\"Name\":\"" + p.getName() + "\","
-             "\"CNIC\":\"" + p.getCnic() + "\","
-             "\"Departure\":\"" + t.getDepartureStation().getStationName() + "\","
-             "\"Arrival\":\"" + t.getArrivalStation().getStationName() + "\""
-             "}}";
+size_t QRCodeCache::entryBytes(const Entry& e) {
+    const BitGrid& grid = e.qr.getModules();
+    return sizeof(Entry) + 4 * sizeof(void*)   // List node and index node overhead
+         + e.payload.capacity()
+         + static_cast<size_t>(grid.getSize()) * static_cast<size_t>(grid.getWordsPerRow()) * sizeof(uint64_t)
+         + e.png.capacity();
 }
-string QRCodeData::getQrCodeData(){
-    return qrData;
+
+list<QRCodeCache::Entry>::iterator QRCodeCache::lookup(const string& payload, QrCode::Ecc ecl) {
+    size_t key = makeKey(payload, ecl);
+    auto found = index.find(key);
+    if (found != index.end()) {
+        auto it = found->second;
+        if (it->ecl == ecl && it->payload == payload) {
+            hits++;
+            entries.splice(entries.begin(), entries, it);  // Move to front
+            return it;
+        }
+        // Hash collision: drop the other payload
+        usedBytes -= it->bytes;
+        entries.erase(it);
+        index.erase(found);
+    }
+
+    misses++;
+    QrCode qr = QrCode::encodeTextOptimal(payload.c_str(), ecl);
+    entries.emplace_front(key, payload, ecl, std::move(qr));
+    auto it = entries.begin();
+    it->bytes = entryBytes(*it);
+    usedBytes += it->bytes;
+    index[key] = it;
+    return it;
+}
+
+void QRCodeCache::evictToFit() {
+    // The front entry was just used by the caller, so it stays even if it alone is too big
+    while (usedBytes > maxBytes && entries.size() > 1) {
+        Entry& last = entries.back();
+        usedBytes -= last.bytes;
+        index.erase(last.key);
+        entries.pop_back();
+    }
+}
+
+QrCode QRCodeCache::get(const string& payload, QrCode::Ecc ecl) {
+    lock_guard<mutex> guard(lock);
+    auto it = lookup(payload, ecl);
+    QrCode qr = it->qr;
+    evictToFit();
+    return qr;
+}
+
+vector<uint8_t> QRCodeCache::getPNG(const string& payload, QrCode::Ecc ecl, QRPngWriter& writer) {
+    lock_guard<mutex> guard(lock);
+    auto it = lookup(payload, ecl);
+    if (it->png.empty() || it->pngScale != writer.getScale() || it->pngBorder != writer.getBorder()
+            || it->pngDepth != writer.getDepth() || it->pngCompression != writer.getCompression()) {
+        it->png = writer.encode(it->qr);
+        it->png.shrink_to_fit();
+        it->pngScale = writer.getScale();
+        it->pngBorder = writer.getBorder();
+        it->pngDepth = writer.getDepth();
+        it->pngCompression = writer.getCompression();
+        usedBytes -= it->bytes;
+        it->bytes = entryBytes(*it);
+        usedBytes += it->bytes;
+    }
+    vector<uint8_t> png = it->png;
+    evictToFit();
+    return png;
+}
+
+long QRCodeCache::getHits() const {
+    lock_guard<mutex> guard(lock);
+    return hits;
+}
+long QRCodeCache::getMisses() const {
+    lock_guard<mutex> guard(lock);
+    return misses;
+}
+size_t QRCodeCache::getUsedBytes() const {
+    lock_guard<mutex> guard(lock);
+    return usedBytes;
+}
+size_t QRCodeCache::getMaxBytes() const {
+    return maxBytes;
+}
+size_t QRCodeCache::size() const {
+    lock_guard<mutex> guard(lock);
+    return entries.size();
+}
+void QRCodeCache::clear() {
+    lock_guard<mutex> guard(lock);
+    entries.clear();
+    index.clear();
+    usedBytes = 0;
 }
 
 
@@ -270,14 +459,20 @@ string QRCodeData::getQrCodeData(){
 QRGeneration::QRGeneration(QRCodeData& q){
     qrCode=q;
 }
-void QRGeneration::printQr(const QrCode &qr) {
-    int size = qr.getSize();
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            cout << (qr.getModule(x, y) ? "██" : "  ");
-        }
-        cout << endl; 
-    }
+QRCodeCache& QRGeneration::getCache() {
+    static QRCodeCache cache;
+    return cache;
+}
+void QRGeneration::printQr(const QrCode &qr, bool ansiInverse) {
+    // Anything already sent to cout must appear before the frame, which bypasses it
+    cout.flush();
+    QRTerminalRenderer renderer(ansiInverse ? QRTerminalRenderer::Style::ANSI_INVERSE
+                                            : QRTerminalRenderer::Style::HALF_BLOCKS);
+    // If the write fails, cout gets only the part that did not reach the terminal
+    const string& frame = renderer.getFrame();
+    size_t written = renderer.print(qr);
+    if (written < frame.size())
+        cout.write(frame.data() + written, static_cast<streamsize>(frame.size() - written)) << flush;
 }
 
 void QRGeneration::generateQR(){
@@ -285,7 +480,7 @@ void QRGeneration::generateQR(){
     // const char *text = qrCode.getQrCodeData().c_str();
     try {
         // 2. Generate the QR code using the qrcodegen library.
-        QrCode qr = QrCode::encodeText(qrCode.getQrCodeData().c_str(), QrCode::Ecc::LOW);
+        QrCode qr = getCache().get(qrCode.getQrCodeData(), QrCode::Ecc::LOW);
         printQr(qr);
     } catch (const exception& e) {
         cerr << "QR code generation failed: " << e.what() << endl;
@@ -297,39 +492,278 @@ void QRGeneration::saveQRCodePNG(const string& filename){
     // 1. Define the text you want to encode into the QR code.
     // const char *text = qrCode.getQrCodeData().c_str();
 
-    // 2. Generate the QR code using the qrcodegen library.
-    QrCode qr = QrCode::encodeText(qrCode.getQrCodeData().c_str(), QrCode::Ecc::HIGH);
-    int qrSize = qr.getSize();
-
-    // 3. Define scaling and border settings for the output image.
-    int scale = 10;    // Number of pixels per QR module.
-    int border = 4;    // Border size in terms of modules.
-    int imgSize = (qrSize + 2 * border) * scale;
-
-    // 4. Create a grayscale OpenCV image with a white background.
-    cv::Mat qrImage(imgSize, imgSize, CV_8UC1, cv::Scalar(255));
-
-    // 5. Draw the QR code on the image.
-    // Iterate over each module of the QR code.
-    for (int y = 0; y < qrSize; y++) {
-        for (int x = 0; x < qrSize; x++) {
-            if (qr.getModule(x, y)) {
-                // Calculate top-left pixel coordinates for the current module.
-                int x0 = (x + border) * scale;
-                int y0 = (y + border) * scale;
-                // Draw a filled rectangle for each dark module.
-                cv::rectangle(qrImage, cv::Rect(x0, y0, scale, scale), cv::Scalar(0), cv::FILLED);
-            }
-        }
-    }
+    // 2. Generate the QR code using the qrcodegen library (or reuse the cached image).
+    // 3. Scale 10 pixels per module with a 4-module border, as a 1-bit grayscale PNG.
+    QRPngWriter writer(10, 4);
+    vector<uint8_t> png = getCache().getPNG(qrCode.getQrCodeData(), QrCode::Ecc::HIGH, writer);
 
-    // 6. Save the generated QR code image as a PNG file.
-    if(cv::imwrite(filename, qrImage))
+    ofstream out(filename, ios::binary);
+    out.write(reinterpret_cast<const char*>(png.data()), static_cast<streamsize>(png.size()));
+    if(!png.empty() && out)
         cout << "QR Code successfully saved as 'qrcode.png'" << endl;
     else
         cerr << "Error: Failed to save QR Code image." << endl;
 }
 
+bool QRGeneration::saveQRCodePNG(const QrCode& qr, const string& filename, QRPngWriter& writer){
+    // The writer builds each scaled pixel row straight from the module grid
+    return writer.writeFile(qr, filename);
+}
+
+bool QRGeneration::saveQRCodeSVG(const string& filename, int border, int scale){
+    QrCode qr = getCache().get(qrCode.getQrCodeData(), QrCode::Ecc::HIGH);
+    ofstream out(filename);
+    QRStreamWriter::writeSVG(qr, out, border, scale);
+    return static_cast<bool>(out);
+}
+
+bool QRGeneration::saveQRCodePBM(const string& filename, int border, int scale){
+    QrCode qr = getCache().get(qrCode.getQrCodeData(), QrCode::Ecc::HIGH);
+    ofstream out(filename, ios::binary);
+    QRStreamWriter::writePBM(qr, out, border, scale);
+    return static_cast<bool>(out);
+}
+
+bool QRGeneration::saveQRCodePGM(const string& filename, int border, int scale){
+    QrCode qr = getCache().get(qrCode.getQrCodeData(), QrCode::Ecc::HIGH);
+    ofstream out(filename, ios::binary);
+    QRStreamWriter::writePGM(qr, out, border, scale);
+    return static_cast<bool>(out);
+}
+
+
+// ******************** QR Batch Generation Class  ***************************
+QRBatchGeneration::QRBatchGeneration(unsigned threads, QrCode::Ecc level)
+    : numThreads(threads), ecl(level), lastCount(0), lastSeconds(0) {
+    if (numThreads == 0)
+        numThreads = max(1u, thread::hardware_concurrency());
+}
+
+bool QRBatchGeneration::takeFront(WorkRange& w, size_t& index) {
+    uint64_t r = w.range.load(memory_order_acquire);
+    while (true) {
+        uint64_t begin = r >> 32, end = r & 0xFFFFFFFFu;
+        if (begin >= end)
+            return false;
+        if (w.range.compare_exchange_weak(r, (begin + 1) << 32 | end, memory_order_acq_rel)) {
+            index = static_cast<size_t>(begin);
+            return true;
+        }
+    }
+}
+
+bool QRBatchGeneration::stealBack(WorkRange& victim, WorkRange& own) {
+    uint64_t r = victim.range.load(memory_order_acquire);
+    while (true) {
+        uint64_t begin = r >> 32, end = r & 0xFFFFFFFFu;
+        if (begin >= end)
+            return false;
+        uint64_t split = end - (end - begin + 1) / 2;  // Take the upper half, at least one item
+        if (victim.range.compare_exchange_weak(r, begin << 32 | split, memory_order_acq_rel)) {
+            // Our own range is empty, so nobody can take from it until this store
+            own.range.store(split << 32 | end, memory_order_release);
+            return true;
+        }
+    }
+}
+
+template<typename Task>
+void QRBatchGeneration::runAll(size_t count, Task task) {
+    if (count > 0xFFFFFFFFu)
+        throw length_error("Batch too large");
+    auto start = chrono::steady_clock::now();
+
+    unsigned workers = static_cast<unsigned>(min<size_t>(numThreads, max<size_t>(count, 1)));
+    unique_ptr<WorkRange[]> ranges(new WorkRange[workers]);
+    for (unsigned w = 0; w < workers; w++) {
+        uint64_t begin = count * w / workers, end = count * (w + 1) / workers;
+        ranges[w].range.store(begin << 32 | end, memory_order_relaxed);
+    }
+
+    auto work = [&](unsigned self) {
+        WorkerScratch scratch;
+        size_t index;
+        while (true) {
+            while (takeFront(ranges[self], index))
+                task(index, scratch);
+            // Out of work: try to steal from the others, starting with the next worker
+            bool stolen = false;
+            for (unsigned k = 1; k < workers && !stolen; k++)
+                stolen = stealBack(ranges[(self + k) % workers], ranges[self]);
+            if (!stolen)
+                break;
+        }
+    };
+
+    vector<thread> pool;
+    pool.reserve(workers - 1);
+    for (unsigned w = 1; w < workers; w++)
+        pool.emplace_back(work, w);
+    work(0);  // The calling thread is worker 0
+    for (thread& t : pool)
+        t.join();
+
+    lastCount = count;
+    lastSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+vector<QrCode> QRBatchGeneration::encodeAll(const QRCodeData* payloads, size_t count) {
+    vector<optional<QrCode>> slots(count);
+    exception_ptr firstError;
+    mutex errorMutex;
+    runAll(count, [&](size_t i, WorkerScratch& scratch) {
+        try {
+            slots[i].emplace(scratch.encoder.encodeTextOptimal(payloads[i].getQrCodeData().c_str(), ecl));
+        } catch (...) {
+            lock_guard<mutex> lock(errorMutex);
+            if (!firstError)
+                firstError = current_exception();
+        }
+    });
+    if (firstError)
+        rethrow_exception(firstError);
+
+    vector<QrCode> codes;
+    codes.reserve(count);
+    for (optional<QrCode>& slot : slots)
+        codes.push_back(move(*slot));
+    return codes;
+}
+
+vector<QrCode> QRBatchGeneration::encodeAll(const vector<QRCodeData>& payloads) {
+    return encodeAll(payloads.data(), payloads.size());
+}
+
+size_t QRBatchGeneration::saveAllPNG(const QRCodeData* payloads, size_t count, const string& prefix) {
+    atomic<size_t> saved(0);
+    runAll(count, [&](size_t i, WorkerScratch& scratch) {
+        try {
+            const QrCode& qr = scratch.encoder.encodeTextOptimal(payloads[i].getQrCodeData().c_str(), ecl);
+            scratch.filename.assign(prefix).append(to_string(i)).append(".png");
+            if (QRGeneration::saveQRCodePNG(qr, scratch.filename, scratch.writer))
+                saved.fetch_add(1, memory_order_relaxed);
+        } catch (const exception&) {
+            // Counted as not saved; the caller compares the result with count
+        }
+    });
+    return saved.load();
+}
+
+size_t QRBatchGeneration::saveAllPNG(const vector<QRCodeData>& payloads, const string& prefix) {
+    return saveAllPNG(payloads.data(), payloads.size(), prefix);
+}
+
+unsigned QRBatchGeneration::getNumThreads() const {
+    return numThreads;
+}
+size_t QRBatchGeneration::getLastCount() const {
+    return lastCount;
+}
+double QRBatchGeneration::getLastSeconds() const {
+    return lastSeconds;
+}
+double QRBatchGeneration::getCodesPerSecond() const {
+    return lastSeconds > 0 ? lastCount / lastSeconds : 0.0;
+}
+
+
+// ******************** Compact Ticket Codec Class  ***************************
+CompactTicket CompactTicketCodec::fromTicket(const TicketInfo& t) {
+    CompactTicket ticket;
+    const string& cnic = t.getPassenger().getCnic();
+    ticket.cnic.reserve(cnic.size());
+    for (char c : cnic) {
+        if (c != '-')
+            ticket.cnic += c;
+    }
+    if (t.getTicketId() > 0)
+        ticket.ticketId = to_string(t.getTicketId());
+    ticket.departureCode = t.getDepartureStation().getStationCode();
+    ticket.arrivalCode = t.getArrivalStation().getStationCode();
+    ticket.numberOfTickets = t.getNoOfTickects();
+    return ticket;
+}
+
+bool CompactTicketCodec::canEncode(const CompactTicket& ticket) {
+    auto isCode = [](const string& code) {
+        return !code.empty() && code.find(' ') == string::npos && QrSegment::isAlphanumeric(code.c_str());
+    };
+    return !ticket.cnic.empty() && ticket.cnic.size() < 0x80 && QrSegment::isNumeric(ticket.cnic.c_str())
+        && !ticket.ticketId.empty() && ticket.ticketId.size() < 0x80 && QrSegment::isNumeric(ticket.ticketId.c_str())
+        && isCode(ticket.departureCode) && isCode(ticket.arrivalCode)
+        && ticket.numberOfTickets >= 1 && ticket.numberOfTickets < 0x80;
+}
+
+vector<QrSegment> CompactTicketCodec::makeSegments(const CompactTicket& ticket) {
+    if (!canEncode(ticket))
+        throw invalid_argument("Ticket fields do not fit the compact format");
+    vector<uint8_t> header = {
+        static_cast<uint8_t>(MAGIC),
+        static_cast<uint8_t>(FORMAT_VERSION),
+        static_cast<uint8_t>(ticket.cnic.size()),
+        static_cast<uint8_t>(ticket.ticketId.size()),
+        static_cast<uint8_t>(ticket.numberOfTickets)
+    };
+    string digits = ticket.cnic + ticket.ticketId;
+    string codes = ticket.departureCode + ' ' + ticket.arrivalCode;
+
+    vector<QrSegment> segs;
+    segs.reserve(3);
+    segs.push_back(QrSegment::makeBytes(header));
+    segs.push_back(QrSegment::makeNumeric(digits.c_str()));
+    segs.push_back(QrSegment::makeAlphanumeric(codes.c_str()));
+    return segs;
+}
+
+QrCode CompactTicketCodec::encode(const CompactTicket& ticket, QrCode::Ecc ecl) {
+    return QrCode::encodeSegments(makeSegments(ticket), ecl);
+}
+
+string CompactTicketCodec::toText(const CompactTicket& ticket) {
+    if (!canEncode(ticket))
+        throw invalid_argument("Ticket fields do not fit the compact format");
+    string text;
+    text.reserve(HEADER_LENGTH + ticket.cnic.size() + ticket.ticketId.size()
+                 + ticket.departureCode.size() + 1 + ticket.arrivalCode.size());
+    text += MAGIC;
+    text += FORMAT_VERSION;
+    text += static_cast<char>(ticket.cnic.size());
+    text += static_cast<char>(ticket.ticketId.size());
+    text += static_cast<char>(ticket.numberOfTickets);
+    text += ticket.cnic;
+    text += ticket.ticketId;
+    text += ticket.departureCode;
+    text += ' ';
+    text += ticket.arrivalCode;
+    return text;
+}
+
+bool CompactTicketCodec::decode(const string& text, CompactTicket& out) {
+    if (text.size() < static_cast<size_t>(HEADER_LENGTH) || text[0] != MAGIC || text[1] != FORMAT_VERSION)
+        return false;
+    size_t cnicLen = static_cast<unsigned char>(text[2]);
+    size_t idLen = static_cast<unsigned char>(text[3]);
+    int count = static_cast<unsigned char>(text[4]);
+    size_t digitsEnd = HEADER_LENGTH + cnicLen + idLen;
+    if (cnicLen == 0 || idLen == 0 || count == 0 || digitsEnd >= text.size())
+        return false;
+
+    size_t space = text.find(' ', digitsEnd);
+    if (space == string::npos || space == digitsEnd || space + 1 == text.size())
+        return false;
+
+    CompactTicket ticket;
+    ticket.cnic.assign(text, HEADER_LENGTH, cnicLen);
+    ticket.ticketId.assign(text, HEADER_LENGTH + cnicLen, idLen);
+    ticket.departureCode.assign(text, digitsEnd, space - digitsEnd);
+    ticket.arrivalCode.assign(text, space + 1, string::npos);
+    ticket.numberOfTickets = count;
+    if (!canEncode(ticket))
+        return false;
+    out = std::move(ticket);
+    return true;
+}
+
 
 //──────── Repository<T> ────────
 template<typename T>
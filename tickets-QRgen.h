@@ -9,10 +9,16 @@
 #include <vector>
 #include <map>
 #include <fstream>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #include "json.hpp"
 
 #include "qrcodegen.hpp"
-#include <opencv2/opencv.hpp>  // Ignore this error if you istall the opencv in wsl/linux using command:  sudo apt-get update and sudo apt-get install libopencv-dev
+#include "QRimage.h"
 
 
 using namespace qrcodegen;
@@ -30,6 +36,7 @@ private:
     Station departure;
     Station arrival;
     PassengerData passenger;
+    int ticketId = 0;       // assigned when saved to tickets.json, 0 until then
     static int ticketCount;
 public:
     TicketInfo();
@@ -41,11 +48,12 @@ public:
     // display details
     virtual void displayTicketInfo();
 
-    int getNoOfTickects();
-    double getPricePerTickect();
-    PassengerData getPassenger();
-    Station getArrivalStation();
-    Station getDepartureStation();
+    int getNoOfTickects() const;
+    double getPricePerTickect() const;
+    const PassengerData& getPassenger() const;
+    const Station& getArrivalStation() const;
+    const Station& getDepartureStation() const;
+    int getTicketId() const;
 
     static int getTicketCount();
 
@@ -54,6 +62,7 @@ public:
     void setPassenger(PassengerData p);
     void setArrivalStation(Station a);
     void setDepartureStation(Station d);
+    void setTicketId(int id);
 
     friend ostream& operator<<(ostream& out, TicketInfo& obj); 
     friend istream& operator>>(istream& in, TicketInfo& obj); 
@@ -112,7 +121,8 @@ class SaveTicketToFile {
     TicketInfo& info;
 public:
     SaveTicketToFile(TicketInfo& info);
-    void saveAsJSON(const string& filename) const;  
+    // appends the ticket, giving it the next ticket ID in the file if it has none
+    void saveAsJSON(const string& filename);
     // now returns all tickets saved in file
     static vector<TicketInfo> loadAllFromJSON(const string& filename);
 };
@@ -155,11 +165,68 @@ public:
 class QRCodeData{
 private:
     string qrData;
+
+    // Builds the JSON payload into out with a single reservation of the exact length
+    static void buildPayload(const PassengerData& p, const TicketInfo& t, string& out);
+    static size_t escapedLength(const string& s);
+    static void appendEscaped(string& out, const string& s);
 public:
     QRCodeData();
-    QRCodeData(PassengerData& p, TicketInfo& t);
-    void setQrCodeData(PassengerData& p, TicketInfo& t);
-    string getQrCodeData();
+    QRCodeData(const PassengerData& p, const TicketInfo& t);
+    void setQrCodeData(const PassengerData& p, const TicketInfo& t);
+    const string& getQrCodeData() const;
+};
+
+
+// ******************** QR Code Cache Class  ***************************
+// Bounded LRU cache of encoded codes, keyed by a hash of the payload plus the ECC level,
+// so reprinting a ticket copies the packed module grid instead of re-running the encoder.
+// Entries can also keep the rendered PNG bytes. A hash hit is only used if the stored
+// payload is equal, so colliding payloads just replace each other.
+class QRCodeCache {
+private:
+    struct Entry {
+        size_t key;
+        string payload;
+        QrCode::Ecc ecl;
+        QrCode qr;
+        vector<uint8_t> png;   // Empty until getPNG() is called for this entry
+        int pngScale = 0, pngBorder = 0;
+        QRPngWriter::BitDepth pngDepth = QRPngWriter::BitDepth::GRAY_1;
+        QRPngWriter::Compression pngCompression = QRPngWriter::Compression::FAST;
+        size_t bytes = 0;      // Approximate memory held by this entry
+
+        Entry(size_t k, const string& p, QrCode::Ecc e, QrCode&& q)
+            : key(k), payload(p), ecl(e), qr(std::move(q)) {}
+    };
+
+    list<Entry> entries;       // Most recently used first
+    unordered_map<size_t, list<Entry>::iterator> index;
+    size_t maxBytes;
+    size_t usedBytes;
+    long hits;
+    long misses;
+    mutable mutex lock;
+
+    static size_t makeKey(const string& payload, QrCode::Ecc ecl);
+    static size_t entryBytes(const Entry& e);
+    // Returns the entry for the payload, encoding and inserting it on a miss; caller holds lock
+    list<Entry>::iterator lookup(const string& payload, QrCode::Ecc ecl);
+    void evictToFit();
+
+public:
+    explicit QRCodeCache(size_t maxBytes = 4 * 1024 * 1024);
+
+    QrCode get(const string& payload, QrCode::Ecc ecl);
+    // PNG bytes for the payload as the given writer renders them
+    vector<uint8_t> getPNG(const string& payload, QrCode::Ecc ecl, QRPngWriter& writer);
+
+    long getHits() const;
+    long getMisses() const;
+    size_t getUsedBytes() const;
+    size_t getMaxBytes() const;
+    size_t size() const;
+    void clear();
 };
 
 
@@ -169,11 +236,109 @@ class QRGeneration {
     QRCodeData qrCode;
 public:
     QRGeneration(QRCodeData& q);
-    void printQr(const QrCode &qr);
+    // Shared cache used by the methods below, so reopening a ticket does not re-encode it
+    static QRCodeCache& getCache();
+    // Half-block rendering, or inverse-video spaces for terminals without those glyphs
+    static void printQr(const QrCode &qr, bool ansiInverse = false);
     void generateQR();
     void saveQRCodePNG(const string& filename);
+    // Writes an already encoded code; the writer's buffers are reused between calls
+    static bool saveQRCodePNG(const QrCode& qr, const string& filename, QRPngWriter& writer);
+    // Compact formats for kiosks and e-ticket emails; border in modules, scale per module
+    bool saveQRCodeSVG(const string& filename, int border = 4, int scale = 10);
+    bool saveQRCodePBM(const string& filename, int border = 4, int scale = 1);
+    bool saveQRCodePGM(const string& filename, int border = 4, int scale = 1);
 };
 
+
+// ******************** QR Batch Generation Class  ***************************
+// Encodes many payloads at once across all cores, for bulk ticket issuance.
+// Work is split into one index range per worker; a worker that runs out steals
+// half of the remaining range of another worker, so slow items don't leave cores idle.
+class QRBatchGeneration {
+private:
+    // One worker's remaining items [begin, end), packed as begin << 32 | end so that
+    // the owner (taking from the front) and thieves (taking from the back) agree via CAS
+    struct alignas(64) WorkRange {
+        atomic<uint64_t> range;
+    };
+
+    // Per-thread scratch space, reused for every item the worker handles: the encoder keeps
+    // its segments, codewords and module grid, so workers do not contend on the allocator
+    struct WorkerScratch {
+        QrEncoder encoder;
+        QRPngWriter writer;
+        string filename;
+    };
+
+    unsigned numThreads;
+    QrCode::Ecc ecl;
+    size_t lastCount;
+    double lastSeconds;
+
+    static bool takeFront(WorkRange& w, size_t& index);
+    static bool stealBack(WorkRange& victim, WorkRange& own);
+    // Runs task(index, scratch) for every index in [0, count) and records the timing
+    template<typename Task>
+    void runAll(size_t count, Task task);
+
+public:
+    QRBatchGeneration(unsigned threads = 0, QrCode::Ecc level = QrCode::Ecc::HIGH);
+
+    // Returns the codes in the same order as the payloads; rethrows the first encoding error
+    vector<QrCode> encodeAll(const QRCodeData* payloads, size_t count);
+    vector<QrCode> encodeAll(const vector<QRCodeData>& payloads);
+
+    // Writes payload i to "<prefix><i>.png"; returns how many files were written
+    size_t saveAllPNG(const QRCodeData* payloads, size_t count, const string& prefix);
+    size_t saveAllPNG(const vector<QRCodeData>& payloads, const string& prefix);
+
+    unsigned getNumThreads() const;
+    size_t getLastCount() const;
+    double getLastSeconds() const;
+    double getCodesPerSecond() const;
+};
+
+// ******************** Compact Ticket Codec Class  ***************************
+// A much smaller alternative to the JSON payload, for lower QR versions at the gates:
+//   BYTE segment:         '~', format version, CNIC digit count, ticket ID digit count, number of tickets
+//   NUMERIC segment:      CNIC digits followed by ticket ID digits (3.33 bits per digit)
+//   ALPHANUMERIC segment: "<departure code> <arrival code>", e.g. "LHR1 LHR12" (5.5 bits per char)
+// Every header byte is below 0x80, so scanners that return the content as UTF-8 text
+// (QRscanner.py via pyzbar) see exactly the same characters that decode() expects.
+struct CompactTicket {
+    string cnic;             // Digits only
+    string ticketId;         // Digits only
+    string departureCode;    // QR alphanumeric charset, no spaces
+    string arrivalCode;
+    int numberOfTickets = 1;
+};
+
+class CompactTicketCodec {
+public:
+    static constexpr char MAGIC = '~';
+    static constexpr char FORMAT_VERSION = 1;
+    static constexpr int HEADER_LENGTH = 5;
+
+    // Fills a compact ticket from a booking; CNIC dashes are dropped. A booking that was
+    // never saved has no ticket ID, so it leaves the ID empty and canEncode() false
+    static CompactTicket fromTicket(const TicketInfo& t);
+
+    // False if a field does not fit the format (non-digit CNIC, lowercase station code, ...)
+    static bool canEncode(const CompactTicket& ticket);
+
+    // Throws invalid_argument if canEncode() is false
+    static vector<QrSegment> makeSegments(const CompactTicket& ticket);
+    static QrCode encode(const CompactTicket& ticket, QrCode::Ecc ecl = QrCode::Ecc::HIGH);
+
+    // The text a scanner reports for the code, i.e. the segments' characters concatenated
+    static string toText(const CompactTicket& ticket);
+
+    // Parses scanned text; returns false if it is not a compact ticket
+    static bool decode(const string& text, CompactTicket& out);
+};
+
+
 //──────────── Template class: Repository ────────────
 template<typename T>
 class Repository {